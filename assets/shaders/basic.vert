@@ -3,21 +3,66 @@ layout(location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aColor; // the color variable has attribute position 1
 layout (location = 2) in vec2 aTexCoord; // the color variable has attribute position 2
 layout (location = 3) in vec3 aNormal;
+layout (location = 4) in uint aDrawId; // Batched: per instance, the baseInstance of the draw
 
 out vec3 ourColor;
 out vec2 TexCoord;
 out vec3 FragPos;  
 out vec3 Normal;
+flat out vec3 batchAmbient;
+flat out vec3 batchDiffuse;
+flat out vec4 batchSpecular; // w: shininess
 
 uniform mat4 MVP;
 uniform mat4 model;
 uniform mat3 normalMatrix;
 
+// Compact16 vertices: unorm16 positions over the model bounds, octahedral normals in xy
+uniform bool compactVertices;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+// Batched (DrawBatcher): matrices, quantization and material of each draw in drawData, 12 texels per draw
+uniform bool batched;
+uniform int drawIdBase;
+uniform samplerBuffer drawData;
+uniform mat4 viewProjection;
+
+vec3 OctDecode(vec2 e)
+{
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
 void main()
 {
-    gl_Position = MVP * vec4(aPos, 1.0);
+    mat4 world = model;
+    mat3 normalWorld = normalMatrix;
+    vec3 offset = positionOffset;
+    vec3 scale = positionScale;
+    mat4 mvp = MVP;
+    if (batched)
+    {
+        int texel = (drawIdBase + int(aDrawId)) * 12;
+        world = mat4(texelFetch(drawData, texel), texelFetch(drawData, texel + 1), texelFetch(drawData, texel + 2), texelFetch(drawData, texel + 3));
+        normalWorld = mat3(texelFetch(drawData, texel + 4).xyz, texelFetch(drawData, texel + 5).xyz, texelFetch(drawData, texel + 6).xyz);
+        offset = texelFetch(drawData, texel + 7).xyz;
+        scale = texelFetch(drawData, texel + 8).xyz;
+        batchAmbient = texelFetch(drawData, texel + 9).xyz;
+        batchDiffuse = texelFetch(drawData, texel + 10).xyz;
+        batchSpecular = texelFetch(drawData, texel + 11);
+        mvp = viewProjection * world;
+    }
+
+    vec3 position = compactVertices ? offset + aPos * scale : aPos;
+    vec3 normal = compactVertices ? OctDecode(aNormal.xy) : aNormal;
+
+    gl_Position = mvp * vec4(position, 1.0);
      ourColor = aColor; 
      TexCoord = aTexCoord;
-     FragPos = vec3(model * vec4(aPos,1.0));
-     Normal = normalMatrix * aNormal;
+     FragPos = vec3(world * vec4(position,1.0));
+     Normal = normalWorld * normal;
 }
\ No newline at end of file
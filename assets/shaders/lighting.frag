@@ -4,6 +4,9 @@ in vec3 ourColor;
 in vec3 Normal;
 in vec3 FragPos;  
 in vec2 TexCoord;
+flat in vec3 batchAmbient;
+flat in vec3 batchDiffuse;
+flat in vec4 batchSpecular;
 
 out vec4 FragColor;
 
@@ -64,6 +67,9 @@ struct Material
 }; 
 
 uniform Material material;
+// Batched draws bring their colors from basic.vert, the maps stay uniforms
+uniform bool batched;
+float shininess;
 
 //Process material
 struct Sampled
@@ -88,7 +94,7 @@ vec3 processLight(Light _light, vec3 _dir)
     vec3 viewDir = normalize(viewPos - FragPos);
     vec3 halfwayDir = normalize(_dir + viewDir);  
 
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess*2);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), shininess*2);
     vec3 specular = _light.specularStrength * spec * _light.specularColor * sampled.SpecTex;  
     
     //Combine
@@ -128,10 +134,11 @@ vec3 processSpotLight(SpotLight _spotLight)
 }
 void main()
 {
+   shininess = batched ? batchSpecular.w : material.shininess;
    sampled.Tex = vec3(texture(material.diffuse2D, TexCoord));
-   sampled.AmbTex = sampled.Tex * material.ambient;
-   sampled.DiffTex = sampled.Tex * material.diffuse;
-   sampled.SpecTex = vec3(texture(material.specular2D, TexCoord)) * material.specular;
+   sampled.AmbTex = sampled.Tex * (batched ? batchAmbient : material.ambient);
+   sampled.DiffTex = sampled.Tex * (batched ? batchDiffuse : material.diffuse);
+   sampled.SpecTex = vec3(texture(material.specular2D, TexCoord)) * (batched ? batchSpecular.xyz : material.specular);
 
     vec3 result = vec3(0.f,0.f,0.f);
     for(int i = 0; i < SPOT_LIGHT_NBR;i++)
@@ -1,14 +1,26 @@
 #include <crtdbg.h>
 
+#include <string>
+
 #include <Application.hpp>
+#include <SelfCheck.hpp>
 
-int main()
+int main(int argc, char** argv)
 {
 	//Detect memory leaks
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 	//_CrtSetBreakAlloc(160); // Debugger should stop alloc nb
 	Log::OpenFile("DebugLog.txt");
 
+	// Headless: the checks without window, then exit
+	if (argc > 1 && std::string(argv[1]) == "--check")
+	{
+		int result = SelfCheck::Run();
+		ResourcesManager::Destroy();
+		Log::DeleteInstance();
+		return result;
+	}
+
 	Application app(800, 600);
 	app.Update();
 
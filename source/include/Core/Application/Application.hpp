@@ -10,6 +10,9 @@
 #include <Scene.hpp>
 #include <ResourcesManager.hpp>
 #include <Assertion.hpp>
+#include <GLFunctions.hpp>
+#include <GLState.hpp>
+#include <SelfCheck.hpp>
 
 class Application
 {
@@ -29,6 +32,11 @@ private:
 	static float s_m_MouseScrollOffset;
 
 	bool m_ShowControls = true;
+	int m_crowdCount = 10000;
+	FrustumBenchmark m_cullBenchmark;
+	std::vector<BvhBenchmark> m_bvhBenchmarks;
+	std::vector<DrawListBenchmark> m_drawListBenchmarks;
+	std::vector<ObjParseBenchmark> m_objBenchmarks;
 	void ProcessInput(GLFWwindow* _window);
 	static void Scroll_callback(GLFWwindow* _window, double _xoffset, double _yoffset);
 
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <Bvh.hpp>
+#include <Frustum.hpp>
+#include <ObjParser.hpp>
+#include <OcclusionBuffer.hpp>
+
+// Checks that need no window nor GL context: "modernOpenGL.exe --check" runs them all and exits with 1 if one fails
+class SelfCheck
+{
+public:
+	// Every shipped .obj through the three parsers, their MB/s logged
+	static std::vector<ObjParseBenchmark> BenchmarkObjParsers();
+	// Parse and ParseParallel give the ObjData of ObjParser::ParseReference on every shipped .obj
+	static bool ObjParsers();
+	// Same on a generated .obj big enough for ParseParallel to split (the shipped ones are parsed in one chunk):
+	// groups, comments and faces of 3 and 4 corners across the chunk ends
+	static bool ObjParserChunks();
+
+	// Frustum::Benchmark of the fixed camera over 10000 and 10003 boxes (a SIMD tail): Cull and CullScalar agree on every box
+	static bool FrustumCulling();
+	// 2000 random boxes: Bvh::Query gives the boxes of Frustum::CullScalar once built, after a small move of all (refit)
+	// and after half of them are scattered (rebuild)
+	static bool BvhQuery();
+
+	// Fixed occluders seen by a fixed camera, rasterized on the calling thread or on _pool
+	static OcclusionBuffer RasterizeOcclusionScene(ThreadPool* _pool);
+	// Same depth hash alone and on the pool, equal to s_occlusionDepthHash, boxes behind the wall hidden and the others not
+	static bool OcclusionDepth();
+
+	// Returns the process exit code
+	static int Run();
+
+private:
+	// Camera at the origin looking down -z: 90 degrees vertically, 2:1, near 0.1, far 100
+	static Matrix4x4 GetCheckViewProjection();
+	// About _bytes of .obj text, the same for the same _seed
+	static std::string GenerateObj(size_t _bytes, uint32_t _seed);
+	// Logged by OcclusionDepth: change it only along with the rasterizer
+	static const uint64_t s_occlusionDepthHash = 0x7f57bac7f1e4cf23;
+};
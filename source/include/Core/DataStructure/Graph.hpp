@@ -1,12 +1,20 @@
 #pragma once
 
+#include <unordered_set>
+
 #include <Transform.hpp>
+#include <BoundingVolume.hpp>
+#include <Bvh.hpp>
+#include <Frustum.hpp>
+#include <OcclusionBuffer.hpp>
 #include <assertion.hpp>
 
 #include <Material.hpp>
 #include <Light.hpp>
 
 #include <Camera.hpp>
+#include <DrawBatcher.hpp>
+#include <RenderQueue.hpp>
 
 class Model;
 class Scene;
@@ -19,6 +27,8 @@ struct Node
 	//Dirty Flag
 	bool changed = false;
 
+	// Scene nodes are deleted through their base
+	virtual ~Node() = default;
 	virtual bool UpdateChildren();
 };
 
@@ -47,6 +57,22 @@ protected:
 	SceneNode() : material(material::none) {}
 
 	Transform m_transform;
+	// Model bounds in world space, follow the transform
+	BoundingVolume m_worldBounds;
+	// Transform changed, or the model was not read yet
+	bool m_worldBoundsStale = true;
+	// Model the bounds come from, it is assigned after the node is created
+	const Model* m_worldBoundsModel = nullptr;
+	// Set by SceneGraph::Cull, once a frame
+	bool m_visible = false;
+	// World bounds changed since the BVH last saw them
+	bool m_boundsMoved = true;
+	// Item in the SceneGraph BVH, -1: not in it
+	int32_t m_bvhItem = -1;
+
+	friend class SceneGraph;
+
+	void UpdateWorldBounds();
 
 public:
 	SceneNode(SceneNode* _parent, const Scene* _scene);
@@ -61,6 +87,8 @@ public:
 	Camera* camera = nullptr;
 	Shader* shader = nullptr;
 	const Scene* scene{};
+	// Drawn in the occlusion buffer: big and solid, like a building
+	bool occluder = false;
 
 	void InitDefaultShader(Shader& _shader);
 	bool UpdateChildren() override;
@@ -71,7 +99,40 @@ public:
 	SceneNode* GetParent();
 	Transform& SetTransform();
 	Transform GetTransform();
-	void Draw();
+	// Empty without model, or until it is read
+	const BoundingVolume& GetWorldBounds() const;
+	// In the view at the last SceneGraph::Cull
+	inline bool IsVisible() const {
+		return m_visible;
+	}
+	// Its model draw for the render queue (needs a model), any thread
+	RenderItem MakeRenderItem();
+	// Pushes its model draw, the graph draws the nodes in the queue order
+	void Enqueue(RenderQueue& _queue);
+	// This node only. With _batcher, the model goes to it when it can and is drawn by Submit
+	void Draw(DrawBatcher* _batcher = nullptr);
+};
+
+// Last frame draw list
+struct DrawListStats
+{
+	size_t nodes = 0;
+	size_t batchedDraws = 0;
+	double buildMs = 0.0;	// Queue, sort and batched draw data, on the workers when parallel
+	double submitMs = 0.0;	// GL thread
+};
+
+// The draw list of the visible nodes built on the calling thread, then on the workers
+struct DrawListBenchmark
+{
+	size_t nodes = 0;
+	size_t batchedDraws = 0;
+	double serialMs = 0.0;
+	double parallelMs = 0.0;
+	// Nodes drawn one by one, out of the batcher: the lists compared are mixed when some are
+	size_t unbatchedNodes = 0;
+	// Same nodes, order, batched flags and batcher draws both ways
+	bool matching = true;
 };
 
 // Like a gameobject
@@ -80,15 +141,99 @@ class SceneGraph : public Graph<SceneNode>
 public:
 	std::vector<SceneNode*> entities;
 	const Scene* scene{};
+	DrawBatcher batcher;
+	RenderQueue queue;
+	// From the camera at the last Cull
+	Frustum frustum;
+	// The occluders in view at the last Cull
+	OcclusionBuffer occlusion;
+
+	inline static bool frustumCulling = true;
+	// Culls through the BVH, else every box is tested
+	inline static bool useBvh = true;
+	// Then hides the nodes behind the occluders
+	inline static bool occlusionCulling = true;
+	// Render items and batched draw data made on the ThreadPool, the GL thread only submits
+	inline static bool parallelDrawList = true;
 
 	SceneGraph(Scene* _scene);
 	~SceneGraph();
 
 	void AddEntity(Model* _model, SceneNode* _parent = nullptr, Transform _transform = Transform());
+	// Detaches and deletes them in one pass, their children must be in the list too
+	void RemoveEntities(const std::vector<SceneNode*>& _entities);
 	// Think to do this before drawing and first update
 	void InitDefaultShader(Shader& _shader);
 	// Check if all shaders are initialized first
 	void Update(const float& _deltaTime);
+	// Finds the nodes with a model in the camera frustum, through the BVH or testing every box (4 or 8 at once)
+	// then drops the ones behind the occluder nodes in view (occlusionCulling)
+	// Nodes without bounds yet stay visible. Draw does it, the nodes keep the answer for the frame
+	void Cull();
+	// Visible nodes in the render queue order, batched (DrawBatcher::enabled) draws go out together at the end
 	void Draw();
+	// Culls, then times building the draw list (not submitted) _runs times each way, averaged, and compares the two lists
+	DrawListBenchmark BenchmarkDrawList(size_t _runs);
+	// Of the last draw list built: nodes in order, their batched flag and DrawBatcher::HashDraws
+	uint64_t HashDrawList() const;
 	void Destroy();
+
+	inline size_t GetLastVisible() const {
+		return m_lastVisible;
+	}
+	inline size_t GetLastCulled() const {
+		return m_lastCulled;
+	}
+	inline double GetLastCullMs() const {
+		return m_lastCullMs;
+	}
+	inline const BvhStats& GetBvhStats() const {
+		return m_bvh.GetStats();
+	}
+	inline const DrawListStats& GetLastDrawListStats() const {
+		return m_drawListStats;
+	}
+
+private:
+	std::vector<SceneNode*> m_cullNodes;
+	BoxList m_cullBoxes;
+	std::vector<uint8_t> m_cullResults;
+	// In the order Cull found them
+	std::vector<SceneNode*> m_visibleNodes;
+	size_t m_lastVisible = 0;
+	size_t m_lastCulled = 0;
+	double m_lastCullMs = 0.0;
+
+	// Built over the nodes with bounds when the entities change, refitted when they move
+	Bvh m_bvh;
+	std::vector<SceneNode*> m_bvhNodes;
+	std::vector<SceneNode*> m_unboundedNodes;
+	std::vector<uint32_t> m_bvhVisible;
+	bool m_bvhStale = true;
+
+	std::vector<uint8_t> m_occludedResults;
+
+	// Per queue item, in the sorted order
+	struct DrawSlot
+	{
+		size_t firstDraw;	// In the batcher
+		uint32_t data;
+		bool batched;
+	};
+	std::vector<DrawSlot> m_drawSlots;
+	// BenchmarkDrawList only: nodes drawn one by one whatever their meshes, for a mixed list
+	std::unordered_set<const SceneNode*> m_keptOutOfBatcher;
+
+	inline bool IsKeptOutOfBatcher(const SceneNode* _node) const {
+		return !m_keptOutOfBatcher.empty() && m_keptOutOfBatcher.contains(_node);
+	}
+	DrawListStats m_drawListStats;
+
+	void CullFlat();
+	void CullBvh();
+	void RebuildBvh();
+	// Occluders rasterized and boxes tested on the workers
+	void CullOccluded();
+	// Queue sorted and batched draws added, returns their count
+	size_t BuildDrawList(bool _parallel, bool _batching);
 };
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <fstream>
 #include <filesystem>
+#include <mutex>
 
 #define NOMINMAX
 #include <Windows.h>
@@ -47,7 +48,9 @@ class Log
 private:
 	std::ofstream m_output;
 	HANDLE m_handle = GetStdHandle(STD_OUTPUT_HANDLE);
-	// Singleton /!\ BE CAREFUL: IT IS NOT THREAD SAFE
+	// The pool workers print too: one line at a time
+	std::mutex m_printMtx;
+	// Singleton /!\ BE CAREFUL: create it (OpenFile) before any other thread logs, the colors are not synchronized
 	static Log* m_instance;
 	Log() {};
 
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// Scoped trace events, exported as Chrome trace JSON (chrome://tracing or ui.perfetto.dev)
+// Each thread records into its own buffer: no lock and no allocation once the buffer exists.
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+// TRACE_SCOPE("category", "name") or TRACE_SCOPE("category", "name", "detail")
+#define TRACE_SCOPE(category, ...) TraceScope TRACE_CONCAT(traceScope, __LINE__)(category, __VA_ARGS__)
+
+struct TraceEvent
+{
+	static const size_t s_nameSize = 64;
+
+	char name[s_nameSize];
+	const char* category;	// Must be a literal
+	int64_t startUs;
+	int64_t durationUs;
+	uint64_t asyncId;		// 0: complete event, else async begin/end pair (may overlap)
+};
+
+class Tracer
+{
+public:
+	// Microseconds since the first call
+	static int64_t NowUs();
+
+	static void Record(const char* _category, const char* _name, const char* _detail, int64_t _startUs, int64_t _endUs);
+	// Spans that can overlap on the same thread (ex: time spent waiting in a queue)
+	static void RecordAsync(const char* _category, const char* _name, const char* _detail, int64_t _startUs, int64_t _endUs);
+
+	static void SetThreadName(const std::string& _name);
+	static void SetEnabled(bool _enabled);
+	static bool IsEnabled();
+
+	// Only when no thread is recording (ex: before a load starts, once the pool is idle)
+	static void Clear();
+	// A thread's events past the buffer capacity are dropped, counted per thread in the trace
+	static bool ExportChromeJson(std::filesystem::path const& _filename);
+
+private:
+	static std::atomic<bool> s_m_enabled;
+	static std::atomic<uint64_t> s_m_nextAsyncId;
+
+	static void Push(const char* _category, const char* _name, const char* _detail, int64_t _startUs, int64_t _endUs, uint64_t _asyncId);
+};
+
+class TraceScope
+{
+private:
+	const char* m_category;
+	const char* m_name;
+	const char* m_detail;
+	int64_t m_start;
+
+public:
+	TraceScope(const char* _category, const char* _name, const char* _detail = nullptr)
+		: m_category(_category), m_name(_name), m_detail(_detail), m_start(Tracer::NowUs()) {}
+
+	~TraceScope() {
+		Tracer::Record(m_category, m_name, m_detail, m_start, Tracer::NowUs());
+	}
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+};
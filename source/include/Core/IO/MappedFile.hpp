@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// Read-only memory mapped file, the content is paged in by the OS on access
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(std::filesystem::path const& _filename);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& _other) noexcept;
+	MappedFile& operator=(MappedFile&& _other) noexcept;
+
+	bool Open(std::filesystem::path const& _filename);
+	void Close();
+
+	// An empty file is open with a null Data()
+	inline bool IsOpen() const {
+		return m_isOpen;
+	}
+	inline const char* Data() const {
+		return m_data;
+	}
+	inline size_t Size() const {
+		return m_size;
+	}
+
+	// Asks the OS to page the whole mapping in, without waiting for it
+	void AdviseWillNeed() const;
+
+	// 64-bit hash of the whole content (XXH64 scheme, seed 0), equal files give equal hashes
+	uint64_t ContentHash() const;
+	static uint64_t Hash(const void* _data, size_t _size);
+
+	// Brings a file into the OS page cache without mapping it (blocking on Windows, async hint on POSIX)
+	// Returns the number of bytes prefetched
+	static size_t PrefetchToPageCache(std::filesystem::path const& _filename);
+
+private:
+	bool m_isOpen = false;
+	const char* m_data = nullptr;
+	size_t m_size = 0;
+#ifdef _WIN32
+	void* m_file = nullptr;		// HANDLE
+	void* m_mapping = nullptr;	// HANDLE
+#else
+	int m_fd = -1;
+#endif
+
+	void MoveFrom(MappedFile& _other);
+};
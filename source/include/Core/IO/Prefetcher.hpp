@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Pulls the next files of the load queue into the OS page cache, a few files ahead of the workers,
+// so their reads hit memory instead of waiting on the disk while the pool is parsing
+class Prefetcher
+{
+public:
+	Prefetcher();
+	~Prefetcher();
+
+	Prefetcher(const Prefetcher&) = delete;
+	Prefetcher& operator=(const Prefetcher&) = delete;
+
+	// Files in the order the workers will read them, replaces the previous list
+	void Start(const std::vector<std::filesystem::path>& _orderedFiles, unsigned int _distance);
+	// A load queued after Start (an empty path only takes a slot)
+	void Append(const std::filesystem::path& _file);
+	// Called by a worker when it starts a read, moves the prefetch window
+	void NotifyReadStarted();
+	void Stop();
+
+	void LogStats() const;
+
+private:
+	std::thread m_thread;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_quit = false;
+
+	std::vector<std::filesystem::path> m_files;
+	size_t m_nextFile = 0;
+	size_t m_readsStarted = 0;
+	unsigned int m_distance = 0;
+
+	// Stats of the current list
+	size_t m_prefetchedFiles = 0;
+	uintmax_t m_prefetchedBytes = 0;
+	double m_prefetchSeconds = 0.0;
+
+	void ThreadTask();
+};
@@ -1,43 +1,119 @@
 #pragma once
 
 #include <thread>
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <array>
 #include <queue>
 #include <functional>
 #include <mutex>
 #include <condition_variable>
 
+#include <Log.hpp>
+#include <Tracer.hpp>
+
 class ThreadPool
 {
 public:
 	ThreadPool()
 	{
 		for (int id = 0; id < s_m_poolSize; id++) // Launch workers
-			m_workers[id] = std::thread([this]() { WorkerTask(); });
+			m_workers[id] = std::thread([this, id]() {
+				Tracer::SetThreadName("Worker " + std::to_string(id));
+				WorkerTask();
+			});
 	}
 
 	~ThreadPool()
 	{
-		std::unique_lock<std::mutex> lock(m_queueMtx);
-
-		m_stop = true; // Notify workers they have to stop
+		{
+			std::unique_lock<std::mutex> lock(m_queueMtx);
+			m_stop = true; // Notify workers they have to stop
+		}
 		m_waitCondition.notify_all();
 
 		for (int id = 0; id < s_m_poolSize; id++) // Kill workers thread
 			m_workers[id].join();
 	}
 
+	static constexpr unsigned int GetSize() {
+		return s_m_poolSize;
+	}
+
 	template <class T>
 	void AddToQueue(T&& _func, const std::string& _name)
 	{
+		int64_t queuedAt = Tracer::NowUs();
 		std::unique_lock<std::mutex> lock(m_queueMtx);
-		// Add the task to the queue
-		m_tasksQueue.emplace(std::forward<T>(_func));
+		// Add the task to the queue, traced from its submission to its end
+		m_tasksQueue.emplace([func = std::forward<T>(_func), _name, queuedAt]() mutable {
+			Tracer::RecordAsync("queue", "Queued", _name.c_str(), queuedAt, Tracer::NowUs());
+			TRACE_SCOPE("task", "Task", _name.c_str());
+			func();
+		});
 		Log::Print("Task %s added to Queue.", _name.c_str());
 		// Notify workers that one new task is available
 		m_waitCondition.notify_one();
 	}
 
+	// Calls _func(i) for every i in [0, _count) on the workers and the calling thread, returns once all are done
+	// The caller takes part so it never waits on a busy pool (it can be a worker itself)
+	// _perFrame: helpers are neither logged nor traced (the load trace keeps only the loads), and only idle workers help:
+	// while the pool is busy loading, the loop runs on the calling thread alone
+	template <class F>
+	void ParallelFor(size_t _count, F&& _func, const std::string& _name, bool _perFrame = false)
+	{
+		if (_count == 0)
+			return;
+
+		// Shared: a helper may only start after the loop is over, it must still find the counters
+		struct Job
+		{
+			std::atomic<size_t> next = 0;
+			std::atomic<size_t> done = 0;
+			size_t count = 0;
+		};
+		std::shared_ptr<Job> job = std::make_shared<Job>();
+		job->count = _count;
+
+		// _func is only called while the caller waits, late helpers do not touch it
+		auto run = [job, &_func]() {
+			for (size_t i = job->next.fetch_add(1); i < job->count; i = job->next.fetch_add(1))
+			{
+				_func(i);
+				if (job->done.fetch_add(1, std::memory_order_acq_rel) + 1 == job->count)
+					job->done.notify_all();
+			}
+		};
+
+		size_t helpers = std::min<size_t>(_count - 1, _perFrame ? GetIdleWorkers() : s_m_poolSize);
+		for (size_t h = 0; h < helpers; h++)
+			if (_perFrame)
+				Enqueue(run);
+			else
+				AddToQueue(run, _name);
+		run();
+
+		for (size_t done = job->done.load(std::memory_order_acquire); done < _count; done = job->done.load(std::memory_order_acquire))
+			job->done.wait(done, std::memory_order_acquire);
+	}
+
+	// Workers neither running a task nor about to take a queued one
+	size_t GetIdleWorkers()
+	{
+		std::unique_lock<std::mutex> lock(m_queueMtx);
+		size_t taken = m_running + m_tasksQueue.size();
+		return taken < s_m_poolSize ? s_m_poolSize - taken : 0;
+	}
+
+	// Returns once the queue is empty and no worker runs a task (not from a worker: it would wait on itself)
+	void WaitIdle()
+	{
+		std::unique_lock<std::mutex> lock(m_queueMtx);
+		m_idleCondition.wait(lock, [this] { return m_running == 0 && m_tasksQueue.empty(); });
+	}
+
 private:
 	static const unsigned int s_m_poolSize = 20;
 
@@ -46,8 +122,18 @@ private:
 
 	std::mutex m_queueMtx;
 	std::condition_variable m_waitCondition;
+	std::condition_variable m_idleCondition;
 
 	bool m_stop = false;
+	size_t m_running = 0;	// Under m_queueMtx
+
+	// Untraced, for the per-frame helpers
+	void Enqueue(std::function<void()> _task)
+	{
+		std::unique_lock<std::mutex> lock(m_queueMtx);
+		m_tasksQueue.emplace(std::move(_task));
+		m_waitCondition.notify_one();
+	}
 
 	void WorkerTask()
 	{
@@ -65,8 +151,16 @@ private:
 			// Get the next task from the queue
 			task = std::move(m_tasksQueue.front());
 			m_tasksQueue.pop();
+			m_running++;
 
+			// Other workers can take tasks meanwhile (and the task can queue more)
+			lock.unlock();
 			task();
+
+			lock.lock();
+			m_running--;
+			if (m_running == 0 && m_tasksQueue.empty())
+				m_idleCondition.notify_all();
 		}
 	}
 };
\ No newline at end of file
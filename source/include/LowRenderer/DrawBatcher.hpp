@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <matrix.hpp>
+
+#include <GeometryArena.hpp>
+
+class Shader;
+class Mesh;
+class Material;
+
+// Per draw, read by basic.vert from the draw data buffer (RGBA32F texels)
+struct DrawData
+{
+	float model[4][4];			// Columns
+	float normalMatrix[3][4];	// Columns, w unused
+	float positionOffset[4];
+	float positionScale[4];
+	float ambient[4];
+	float diffuse[4];
+	float specular[4];			// w: shininess, as the shader takes it
+};
+
+// Collects the frame draws of the meshes in geometry arenas, then sends them per batch:
+// same shader, arena (vertex layout), index type and texture units
+// Draws of the same mesh (and LOD) become the instances of one command
+// GL 4.3: one glMultiDrawElementsIndirect per batch, a draw finds its data with aDrawId (baseInstance + instance)
+// Before: one glDrawElements(Instanced)BaseVertex per command, setting only drawIdBase
+class DrawBatcher
+{
+public:
+	inline static bool enabled = true;
+	// Same mesh draws as instances of one command (needs multi-draw or glDrawElementsInstancedBaseVertex)
+	inline static bool instancing = true;
+
+	// Needs glDrawElementsBaseVertex and glVertexAttribDivisor
+	static bool IsSupported();
+	static bool HasMultiDraw();
+	static DrawData MakeDrawData(const Matrix4x4& _model, const Matrix4x4& _normalMatrix, const Vectorf3& _positionOffset,
+		const Vectorf3& _positionScale, const Material& _material);
+
+	void Begin();
+	// False when the mesh is not in an arena, to be drawn by the caller
+	bool Add(Shader& _shader, Mesh& _mesh, size_t _lod, const Material& _material, const DrawData& _data);
+	// Instead of Add, for a list built on several threads: _draws and _data slots, then each written once by any thread
+	void Reserve(size_t _draws, size_t _data);
+	// _mesh must be in an arena
+	void Set(size_t _draw, Shader& _shader, const Mesh& _mesh, size_t _lod, const Material& _material, uint32_t _data);
+	void SetData(uint32_t _data, const DrawData& _drawData);
+	// Draws added since Begin, their state and data, to compare two ways of building them
+	uint64_t HashDraws() const;
+	void Submit(const Matrix4x4& _viewProjection);
+	// GL objects, made again on the next Submit
+	void Release();
+
+	// Last Submit
+	inline size_t GetLastDraws() const {
+		return m_lastDraws;
+	}
+	// Draws left once the instances are merged
+	inline size_t GetLastCommands() const {
+		return m_lastCommands;
+	}
+	inline size_t GetLastCalls() const {
+		return m_lastCalls;
+	}
+	inline size_t GetLastBatches() const {
+		return m_lastBatches;
+	}
+
+private:
+	struct Item
+	{
+		Shader* shader;
+		GeometryArena* arena;
+		unsigned int indexType;
+		unsigned int diffuseUnit;
+		unsigned int specularUnit;
+		DrawElementsIndirectCommand command;
+		uint32_t data;			// In m_data
+	};
+
+	// Commands [firstCommand, + commandCount) of m_commands, their state from m_items[item]
+	struct Batch
+	{
+		size_t firstCommand;
+		size_t commandCount;
+		size_t item;
+	};
+
+	std::vector<Item> m_items;
+	std::vector<DrawData> m_data;
+	// Sorted for the upload
+	std::vector<DrawData> m_sortedData;
+	std::vector<DrawElementsIndirectCommand> m_commands;
+	std::vector<Batch> m_batches;
+
+	unsigned int m_dataBuffer = 0;
+	unsigned int m_dataTexture = 0;
+	unsigned int m_indirectBuffer = 0;
+	unsigned int m_drawIdBuffer = 0;
+	size_t m_drawIdCapacity = 0;
+	// GL_MAX_TEXTURE_BUFFER_SIZE in draws, more go out in several passes
+	size_t m_maxDraws = 0;
+	int m_dataUnit = 0;
+	// drawIdBase of each shader program drawn without multi-draw, looked up once
+	std::vector<std::pair<uint32_t, int>> m_drawIdBaseLocations;
+
+	size_t m_lastDraws = 0;
+	size_t m_lastCommands = 0;
+	size_t m_lastCalls = 0;
+	size_t m_lastBatches = 0;
+
+	static bool SameBatch(const Item& _a, const Item& _b);
+	static bool SameMesh(const Item& _a, const Item& _b);
+	void CreateBuffers();
+	void ReserveDrawIds(size_t _count);
+	int GetDrawIdBaseLocation(const Shader& _shader);
+	// [_first, _last) of m_items, sorted, at most m_maxDraws
+	void SubmitRange(size_t _first, size_t _last, const Matrix4x4& _viewProjection, std::vector<Shader*>& _usedShaders);
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// GL 4.0, not defined by glad
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+// Entry points newer than the generated glad (GL 3.1), null when the driver does not have them
+struct GLFunctions
+{
+	// GL 3.2
+	using DrawElementsBaseVertexProc = void (APIENTRYP)(GLenum _mode, GLsizei _count, GLenum _type, const void* _indices, GLint _baseVertex);
+	inline static DrawElementsBaseVertexProc drawElementsBaseVertex = nullptr;
+	using DrawElementsInstancedBaseVertexProc = void (APIENTRYP)(GLenum _mode, GLsizei _count, GLenum _type, const void* _indices,
+		GLsizei _instanceCount, GLint _baseVertex);
+	inline static DrawElementsInstancedBaseVertexProc drawElementsInstancedBaseVertex = nullptr;
+	// GL 3.3
+	using VertexAttribDivisorProc = void (APIENTRYP)(GLuint _index, GLuint _divisor);
+	inline static VertexAttribDivisorProc vertexAttribDivisor = nullptr;
+	// GL 4.3, also left null when the context is older
+	using MultiDrawElementsIndirectProc = void (APIENTRYP)(GLenum _mode, GLenum _type, const void* _indirect, GLsizei _drawCount, GLsizei _stride);
+	inline static MultiDrawElementsIndirectProc multiDrawElementsIndirect = nullptr;
+
+	// Once the context is current, with the loader given to gladLoadGLLoader
+	static void Load(GLADloadproc _load);
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+#include <glad/glad.h>
+
+enum class GLStateKind
+{
+	Program,
+	VertexArray,
+	Buffer,
+	Texture,
+	Capability,
+
+	Count
+};
+
+struct GLStateCounter
+{
+	size_t issued = 0;
+	size_t skipped = 0;
+};
+
+// Shadow of the bindings the renderer changes, a call that would not change anything is not sent
+// Every change must go through it, or Invalidate after. ImGui restores what it changes, no need there
+// Deleting a bound object makes GL bind 0: tell it with the Forget functions
+struct GLState
+{
+	// Off: every call is sent, still counted as issued
+	inline static bool enabled = true;
+
+	// Each returns true if the call was sent
+	static bool UseProgram(GLuint _program);
+	static bool BindVertexArray(GLuint _vertexArray);
+	// Not GL_ELEMENT_ARRAY_BUFFER: the bound VAO holds it, bind it directly
+	static bool BindBuffer(GLenum _target, GLuint _buffer);
+	// Unit index, not GL_TEXTURE0 + unit
+	static bool ActiveTexture(GLuint _unit);
+	// Makes _unit active if _texture is not bound to it yet
+	static bool BindTexture(GLuint _unit, GLenum _target, GLuint _texture);
+	static bool SetCapability(GLenum _capability, bool _enabled);
+
+	static void ForgetProgram(GLuint _program);
+	static void ForgetVertexArray(GLuint _vertexArray);
+	static void ForgetBuffer(GLuint _buffer);
+	static void ForgetTexture(GLuint _texture);
+	// Nothing known, the next calls are all sent
+	static void Invalidate();
+
+	static void EndFrameStats();
+	static const GLStateCounter& GetLastFrameStats(GLStateKind _kind);
+	static GLStateCounter GetLastFrameTotal();
+
+private:
+	static const GLuint s_unknown = static_cast<GLuint>(-1);
+
+	inline static GLuint s_m_program = s_unknown;
+	inline static GLuint s_m_vertexArray = s_unknown;
+	inline static GLuint s_m_activeTexture = s_unknown;
+	// Keyed by target, (unit, target) and capability, missing: unknown
+	inline static std::unordered_map<GLenum, GLuint> s_m_buffers;
+	inline static std::unordered_map<uint64_t, GLuint> s_m_textures;
+	inline static std::unordered_map<GLenum, bool> s_m_capabilities;
+
+	inline static GLStateCounter s_m_frame[static_cast<size_t>(GLStateKind::Count)];
+	inline static GLStateCounter s_m_lastFrame[static_cast<size_t>(GLStateKind::Count)];
+
+	// Counts the call, true if it has to be sent
+	static bool Change(GLStateKind _kind, bool _changed);
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <VertexLayout.hpp>
+
+// First fit over [0, capacity), a freed range merges with its free neighbours
+class RangeAllocator
+{
+public:
+	static constexpr size_t s_invalid = static_cast<size_t>(-1);
+
+	// Offset multiple of _alignment, s_invalid when no free range is large enough or _size is 0
+	size_t Allocate(size_t _size, size_t _alignment = 1);
+	void Free(size_t _offset, size_t _size);
+	// The added space is free
+	void Grow(size_t _capacity);
+
+	inline size_t GetCapacity() const {
+		return m_capacity;
+	}
+	inline size_t GetUsed() const {
+		return m_used;
+	}
+	inline size_t GetFreeRangeCount() const {
+		return m_free.size();
+	}
+
+private:
+	std::map<size_t, size_t> m_free;	// Offset -> size
+	size_t m_capacity = 0;
+	size_t m_used = 0;
+};
+
+// Where a mesh lives in its arena
+struct ArenaRange
+{
+	size_t baseVertex = 0;
+	size_t vertexCount = 0;
+	size_t indexOffset = 0;		// Bytes into the index buffer
+	size_t indexBytes = 0;
+};
+
+// As glMultiDrawElementsIndirect reads it, firstIndex in indices
+struct DrawElementsIndirectCommand
+{
+	uint32_t count;
+	uint32_t instanceCount;
+	uint32_t firstIndex;
+	int32_t baseVertex;
+	uint32_t baseInstance;
+};
+
+struct GeometryArenaStats
+{
+	size_t arenas = 0;
+	size_t meshes = 0;
+	size_t usedBytes = 0;
+	size_t capacityBytes = 0;
+	size_t freeRanges = 0;
+};
+
+// One VBO, one EBO and one VAO for every mesh of a vertex layout, drawn with glDrawElementsBaseVertex
+// Full buffers are reallocated twice as large (glCopyBufferSubData), GL thread only
+class GeometryArena
+{
+public:
+	// Applies to the meshes set up next
+	inline static bool enabled = true;
+	// basic.vert aDrawId, per instance: the baseInstance of an indirect command
+	static constexpr unsigned int s_drawIdLocation = 4;
+
+	// glDrawElementsBaseVertex loaded (GLFunctions)
+	static bool IsSupported();
+	// Arena of _layout, created on first use
+	static GeometryArena& Get(const VertexLayout& _layout);
+	// The meshes in them must be released first
+	static void DestroyAll();
+	// Buffer of 0, 1, 2... read at s_drawIdLocation by every arena VAO
+	static void SetDrawIdBuffer(unsigned int _buffer);
+	static GeometryArenaStats GetStats();
+
+	~GeometryArena();
+
+	// Copies the buffers in, 16-bit and 32-bit indices share the index buffer (4 bytes aligned)
+	// No vertices or no indices: an empty range (indexBytes 0), nothing copied
+	ArenaRange Allocate(const std::vector<unsigned char>& _vertexData, size_t _vertexCount, const std::vector<unsigned char>& _indexData);
+	void Free(const ArenaRange& _range);
+
+	inline const VertexLayout& GetLayout() const {
+		return m_layout;
+	}
+
+	// Binds the VAO unless it is the bound one (GLState), returns true if it had to
+	bool Bind();
+
+private:
+	GeometryArena(const VertexLayout& _layout);
+
+	VertexLayout m_layout;
+	unsigned int m_VAO = 0, m_VBO = 0, m_EBO = 0;
+	RangeAllocator m_vertices;	// In vertices
+	RangeAllocator m_indices;	// In bytes
+	size_t m_meshCount = 0;
+
+	inline static std::vector<std::unique_ptr<GeometryArena>> s_m_arenas;
+	inline static unsigned int s_m_drawIdBuffer = 0;
+
+	// Reallocates _buffer with _newBytes, keeping the first _oldBytes
+	static void Reallocate(unsigned int& _buffer, size_t _oldBytes, size_t _newBytes);
+	// Points the VAO at the current buffers
+	void AttachBuffers();
+};
@@ -3,8 +3,15 @@
 #include <glad/glad.h>
 
 #include <matrix.hpp>
+#include <atomic>
 #include <vector>
 
+#include <BoundingVolume.hpp>
+#include <GeometryArena.hpp>
+#include <VertexLayout.hpp>
+
+struct OccluderMesh;
+
 struct Vertex
 {
 	Vectorf3 Position;
@@ -12,17 +19,65 @@ struct Vertex
 	Vectorf3 Normal;
 };
 
+// A level of detail: its triangles are a range of the index buffer, over the same vertices
+struct MeshLod
+{
+	size_t indexOffset;
+	size_t indexCount;
+	float error;	// Max distance to the full mesh, in model units
+};
+
 class Mesh
 {
 private:
-	unsigned int m_VAO = -1, m_VBO = -1, m_EBO = -1;
-	std::vector<Vertex> m_vertices;
-	std::vector<unsigned int> m_indices;
+	unsigned int m_VAO = -1, m_VBO = -1, m_EBO = -1;	// Own buffers, when not in an arena
+	GeometryArena* m_arena = nullptr;
+	ArenaRange m_arenaRange;
+	std::vector<Vertex> m_vertices;			// Until PackVertices
+	std::vector<unsigned char> m_vertexData;	// As uploaded, described by m_layout
+	VertexLayout m_layout;
+	size_t m_vertexCount = 0;
+	std::vector<unsigned int> m_indices;	// Every LOD, finest first (until PackIndices)
+	std::vector<unsigned char> m_indexData;	// As uploaded, of m_indexType
+	unsigned int m_indexType = GL_UNSIGNED_INT;
+	std::vector<MeshLod> m_lods;
 	Matrix4x4 m_local = Matrix4x4(true);
+	size_t m_gpuBytes = 0;
+	size_t m_indexBytes = 0;	// Uploaded, the stats do not need m_indexData
+	size_t m_releasedBytes = 0;	// CPU copy dropped since the upload
+	BoundingVolume m_bounds;
+
+	inline static size_t s_m_frameTriangles = 0;
+	inline static size_t s_m_lastFrameTriangles = 0;
+	inline static size_t s_m_frameDraws = 0;
+	inline static size_t s_m_lastFrameDraws = 0;
+	inline static size_t s_m_frameVAOBinds = 0;
+	inline static size_t s_m_lastFrameVAOBinds = 0;
+	// Index buffers on the GPU, and what they would take at 32 bits
+	// Atomic: the workers free, read back and unload meshes too (retention, occluders, reloads)
+	inline static std::atomic<size_t> s_m_indexBufferBytes = 0;
+	inline static std::atomic<size_t> s_m_indexBufferBytes32 = 0;
+	inline static std::atomic<size_t> s_m_shortIndexMeshes = 0;
+	inline static std::atomic<size_t> s_m_uploadedMeshes = 0;
+	inline static std::atomic<size_t> s_m_releasedCpuBytes = 0;
+
+	void ResetLods();
+	// Deletes the GL objects, if uploaded
+	void ReleaseGpu();
+	void ComputeBounds();
 
 public:
+	inline static bool lodEnabled = true;
+	// Switching LOD is invisible while the geometric error stays under a pixel or so
+	inline static float lodMaxPixelError = 1.f;
+
 	Mesh() = default;
-	Mesh(const std::vector<Vertex>& _tmpVertices, const std::vector<uint32_t>& _tmpIdxPositions, const std::vector<uint32_t>& _tmpIdxUvs, const std::vector<uint32_t>& _tmpIdxNormals);
+	// Welds the face corners sharing their file indices, _corners are the triangles over the corners
+	Mesh(const std::vector<Vertex>& _tmpVertices, const std::vector<uint32_t>& _tmpIdxPositions, const std::vector<uint32_t>& _tmpIdxUvs, const std::vector<uint32_t>& _tmpIdxNormals,
+		const std::vector<uint32_t>& _corners);
+	// Ready to upload, as stored in a .mesh file
+	Mesh(const VertexLayout& _layout, std::vector<unsigned char>&& _vertexData, size_t _vertexCount, std::vector<unsigned char>&& _indexData,
+		unsigned int _indexType, std::vector<MeshLod>&& _lods, const BoundingVolume& _bounds);
 	~Mesh();
 
 	void Unload();
@@ -30,6 +85,89 @@ public:
 	void SetVertices(const std::vector<Vertex>& _vertices);
 	void SetIndices(const std::vector<unsigned int>& _indices);
 
+	// Triangle order for the post-transform cache, then vertex order for the fetches (CPU, before SetupMesh)
+	void OptimizeIndexOrder();
+
+	// Simplified levels, halving the triangles while it keeps up (CPU, before SetupMesh)
+	void BuildLods();
+	// Vertices to the VBO layout, the CPU-side edits are over after this
+	void PackVertices();
+	// Compact16 positions are stored as (position - _positionOffset) / _positionScale, in [0, 1]
+	void PackVertices(VertexFormat _format, const Vectorf3& _positionOffset, const Vectorf3& _positionScale);
+	// Smallest index type for the vertex count: 16 bits up to 65536 vertices
+	void PackIndices();
+	// Coarsest level with an error under lodMaxPixelError, _pixelsPerUnit: screen pixels per model unit
+	size_t SelectLod(float _pixelsPerUnit) const;
+	inline size_t GetLodCount() const {
+		return m_lods.size();
+	}
+	inline const std::vector<MeshLod>& GetLods() const {
+		return m_lods;
+	}
+	inline const std::vector<unsigned char>& GetIndexData() const {
+		return m_indexData;
+	}
+	inline unsigned int GetIndexType() const {
+		return m_indexType;
+	}
+	inline size_t GetIndexSize() const {
+		return m_indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+	}
+	inline const std::vector<unsigned char>& GetVertexData() const {
+		return m_vertexData;
+	}
+	inline const VertexLayout& GetLayout() const {
+		return m_layout;
+	}
+	inline size_t GetVertexCount() const {
+		return m_vertexCount;
+	}
+	// Packed vertices and indices, as uploaded (also once their CPU copy is released)
+	inline size_t GetBufferBytes() const {
+		return HasCpuData() ? m_vertexData.size() + m_indexData.size() : m_gpuBytes;
+	}
+
+	// The packed data is left on the CPU after SetupMesh, Draw only needs the LOD ranges
+	inline bool HasCpuData() const {
+		return !m_vertexData.empty() && !m_indexData.empty();
+	}
+	// Frees it once uploaded, returns the bytes freed (0 before the upload)
+	size_t ReleaseCpuData();
+	// Takes back the data of _read, the same mesh read again (false if it differs)
+	bool RestoreCpuData(Mesh& _read);
+
+	// In the GeometryArena of its layout when enabled and supported, else in its own buffers (not uploaded when empty)
 	void SetupMesh();
-	void Draw();
+	void Draw(size_t _lod = 0);
+	// Null when in its own buffers
+	inline GeometryArena* GetArena() const {
+		return m_arena;
+	}
+	// The draw of _lod for a multi-draw from the arena (false when not in one). Any thread: the batcher counts it when it submits
+	bool GetDrawCommand(size_t _lod, DrawElementsIndirectCommand& _command) const;
+
+	// Finest level triangles added to _mesh, positions decoded from the packed vertices (Compact16 ones with the model frame)
+	void AppendTriangles(OccluderMesh& _mesh, const Vectorf3& _positionOffset, const Vectorf3& _positionScale) const;
+
+	// Model space, computed from the vertices when built
+	inline const BoundingVolume& GetBounds() const {
+		return m_bounds;
+	}
+
+	// Triangles, draw calls and VAO binds of the last frame
+	static void EndFrameStats();
+	static size_t GetLastFrameTriangles();
+	static size_t GetLastFrameDraws();
+	static size_t GetLastFrameVAOBinds();
+	// Draws sent without Draw (the batcher), in the frame stats
+	static void AddFrameDraws(size_t _draws, size_t _triangles);
+	// Uploaded index buffers against 32-bit ones
+	static void LogIndexStats();
+	static size_t GetIndexBufferBytes();
+	static size_t GetIndexBufferBytes32();
+	// CPU copies freed after the upload, of the meshes still loaded
+	static size_t GetReleasedCpuBytes();
+
+	size_t GetCpuBytes() const;
+	size_t GetGpuBytes() const;
 };
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Index buffer tools, CPU only (run on the loading workers)
+class MeshOptimizer
+{
+public:
+	// Post-transform cache size used for the stats, close to current GPUs
+	static const unsigned int s_cacheSize = 32;
+
+	// Gives the same id to the corners sharing their (position, uv, normal) file indices
+	// _remap[corner] = welded vertex, _firstCorners[vertex] = a corner using it. Missing uv/normal indices count as 0
+	static void WeldCorners(const std::vector<uint32_t>& _idxPositions, const std::vector<uint32_t>& _idxUvs, const std::vector<uint32_t>& _idxNormals,
+		std::vector<uint32_t>& _remap, std::vector<uint32_t>& _firstCorners);
+
+	// Vertices shaded when drawing the triangle list through a FIFO post-transform cache
+	static size_t SimulateVertexCache(const std::vector<uint32_t>& _indices, size_t _vertexCount, unsigned int _cacheSize = s_cacheSize);
+
+	// Reorders the triangles for the post-transform cache (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation")
+	static void OptimizeVertexCache(std::vector<uint32_t>& _indices, size_t _vertexCount);
+
+	// Renumbers the vertices in order of first use so the fetches go forward in memory
+	// Returns _remap[old vertex] = new vertex, to apply on the vertex buffer
+	static std::vector<uint32_t> OptimizeVertexFetch(std::vector<uint32_t>& _indices, size_t _vertexCount);
+
+	// Quadric error edge collapses (Garland & Heckbert) until _targetIndexCount, cheapest first
+	// Vertices only collapse onto existing ones so every LOD shares the vertex buffer. Border and seam vertices stay
+	// _error: max distance (model units) between the result and the original surface, estimated from the quadrics
+	static std::vector<uint32_t> Simplify(const std::vector<uint32_t>& _indices, const std::vector<float>& _positions, size_t _targetIndexCount, float& _error);
+
+private:
+	static float ForsythVertexScore(int _cachePosition, uint32_t _activeTriangles);
+};
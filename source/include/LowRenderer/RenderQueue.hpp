@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class Shader;
+class Material;
+struct SceneNode;
+
+// 2 bits of the sort key, drawn in this order
+enum class RenderPass : uint32_t
+{
+	Opaque,
+};
+
+// What was pushed, the payload is drawn by the caller in GetItems order
+struct RenderItem
+{
+	uint64_t key;
+	SceneNode* node;
+	uint32_t program;
+	uint64_t textures;		// Diffuse and specular units
+	const void* geometry;	// What binds the vertex array (arena or mesh)
+	uint64_t material;		// Hash of the uniform colors
+};
+
+// State changes between consecutive items, in the order they are drawn
+struct RenderQueueStats
+{
+	size_t items = 0;
+	size_t programSwitches = 0;
+	size_t textureSwitches = 0;
+	size_t vaoSwitches = 0;
+};
+
+// Frame draws as 64-bit sort keys, radix sorted so draws sharing state follow each other
+// Key, high bits first: pass (2) | shader (8) | texture set (12) | geometry (12) | material (14) | depth (16)
+// Textures come before the material, rebinding them costs more than a few uniforms
+// Ids are given per frame in first seen order, past the field size they share the last one (order only, never correctness)
+class RenderQueue
+{
+public:
+	// Off: drawn in push order (scene graph order), the stats then show what sorting saves
+	inline static bool sorted = true;
+
+	void Begin();
+	void Push(const RenderItem& _item);
+	// _depth: view distance over the far plane, near first within the same state
+	// Any thread: the key only has the pass and depth, Sort adds the ids
+	static RenderItem MakeItem(RenderPass _pass, const Shader& _shader, const Material& _material, const void* _geometry, float _depth,
+		SceneNode* _node);
+	// _count items after the pushed ones, to be filled with MakeItem (from several threads)
+	RenderItem* Allocate(size_t _count);
+	// Gives the ids in push order, sorts (if sorted) and counts the switches of the final order
+	void Sort();
+
+	inline const std::vector<RenderItem>& GetItems() const {
+		return m_items;
+	}
+	inline const RenderQueueStats& GetLastStats() const {
+		return m_stats;
+	}
+
+private:
+	std::vector<RenderItem> m_items;
+	std::vector<RenderItem> m_scratch;
+	std::unordered_map<uint64_t, uint32_t> m_shaderIds;
+	std::unordered_map<uint64_t, uint32_t> m_textureIds;
+	std::unordered_map<uint64_t, uint32_t> m_geometryIds;
+	std::unordered_map<uint64_t, uint32_t> m_materialIds;
+	RenderQueueStats m_stats;
+
+	static uint32_t GetId(std::unordered_map<uint64_t, uint32_t>& _ids, uint64_t _value, uint32_t _bits);
+	void AssignIds();
+	// LSD, a byte per pass, passes where every key has the same byte are skipped
+	void RadixSort();
+	void CountSwitches();
+};
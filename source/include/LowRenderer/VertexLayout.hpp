@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// One shader input, as glVertexAttribPointer takes it
+struct VertexAttribute
+{
+	uint32_t location;
+	uint32_t components;
+	uint32_t type;			// GL_FLOAT, GL_SHORT...
+	uint32_t normalized;
+	uint32_t offset;		// Bytes from the start of the vertex
+
+	bool operator==(const VertexAttribute&) const = default;
+};
+
+// What the VBO holds: tightly packed, unlike Vertex (its vectors carry a vtable)
+struct GpuVertex
+{
+	float position[3];
+	float uv[2];
+	float normal[3];
+};
+
+// 16 bytes: position as unorm16 over the model bounds, octahedral normal (unorm16), half float uv
+struct GpuVertexCompact
+{
+	uint16_t position[4];	// w unused, keeps the normal 4 bytes aligned
+	uint16_t normal[2];
+	uint16_t uv[2];
+};
+
+enum class VertexFormat
+{
+	Float32,
+	Compact16,
+};
+
+struct VertexLayout
+{
+	uint32_t stride = 0;
+	std::vector<VertexAttribute> attributes;
+
+	// GpuVertex: position (0), uv (2), normal (3)
+	static VertexLayout Float32();
+	// GpuVertexCompact, same locations, basic.vert decodes it with the vertex format uniforms
+	static VertexLayout Compact16();
+	static VertexLayout Get(VertexFormat _format);
+
+	// Points the attributes at the bound VBO, for the bound VAO
+	void Apply() const;
+
+	bool operator==(const VertexLayout&) const = default;
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+
+#include <matrix.hpp>
+
+// Axis aligned box and sphere around the same points
+struct BoundingVolume
+{
+	Vectorf3 boxMin = Vectorf3(0.f, 0.f, 0.f);
+	Vectorf3 boxMax = Vectorf3(0.f, 0.f, 0.f);
+	Vectorf3 center = Vectorf3(0.f, 0.f, 0.f);
+	float radius = -1.f;	// Negative: holds nothing
+
+	inline bool IsEmpty() const {
+		return radius < 0.f;
+	}
+
+	// _first: x, y, z of the first point, the next one is _strideBytes further (SSE min/max)
+	// The sphere is centered on the box
+	static BoundingVolume FromPoints(const float* _first, size_t _count, size_t _strideBytes);
+
+	// Grows to hold _other as well
+	void Merge(const BoundingVolume& _other);
+
+	// Box of the transformed box (Arvo), sphere scaled by the longest axis
+	BoundingVolume Transformed(const Matrix4x4& _matrix) const;
+};
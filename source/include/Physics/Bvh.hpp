@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <Frustum.hpp>
+
+struct BvhBox
+{
+	float boxMin[3];
+	float boxMax[3];
+};
+
+struct BvhStats
+{
+	size_t items = 0;
+	size_t nodes = 0;
+	size_t depth = 0;
+	float builtCost = 0.f;	// SAH cost right after the build
+	float cost = 0.f;		// After the refits since
+	size_t rebuilds = 0;
+	size_t lastVisitedNodes = 0;
+};
+
+struct BvhBenchmark
+{
+	size_t boxes = 0;
+	size_t visible = 0;
+	size_t visitedNodes = 0;
+	double buildMs = 0.0;
+	double refitMs = 0.0;	// Every box moved
+	double queryMs = 0.0;
+	double flatMs = 0.0;	// Frustum::Cull over every moved box
+	size_t mismatches = 0;	// Query and Frustum::CullScalar disagree, should stay 0
+};
+
+// Bounding volume hierarchy over items 0..n-1, built top-down with a binned surface area heuristic
+// Nodes are stored depth first: a node covers a contiguous range of the item order, its children come after it
+// Moving items is a refit (bounds only, the tree is kept), Refit rebuilds once the tree got too loose
+class Bvh
+{
+public:
+	// Refits past this cost (relative to the built one) rebuild
+	inline static float rebuildRatio = 1.5f;
+
+	void Build(const std::vector<BvhBox>& _boxes);
+	void Clear();
+	// Marks the item leaf for the next Refit
+	void SetBox(uint32_t _item, const BvhBox& _box);
+	// Bottom-up over the marked nodes, true if it rebuilt instead
+	bool Refit();
+
+	// Items in or across the frustum. A subtree fully inside goes out without testing its items, one fully outside is skipped
+	void Query(const Frustum& _frustum, std::vector<uint32_t>& _out);
+
+	inline size_t GetItemCount() const {
+		return m_entries.size();
+	}
+	inline const BvhStats& GetStats() const {
+		return m_stats;
+	}
+
+	// _boxes random boxes (fixed seed): build, refit after moving all of them, query, and the flat SIMD test over the same moved boxes
+	static BvhBenchmark Benchmark(const Frustum& _frustum, size_t _boxes);
+	// Items missing from _items, extra or repeated, against Frustum::CullScalar over _boxes
+	static size_t CountMismatches(const Frustum& _frustum, const std::vector<BvhBox>& _boxes, const std::vector<uint32_t>& _items);
+
+private:
+	struct Node
+	{
+		float boxMin[3];
+		uint32_t first;		// Into m_entries
+		float boxMax[3];
+		uint32_t count;
+		uint32_t right;		// Left child is the next node, 0: leaf
+		uint32_t parent;
+	};
+
+	// The boxes move with the items when they are sorted: a node reads contiguous memory
+	struct Entry
+	{
+		BvhBox box;
+		uint32_t item;
+	};
+
+	static const size_t s_leafSize = 4;
+	static const size_t s_bins = 12;
+
+	std::vector<Entry> m_entries;		// Node order
+	std::vector<Node> m_nodes;
+	std::vector<uint32_t> m_itemSlot;	// Entry of each item
+	std::vector<uint32_t> m_itemLeaf;	// Leaf holding each item
+	std::vector<uint8_t> m_dirty;		// Per node, waiting for Refit
+	bool m_anyDirty = false;
+	std::vector<std::pair<uint32_t, uint8_t>> m_stack;
+	BvhStats m_stats;
+
+	// Over m_entries, in any order
+	void BuildEntries();
+	uint32_t BuildNode(uint32_t _first, uint32_t _count, uint32_t _parent, size_t _depth);
+	void FitNode(Node& _node) const;
+	float ComputeCost() const;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <matrix.hpp>
+
+#include <BoundingVolume.hpp>
+
+// Boxes as center and half extents, an array per coordinate so the SIMD test loads 4 or 8 of them at once
+struct BoxList
+{
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+
+	void Clear();
+	void Reserve(size_t _count);
+	void Add(const BoundingVolume& _bounds);
+	inline size_t Size() const {
+		return centerX.size();
+	}
+};
+
+struct FrustumBenchmark
+{
+	size_t boxes = 0;
+	size_t visible = 0;
+	size_t mismatches = 0;	// Scalar and SIMD disagree, should stay 0
+	double scalarMs = 0.0;
+	double simdMs = 0.0;
+};
+
+enum class FrustumTest
+{
+	Outside,
+	Intersects,
+	Inside,
+};
+
+// Planes pointing inward, a point p is inside one when dot(normal, p) + w >= 0
+struct Frustum
+{
+	float planes[6][4] = {};
+
+	// Gribb-Hartmann: rows of the matrix combined, for a column vector convention (clip = viewProjection * p)
+	static Frustum FromViewProjection(const Matrix4x4& _viewProjection);
+
+	// False only when the box is fully outside a plane: may keep a box near a corner, never drops a visible one
+	bool IsVisible(const BoundingVolume& _bounds) const;
+	// Only the planes of _planeMask (bit i: plane i) are tested, the box is fully inside the others
+	// Planes it is fully inside are removed from the mask: the children of a box need not test them again
+	FrustumTest Classify(const float (&_boxMin)[3], const float (&_boxMax)[3], uint8_t& _planeMask) const;
+	// _visible[i]: 1 if box i is kept. Returns the kept count
+	size_t Cull(const BoxList& _boxes, uint8_t* _visible) const;
+	size_t CullScalar(const BoxList& _boxes, uint8_t* _visible) const;
+	// "AVX, 8 boxes" when built with /arch:AVX or more, else SSE
+	static const char* GetSimdName();
+
+	// _boxes random boxes (fixed seed) against this frustum, scalar then SIMD
+	FrustumBenchmark Benchmark(size_t _boxes) const;
+};
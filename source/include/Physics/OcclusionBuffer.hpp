@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include <matrix.hpp>
+
+#include <BoundingVolume.hpp>
+
+class ThreadPool;
+
+// Model space triangles of an occluder: positions as x, y, z
+struct OccluderMesh
+{
+	std::vector<float> positions;
+	std::vector<uint32_t> indices;
+
+	inline bool IsEmpty() const {
+		return indices.empty();
+	}
+};
+
+struct OcclusionStats
+{
+	size_t occluders = 0;
+	size_t triangles = 0;	// Rasterized, the ones across the near plane are left out
+	size_t tested = 0;
+	size_t occluded = 0;
+	double rasterMs = 0.0;
+	double testMs = 0.0;
+};
+
+// Low resolution depth buffer of the big occluders, drawn on the CPU: boxes fully behind it are hidden
+// Rows are split in bands, a band is rasterized by one thread (4 pixels at once) so the depth does not depend on the thread count
+// A triangle or box crossing the near plane is left out (not drawn, never hidden)
+// Depth is sampled at pixel centers: a box seen only through the uncovered part of an edge pixel can still be hidden
+class OcclusionBuffer
+{
+public:
+	static const int s_width = 256;
+	static const int s_height = 128;
+
+	// Clears the depth and the occluders
+	void Begin(const Matrix4x4& _viewProjection);
+	// Projects the triangles of _mesh placed by _model, drawn by Rasterize (the ones with an index out of positions are skipped)
+	void AddOccluder(const OccluderMesh& _mesh, const Matrix4x4& _model);
+	// A band per task on _pool (untraced, idle workers only), on the calling thread without one
+	void Rasterize(ThreadPool* _pool);
+	// Nearest point of the box behind the depth at every pixel it covers
+	bool IsOccluded(const BoundingVolume& _bounds) const;
+
+	// Row 0 at the bottom, window depth (0 near, 1 far), infinity where nothing was drawn
+	inline const std::vector<float>& GetDepth() const {
+		return m_depth;
+	}
+	// Same scene and camera, same hash
+	uint64_t GetDepthHash() const;
+	// Binary PGM, near is dark, nothing drawn is white
+	bool WriteDepthImage(const std::filesystem::path& _path) const;
+
+	// Counters since Begin
+	inline OcclusionStats& GetStats() {
+		return m_stats;
+	}
+	inline const OcclusionStats& GetStats() const {
+		return m_stats;
+	}
+
+private:
+	static const int s_bandRows = 8;
+	static const int s_bands = s_height / s_bandRows;
+
+	// Screen space (pixels), counterclockwise, depth as a plane over x and y
+	struct Triangle
+	{
+		float x[3];
+		float y[3];
+		float depthX, depthY, depthC;
+		int minX, maxX, minY, maxY;	// Pixels with their center inside the bounds
+	};
+
+	Matrix4x4 m_viewProjection = Matrix4x4(true);
+	std::vector<float> m_depth = std::vector<float>(s_width * s_height);
+	std::vector<Triangle> m_triangles;
+	std::vector<uint32_t> m_bands[s_bands];	// Triangles crossing each band
+	std::vector<float> m_clip;				// AddOccluder scratch, x y z w per vertex
+	OcclusionStats m_stats;
+
+	void RasterizeBand(int _band);
+};
@@ -1,21 +1,80 @@
 #pragma once
 
 #include <string>
+#include <chrono>
+#include <filesystem>
 
 #include <Log.hpp>
+#include <Tracer.hpp>
 #include <atomic>
 
+// Ordered: a state only moves forward, Failed and Evicted are terminal
+enum class ResourceState : unsigned char
+{
+	Queued,		// Created, waiting for a worker
+	Reading,	// File read/parse in progress (worker thread)
+	Decoded,	// CPU data ready, waiting for the OpenGL thread
+	Uploading,	// Claimed by the OpenGL thread
+	Ready,
+	Failed,
+	Evicted,	// Unloaded
+
+	Count
+};
+
+inline const char* ResourceStateName(ResourceState _state)
+{
+	switch (_state)
+	{
+	case ResourceState::Queued:		return "Queued";
+	case ResourceState::Reading:	return "Reading";
+	case ResourceState::Decoded:	return "Decoded";
+	case ResourceState::Uploading:	return "Uploading";
+	case ResourceState::Ready:		return "Ready";
+	case ResourceState::Failed:		return "Failed";
+	case ResourceState::Evicted:	return "Evicted";
+	default:						return "Unknown";
+	}
+}
+
+// File a resource actually read and the time spent reading and decoding it, for the load estimates
+// Hashing, cooking or waiting on another resource is left out, no bytes: nothing read (shared content)
+struct ReadCost
+{
+	std::filesystem::path file;
+	uintmax_t bytes = 0;
+	double seconds = 0.0;
+};
+
 class IResource
 {
 public:
+	using Clock = std::chrono::steady_clock;
+
+	IResource() {
+		SetState(ResourceState::Queued);
+	}
+	// std::atomic is not copyable, copy a snapshot of the state instead
+	IResource(const IResource& _other) {
+		CopyFrom(_other);
+	}
+	IResource& operator=(const IResource& _other)
+	{
+		if (this != &_other)
+			CopyFrom(_other);
+		return *this;
+	}
 	virtual ~IResource() = default;
 
 	void ResourceFileReadTimed(const std::string _name)
 	{
-		auto start = std::chrono::system_clock::now();
+		TRACE_SCOPE("resource", "Read", _name.c_str());
+		SetState(ResourceState::Reading);
 		ResourceFileRead(_name);
-		DEBUG_LOG("%s resource loadtime : %f", _name.c_str(),
-			std::chrono::duration<double>(std::chrono::system_clock::now() - start).count());
+		// A resource that did not report anything is considered read
+		if (GetState() == ResourceState::Reading)
+			SetState(ResourceState::Decoded);
+		DEBUG_LOG("%s resource loadtime : %f", _name.c_str(), GetStageDuration(ResourceState::Reading, GetState()));
 	}
 
 	// To be defined by a class
@@ -23,16 +82,78 @@ public:
 	virtual void ResourceLoadOpenGL(const std::string _name) = 0;
 	virtual void ResourceUnload() = 0;
 
-	inline bool IsReadFinished() {
-		return (m_isRead && !m_isLoaded);
+	// Memory held by the resource, in bytes (GPU is an estimate of what the driver allocates)
+	// Not safe while the resource is Reading: its worker is still filling the data
+	virtual size_t GetCpuBytes() const { return 0; }
+	virtual size_t GetGpuBytes() const { return 0; }
+	virtual const char* GetTypeName() const { return "Resource"; }
+	// File read by ResourceFileRead, empty if it does not read one
+	virtual std::filesystem::path GetSourceFile(const std::string& /*_name*/) const { return {}; }
+
+	inline ResourceState GetState() const {
+		return m_state.load(std::memory_order_acquire);
+	}
+
+	inline bool IsReadFinished() const {
+		return GetState() == ResourceState::Decoded;
+	}
+
+	inline bool IsLoaded() const {
+		return GetState() == ResourceState::Ready;
+	}
+
+	// Ready, Failed or Evicted: nothing left to do for the loader
+	inline bool IsSettled() const {
+		return GetState() >= ResourceState::Ready;
 	}
 
-	inline bool IsLoaded() {
-		return m_isLoaded;
+	// Only one caller can win the Decoded -> Uploading transition,
+	// call ResourceLoadOpenGL only if it returns true
+	bool BeginUpload()
+	{
+		ResourceState expected = ResourceState::Decoded;
+		Clock::time_point now = Clock::now();
+		if (!m_state.compare_exchange_strong(expected, ResourceState::Uploading, std::memory_order_acq_rel, std::memory_order_acquire))
+			return false;
+		m_stateTimes[static_cast<size_t>(ResourceState::Uploading)] = now;
+		m_state.notify_all();
+		return true;
+	}
+
+	// For resources that are read but never sent to OpenGL
+	bool SkipUpload()
+	{
+		if (!BeginUpload())
+			return false;
+		SetState(ResourceState::Ready);
+		return true;
 	}
-	inline void BypassLoad() {
-		 m_isLoaded = true;
+
+	// Blocks until the state reaches _state (or a terminal one), returns the state reached
+	ResourceState WaitForState(ResourceState _state) const
+	{
+		ResourceState current = GetState();
+		while (current < _state)
+		{
+			m_state.wait(current, std::memory_order_acquire);
+			current = GetState();
+		}
+		return current;
 	}
+
+	inline Clock::time_point GetStateTime(ResourceState _state) const {
+		return m_stateTimes[static_cast<size_t>(_state)];
+	}
+
+	// In seconds, between the two transitions
+	inline double GetStageDuration(ResourceState _from, ResourceState _to) const {
+		return std::chrono::duration<double>(GetStateTime(_to) - GetStateTime(_from)).count();
+	}
+
+	inline const ReadCost& GetReadCost() const {
+		return m_readCost;
+	}
+
 	inline unsigned int GetResourceId() const
 	{
 		//if (m_resourceId == static_cast<unsigned int>(-1))
@@ -52,9 +173,44 @@ public:
 	}
 
 protected:
-	bool m_isRead = false;
-	bool m_isLoaded = false;
+	// Timestamp first, then publish the state (release) so a reader that sees it sees the time too
+	// A move backward (under a terminal state reached meanwhile...) is refused, returns false
+	bool SetState(ResourceState _state)
+	{
+		ResourceState current = m_state.load(std::memory_order_relaxed);
+		do
+		{
+			if (_state < current)
+			{
+				DEBUG_WARNING("Resource %s: state %s refused, already %s", m_resourcePath.c_str(), ResourceStateName(_state), ResourceStateName(current));
+				return false;
+			}
+			m_stateTimes[static_cast<size_t>(_state)] = Clock::now();
+		} while (!m_state.compare_exchange_weak(current, _state, std::memory_order_release, std::memory_order_relaxed));
+		m_state.notify_all();
+		return true;
+	}
+
+	// Before the state leaves Reading
+	inline void SetReadCost(const std::filesystem::path& _file, uintmax_t _bytes, double _seconds) {
+		m_readCost = { _file, _bytes, _seconds };
+	}
 
 	unsigned int m_resourceId = -1;
 	std::string m_resourcePath = "";
+
+private:
+	std::atomic<ResourceState> m_state = ResourceState::Queued;
+	Clock::time_point m_stateTimes[static_cast<size_t>(ResourceState::Count)]{};
+	ReadCost m_readCost;
+
+	void CopyFrom(const IResource& _other)
+	{
+		for (size_t i = 0; i < static_cast<size_t>(ResourceState::Count); i++)
+			m_stateTimes[i] = _other.m_stateTimes[i];
+		m_state.store(_other.GetState(), std::memory_order_release);
+		m_resourceId = _other.m_resourceId;
+		m_resourcePath = _other.m_resourcePath;
+		m_readCost = _other.m_readCost;
+	}
 };
\ No newline at end of file
@@ -34,9 +34,10 @@ public:
 	void DetachSpecularMap();
 
 	// Inherited from IResource
-	virtual void ResourceLoadOpenGL(const std::string _name) override { m_isLoaded = true; };
-	virtual void ResourceFileRead(const std::string _name) override { m_isRead = true; };
+	virtual void ResourceLoadOpenGL(const std::string _name) override { SetState(ResourceState::Ready); };
+	virtual void ResourceFileRead(const std::string _name) override { SetState(ResourceState::Decoded); };
 	virtual void ResourceUnload() override {};
+	virtual const char* GetTypeName() const override { return "Material"; }
 };
 
 namespace material
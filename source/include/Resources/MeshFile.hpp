@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+class Mesh;
+
+// .mesh: the buffers as the GPU takes them, loading is a mapping and one copy per blob
+// Little endian, in this order:
+//	MeshFileHeader
+//	MeshFileAttribute[attributeCount]	vertex layout, shared by the submeshes
+//	MeshFileSubmesh[submeshCount]		one per Mesh
+//	MeshFileLod[lodCount]				index ranges of the submeshes, finest first
+//	vertex blob, index blob				16 bytes aligned
+struct MeshFileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t flags;			// MeshFile::Flags, what was done to the meshes when cooked
+	uint32_t attributeCount;
+	uint32_t submeshCount;
+	uint32_t lodCount;
+	uint32_t vertexStride;
+	uint32_t reserved;
+	float boundsMin[3];
+	float boundsMax[3];
+	uint64_t vertexBlobOffset;
+	uint64_t vertexBlobBytes;
+	uint64_t indexBlobOffset;
+	uint64_t indexBlobBytes;
+	uint64_t sourceHash;	// MappedFile::ContentHash of the .obj it was cooked from, 0 if unknown
+};
+
+struct MeshFileAttribute
+{
+	uint32_t location;
+	uint32_t components;
+	uint32_t type;
+	uint32_t normalized;
+	uint32_t offset;
+};
+
+struct MeshFileSubmesh
+{
+	uint64_t vertexOffset;	// Bytes into the vertex blob
+	uint64_t indexOffset;	// Bytes into the index blob
+	uint32_t vertexCount;
+	uint32_t indexCount;	// Every LOD
+	uint32_t firstLod;
+	uint32_t lodCount;
+	float boundsMin[3];
+	float boundsMax[3];
+	float sphereCenter[3];
+	float sphereRadius;
+	uint32_t indexSize;		// Bytes per index, 2 or 4
+	uint32_t padding;
+};
+
+struct MeshFileLod
+{
+	uint32_t indexOffset;	// Indices from the start of the submesh
+	uint32_t indexCount;
+	float error;
+};
+
+class MeshFile
+{
+public:
+	static const uint32_t s_version = 4;
+
+	enum Flags : uint32_t
+	{
+		LodsGenerated = 1 << 0,
+		IndexOrderOptimized = 1 << 1,
+		CompactVertices = 1 << 2,
+	};
+
+	// Meshes must be packed (Mesh::PackVertices, Mesh::PackIndices), with the same vertex layout (stride and every attribute)
+	// Written next to _path then renamed, a failed cook never leaves half a file
+	static bool Write(const std::filesystem::path& _path, const std::vector<Mesh*>& _meshes, uint32_t _flags, uint64_t _sourceHash);
+
+	// Appends the meshes to _out, ready for SetupMesh
+	// Returns the file size, 0 when missing, corrupted, of another version or cooked with other _flags
+	static size_t Read(const std::filesystem::path& _path, std::vector<Mesh*>& _out, uint32_t _flags);
+	// Header only, 0 when missing, of another version or cooked without it
+	static uint64_t ReadSourceHash(const std::filesystem::path& _path);
+	// Vertices and indices (every LOD) of all the submeshes, from the tables only. False like Read
+	static bool ReadCounts(const std::filesystem::path& _path, uint32_t _flags, uint64_t& _vertexCount, uint64_t& _indexCount);
+};
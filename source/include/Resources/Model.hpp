@@ -1,19 +1,46 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+
 #include <Mesh.hpp>
+#include <OcclusionBuffer.hpp>
 #include <IResource.hpp>
 
 #include <Material.hpp>
+#include <Camera.hpp>
+#include <ObjParser.hpp>
 
 class Scene;
 struct SceneNode;
+class DrawBatcher;
+
+// What a model does with the CPU copy of its meshes once uploaded
+enum class GeometryRetention
+{
+	Discard,	// Freed, only the GPU buffers are left
+	Keep,		// For the CPU queries
+	Reload		// Freed, read back from the cooked file when a query needs it
+};
 
 class Model : public IResource
 {
 public:
+	~Model();
+
 	void Draw(Shader& _shader);
 	void Draw();
+	// Each mesh at the LOD that fits its on-screen size
+	void Draw(float _pixelsPerUnit);
+	// Screen pixels covered by one model unit, at the distance of _worldBounds (these bounds transformed) from the camera
+	float GetPixelsPerUnit(const BoundingVolume& _worldBounds, const Camera& _camera) const;
+	// Model space, set once read (empty before)
+	const BoundingVolume& GetBounds() const {
+		return m_bounds;
+	}
 
+	// Shared with the models of the same content when ResourcesManager::shareDuplicates (deleted by the last one)
 	std::vector<Mesh*> meshes;
 	Shader* shader = nullptr;
 	std::vector<Material> materials = { material::none };
@@ -25,23 +52,119 @@ public:
 
 	void ProcessNode(SceneNode* _node, const Scene* _scene);
 	void ProcessNode(SceneNode* _node, const Scene* _scene, Shader* _shader);
+	// The meshes of _node to _batcher, false (nothing added) unless uploaded in geometry arenas
+	bool AddDraws(DrawBatcher& _batcher, SceneNode* _node, const Scene* _scene);
+	// Draws AddDraws would add (one per mesh), 0 when it would return false
+	size_t GetBatchedDrawCount(const SceneNode* _node) const;
+	// AddDraws into DrawBatcher::Reserve slots: a draw per mesh from _firstDraw, their data at _data. Any thread
+	void SetDraws(DrawBatcher& _batcher, SceneNode* _node, const Scene* _scene, size_t _firstDraw, uint32_t _data) const;
+	// What binds its vertex arrays, for the render queue: the arena of its meshes, else its first mesh (a VAO each)
+	const void* GetGeometryKey() const;
+
+	// Triangles of every mesh for the occlusion buffer, decoded by the reading worker (empty before Ready, or unless SetOccluder)
+	const OccluderMesh& GetOccluderMesh() const;
+
+	// Every mesh has its packed vertices and indices on the CPU
+	bool HasCpuGeometry() const;
+	// Reads them back from the cooked file, false without one (or cooked again since)
+	bool ReloadCpuGeometry();
+	// Frees them, returns the bytes freed (the uploaded meshes only)
+	size_t ReleaseCpuGeometry();
+	inline GeometryRetention GetRetention() const {
+		return m_retention;
+	}
 
 	static void ResetCount();
 
+	// Vertex format of the model loaded as _name (set before creating it), ResourcesManager::compactVertices for the others
+	static void SetVertexFormat(const std::string& _name, VertexFormat _format);
+	static VertexFormat GetVertexFormat(const std::string& _name);
+	// Geometry retention of the model loaded as _name (set before it is created or queued), ResourcesManager::discardCpuGeometry for the others
+	static void SetGeometryRetention(const std::string& _name, GeometryRetention _retention);
+	static GeometryRetention GetGeometryRetention(const std::string& _name);
+	// The model loaded as _name decodes its occluder triangles while read (set before it is created or queued)
+	static void SetOccluder(const std::string& _name, bool _occluder);
+	static bool IsOccluder(const std::string& _name);
+
 	// Inherited from IResource
 	virtual void ResourceFileRead(const std::string _path) override;
 	virtual void ResourceLoadOpenGL(const std::string _name) override;
 	virtual void ResourceUnload() override;
+	virtual size_t GetCpuBytes() const override;
+	virtual size_t GetGpuBytes() const override;
+	virtual const char* GetTypeName() const override { return "Model"; }
+	virtual std::filesystem::path GetSourceFile(const std::string& _name) const override;
+
+	// Name of the model whose meshes this one uses, empty when it read its own
+	const std::string& GetSharedWith() const {
+		return m_sharedWith;
+	}
 
 private:
-	std::mutex m_meshMtx;
+	// Meshes of one read, kept alive by every model using them
+	struct SharedMeshes
+	{
+		std::vector<Mesh*> meshes;
+		// What the sharers compare theirs to, the content hash alone is not proof
+		std::string owner;
+		uintmax_t objBytes = 0;		// 0: no .obj
+		uint64_t vertexCount = 0;
+		uint64_t indexCount = 0;
+		std::once_flag uploaded;
+		// One of the models sharing them keeps the CPU copy: the upload does not free it, nor does a Reload model
+		// Also guards the CPU copy itself, freed or read back by any of them. Taken after the model's m_meshMtx, never before
+		std::mutex retentionMtx;
+		bool keepGeometry = false;
+		~SharedMeshes();
+	};
+
+	mutable std::mutex m_meshMtx;
+	std::shared_ptr<SharedMeshes> m_shared;
+	std::string m_sharedWith;
+	std::string m_name;
+	GeometryRetention m_retention = GeometryRetention::Discard;
+	// MappedFile::ContentHash of the .obj, written in the .mesh when cooked
+	uint64_t m_sourceHash = 0;
 	// Model data
 	std::string m_directory;
-	std::vector<uint32_t> m_indices;
+	// Every mesh, model space
+	BoundingVolume m_bounds;
+	// Compact16 positions are relative to the model bounds, basic.vert scales them back
+	VertexFormat m_vertexFormat = VertexFormat::Float32;
+	Vectorf3 m_positionOffset = Vectorf3(0.f, 0.f, 0.f);
+	Vectorf3 m_positionScale = Vectorf3(1.f, 1.f, 1.f);
+	// Written by the reading worker before Decoded, read once Ready
+	OccluderMesh m_occluder;
+
+	// Builds the meshes (welded) from a parsed .obj, on the reading thread
+	void BuildFromObj(ObjData& _data);
+	// Model bounds and quantization frame from the mesh bounds
+	void UpdateBounds();
+	void SetVertexUniforms(const Shader& _shader) const;
+
+	// The .mesh was cooked from another .obj than the current one (copied or checked out with an older time), hashes it
+	bool IsCookStale(const std::filesystem::path& _cooked, const std::string& _name);
+	// Same source content and cook flags: same meshes
+	uint64_t GetContentKey(const std::filesystem::path& _path, const std::string& _name);
+	// Takes the meshes of the model that claimed the same content first, false if this one must read them
+	bool ReadShared(const std::filesystem::path& _path, const std::string& _name);
+	// Source size and counts of _shared against this model's files, false when they differ or none could be compared
+	bool MatchesShared(const SharedMeshes& _shared, const std::filesystem::path& _path, const std::string& _name) const;
+	// Once the meshes are read: Reload without a cooked file of their owner falls back to Keep
+	void ApplyRetention(SharedMeshes& _shared);
+	// Decodes m_occluder on the reading thread, reading the CPU geometry back if it was already freed (a shared owner uploaded)
+	void BuildOccluder();
+	// Retention lock of the shared meshes, for their CPU copy (nothing to lock before they are shared). m_meshMtx held
+	std::unique_lock<std::mutex> LockCpuGeometry() const;
+
+	// Returns the seconds taken, negative if it could not be opened
+	double ReadObj(const std::filesystem::path& _path, const std::string& _name);
+	bool ReadCooked(const std::filesystem::path& _path, const std::string& _name);
+	// Writes the meshes to a .mesh, then times reading them back against the .obj
+	void Cook(const std::string& _name, double _objSeconds);
 
-	// Tmp index
-	std::vector<Vertex> m_tmpVertices;
-	std::vector<uint32_t> m_tmpIdxPositions;
-	std::vector<uint32_t> m_tmpIdxUvs;
-	std::vector<uint32_t> m_tmpIdxNormals;
+	static std::filesystem::path GetObjFile(const std::string& _name);
+	static std::filesystem::path GetCookedFile(const std::string& _name);
+	// Where the meshes are read back from: the cooked file of the model that read them
+	std::filesystem::path GetReloadFile() const;
 };
\ No newline at end of file
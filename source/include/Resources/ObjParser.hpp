@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// Counts reached when a "g ... default" line is parsed, the model snapshots a mesh there
+struct ObjGroupMark
+{
+	size_t positions;
+	size_t uvs;
+	size_t normals;
+	size_t idxPositions;
+	size_t idxUvs;
+	size_t idxNormals;
+	size_t indices;
+};
+
+// Raw content of an .obj, in file order (indices are 1-based as in the file)
+struct ObjData
+{
+	std::vector<float> positions;	// xyz
+	std::vector<float> uvs;			// uv
+	std::vector<float> normals;		// xyz
+
+	std::vector<uint32_t> idxPositions;
+	std::vector<uint32_t> idxUvs;
+	std::vector<uint32_t> idxNormals;
+	std::vector<uint32_t> indices;	// Triangles, faces fanned around their first vertex
+	uint32_t faceVertices = 0;		// Next face starts at this index
+
+	std::vector<ObjGroupMark> groups;
+
+	void Clear();
+};
+
+struct ObjParseBenchmark
+{
+	std::string file;
+	double megaBytes = 0.0;
+	double referenceMs = 0.0;	// ParseReference from an ifstream
+	double serialMs = 0.0;		// Mapped, Parse
+	double parallelMs = 0.0;	// Mapped, ParseParallel
+	size_t chunks = 0;
+	bool sameOutput = false;	// Parse and ParseParallel against ParseReference
+	bool opened = false;
+};
+
+// Scans the bytes in place: no allocation per line, numbers read with std::from_chars (locale independent)
+class ObjParser
+{
+public:
+	// Appends the content of [_begin, _end) to _out, the range must hold whole lines
+	static void Parse(const char* _begin, const char* _end, ObjData& _out);
+
+	// Splits big files at line ends, parses the chunks on the pool and merges them with prefix-summed offsets
+	// Same result as Parse, returns the number of chunks (1: parsed on the calling thread)
+	static size_t ParseParallel(const char* _begin, const char* _end, ObjData& _out, ThreadPool& _pool);
+
+	// The getline/istringstream parser Parse replaced, kept to check it: same output, quirks included
+	static void ParseReference(std::istream& _in, ObjData& _out);
+	// Same content, the "g default" marks before any vertex aside (ParseReference drops them, the models skip them)
+	static bool SameOutput(const ObjData& _a, const ObjData& _b);
+	// Times the three parsers on _path and compares their output
+	static ObjParseBenchmark Benchmark(const std::filesystem::path& _path, ThreadPool& _pool);
+
+private:
+	// Below, splitting costs more than it saves
+	static const size_t s_parallelMinBytes = 4 * 1024 * 1024;
+	static const size_t s_chunkBytes = 1024 * 1024;
+};
@@ -1,31 +1,124 @@
 #pragma once
 
+#include <chrono>
 #include <unordered_map>
 
 #include <Log.hpp>
 #include <Model.hpp>
 
 #include <ThreadPool.hpp>
+#include <Prefetcher.hpp>
 #include <IResource.hpp>
 
+struct ResourceMemoryInfo
+{
+	std::string name;
+	const char* type;
+	ResourceState state;
+	size_t cpuBytes;
+	size_t gpuBytes;
+};
+
+struct ResourceMemoryTotals
+{
+	const char* type;
+	size_t count;
+	size_t cpuBytes;
+	size_t gpuBytes;
+};
+
+// Load waiting for SubmitLoadBatch
+struct PendingLoad
+{
+	IResource* resource;
+	std::string name;
+	double estimatedSeconds;
+};
+
+// Measured read speed of a load kind (resource type and source extension)
+struct LoadThroughput
+{
+	double bytesPerSecond;
+	double fixedSeconds;	// Per file, whatever its size
+	unsigned int samples;
+};
+
+// Reads of the last load batch submitted in an order, from SubmitLoadBatch to the last read done
+struct LoadBatchTiming
+{
+	size_t files = 0;
+	double estimatedMs = 0.0;	// SimulateMakespan of the submitted order
+	double measuredMs = 0.0;	// 0 until its reads are all done
+	unsigned int loads = 0;		// Batches measured in this order
+};
+
 class ResourcesManager
 {
 private:
 	static std::atomic<ResourcesManager*> s_m_instance;
+	// Guards s_m_resources: the scene loader thread adds to it while the UI reports on it
+	// Also guards the batch state, BeginLoadBatch and SubmitLoadBatch may come from another thread than the creations
 	static std::mutex s_m_mutex;
 	static std::unordered_map<std::string, IResource*> s_m_resources;
 	static ThreadPool s_m_threadPool;
+	static Prefetcher s_m_prefetcher;
+
+	static bool s_m_batching;
+	static std::vector<PendingLoad> s_m_pendingLoads;
+	static std::mutex s_m_throughputMutex;
+	static std::unordered_map<std::string, LoadThroughput> s_m_throughputs;
+	// Guarded by s_m_throughputMutex, [0] source order, [1] longest first
+	static LoadBatchTiming s_m_batchTimings[2];
+	static std::chrono::steady_clock::time_point s_m_batchStart;
+	static bool s_m_batchLongestFirst;
+	// Decremented by the reads of the current batch (their id), the last one done measures it
+	static std::atomic<uint64_t> s_m_batchId;
+	static std::atomic<size_t> s_m_batchReadsLeft;
+	// Content key -> first resource that claimed it, and its name
+	static std::mutex s_m_contentMutex;
+	static std::unordered_map<uint64_t, std::pair<IResource*, std::string>> s_m_contentOwners;
+
+	// _batchId: 0 out of a batch
+	static void QueueRead(IResource* _resource, const std::string& _name, uint64_t _batchId = 0);
+	static void FinishLoadBatch();
+	// From the IResource::ReadCost of _resource, nothing when it did not read a file itself
+	static void RecordThroughput(const IResource* _resource);
+	// Makespan of a list scheduling on the pool, in the given order
+	static double SimulateMakespan(const std::vector<PendingLoad>& _loads);
 
 	ResourcesManager();
 	~ResourcesManager();
 
 public:
+	// Sort batched loads longest first (applies to the next SubmitLoadBatch)
+	inline static bool longestJobFirst = true;
+	// Read the next files into the page cache ahead of the workers (applies to the next SubmitLoadBatch)
+	inline static bool prefetchEnabled = true;
+	inline static int prefetchDistance = 8;
+	// Reorder mesh triangles and vertices for the GPU caches while reading
+	inline static bool optimizeMeshes = true;
+	// Simplified levels of detail for each mesh while reading
+	inline static bool generateLods = true;
+	// Read meshes from assets/meshes/cooked/*.mesh, cooked from the .obj when missing, older or of another content
+	inline static bool useCookedMeshes = true;
+	// Compact16 vertices (16 bytes instead of 32) for the models without a Model::SetVertexFormat
+	inline static bool compactVertices = true;
+	// Free the CPU copy of the meshes once uploaded, for the models without a Model::SetGeometryRetention
+	inline static bool discardCpuGeometry = true;
+	// Models of identical content share the meshes and buffers of the first one read
+	inline static bool shareDuplicates = true;
+
 	static ResourcesManager* GetInstance();
+	// For resources that split their own work (ThreadPool::ParallelFor)
+	static ThreadPool& GetThreadPool() {
+		return s_m_threadPool;
+	}
 
 	// Maybe try to make the parameter a path...
 	template<typename R>
 	static R* CreateResource(const std::string& _name, bool _isMultiThread)
 	{
+		TRACE_SCOPE("manager", "Create", _name.c_str());
 		IResource* createdResource = new R();
 		if (!_isMultiThread)
 		{
@@ -33,6 +126,7 @@ public:
 			createdResource->ResourceFileReadTimed(_name);
 
 			// Erase previous pointer if found
+			std::lock_guard<std::mutex> lock(s_m_mutex);
 			auto it = s_m_resources.find(_name);
 			if (it != s_m_resources.end())
 				delete it->second;
@@ -41,6 +135,7 @@ public:
 		}
 		else
 		{
+			std::lock_guard<std::mutex> lock(s_m_mutex);
 			auto it = s_m_resources.find(_name);
 			if (it == s_m_resources.end())
 				return nullptr;
@@ -53,20 +148,44 @@ public:
 	template<typename R>
 	static void CreateResourceThreaded(const std::string& _name)
 	{
+		TRACE_SCOPE("manager", "Submit", _name.c_str());
 		IResource* createdResource = new R();
 		createdResource->SetResourcePath(_name);
 
-		s_m_threadPool.AddToQueue([createdResource, _name]() { createdResource->ResourceFileReadTimed(_name); }, _name + " creation");
+		// Stat now, the batch is ordered with it
+		std::error_code error;
+		std::filesystem::path file = createdResource->GetSourceFile(_name);
+		uintmax_t fileBytes = file.empty() ? 0 : std::filesystem::file_size(file, error);
+		if (error)
+			fileBytes = 0;
 
-		auto it = s_m_resources.find(_name);
-		if (it != s_m_resources.end())
-			delete it->second;
-		s_m_resources.emplace(_name, createdResource);
+		double estimatedSeconds = EstimateLoadSeconds(GetLoadKind(createdResource->GetTypeName(), file), fileBytes);
+
+		bool batched = false;
+		{
+			std::lock_guard<std::mutex> lock(s_m_mutex);
+			batched = s_m_batching;
+			if (batched)
+				s_m_pendingLoads.push_back({ createdResource, _name, estimatedSeconds });
+
+			auto it = s_m_resources.find(_name);
+			if (it != s_m_resources.end())
+				delete it->second;
+			s_m_resources.emplace(_name, createdResource);
+		}
+
+		if (!batched)
+		{
+			// Keeps the prefetch list in the queue order
+			s_m_prefetcher.Append(file);
+			QueueRead(createdResource, _name);
+		}
 	}
 
 	template<typename R>
 	static R* GetResource(const std::string& _name)
 	{
+		std::lock_guard<std::mutex> lock(s_m_mutex);
 		auto it = s_m_resources.find(_name);
 		if (it != s_m_resources.end())
 		{
@@ -84,6 +203,30 @@ public:
 
 	static bool IsPoolDone();
 
+	// nullptr when _resource is the first to claim _key (it reads the content),
+	// else the first one, its name in _ownerName
+	static IResource* ClaimContent(uint64_t _key, IResource* _resource, const std::string& _name, std::string& _ownerName);
+	// Forgets the keys claimed by _resource, before it is deleted
+	static void ReleaseContent(const IResource* _resource);
+
+	// CreateResourceThreaded calls in between are queued together by SubmitLoadBatch
+	static void BeginLoadBatch();
+	// Longest estimated first (LPT) so the big files do not start last
+	static void SubmitLoadBatch();
+	// Type and extension of the source file ("Model .obj", "Model .mesh"...): text and binary meshes read at very different speeds
+	static std::string GetLoadKind(const std::string& _type, const std::filesystem::path& _file);
+	// From the throughput measured on previous loads of the same kind
+	static double EstimateLoadSeconds(const std::string& _kind, uintmax_t _fileBytes);
+	static void LogThroughputs();
+	static void LogPrefetchStats();
+	// Last batch loaded in that order, to compare both measured makespans
+	static LoadBatchTiming GetLoadBatchTiming(bool _longestFirst);
+
+	// Memory per resource, sorted by total size (biggest first)
+	static std::vector<ResourceMemoryInfo> GetMemoryReport();
+	static std::vector<ResourceMemoryTotals> GetMemoryTotalsByType();
+	static void ShowImGuiMemory();
+
 	static void Destroy();
 	void Delete(const std::string& _name);
 };
\ No newline at end of file
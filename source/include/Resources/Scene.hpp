@@ -79,9 +79,16 @@ public:
 	void Draw();
 	void Destroy();
 	void Restart();
+	// Replaces the previous crowd: _count cubes in a grid under the scene, each with its material
+	// Stress test for the batched and instanced draws
+	void SpawnCrowd(size_t _count);
+	inline size_t GetCrowdSize() const {
+		return m_crowd.size();
+	}
 
 private:
 	bool m_justRestarted = true;
+	std::vector<SceneNode*> m_crowd;
 
 	std::thread m_oneThreadToRuleThemAll;
 	uint64_t m_startLoad = 0;
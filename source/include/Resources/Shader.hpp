@@ -41,9 +41,11 @@ public:
 	static void ResetCount();
 
 	// Inherited from IResource
-	void ResourceLoadOpenGL(const std::string _name) override { m_isLoaded = true; };
-	void ResourceFileRead(const std::string _name) override { m_isRead = true; };
+	void ResourceLoadOpenGL(const std::string _name) override { SetState(ResourceState::Ready); };
+	void ResourceFileRead(const std::string _name) override { SetState(ResourceState::Decoded); };
 	void ResourceUnload() override;
+	size_t GetCpuBytes() const override { return m_vertexShaderSource.capacity() + m_fragmentShaderSource.capacity(); }
+	const char* GetTypeName() const override { return "Shader"; }
 
 	void DeleteVertFrag();
 	void DeleteProgram();
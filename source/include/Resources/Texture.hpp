@@ -12,6 +12,7 @@ class Texture : public IResource
 private:
 	int m_width = -1, m_height = -1, m_channels = -1;
 	unsigned char* m_data = nullptr;
+	size_t m_gpuBytes = 0;
 
 public:
 	Texture() {};
@@ -21,4 +22,8 @@ public:
 	void ResourceFileRead(const std::string _name);
 	void ResourceLoadOpenGL(const std::string _name) override;
 	void ResourceUnload() override;
+	size_t GetCpuBytes() const override;
+	size_t GetGpuBytes() const override;
+	const char* GetTypeName() const override { return "Texture"; }
+	std::filesystem::path GetSourceFile(const std::string& _name) const override;
 };
\ No newline at end of file
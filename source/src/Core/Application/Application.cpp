@@ -20,11 +20,12 @@ Application::Application(int _width, int _height) : m_scene(_width, _height)
 	}
 	glfwMakeContextCurrent(m_window);
 	Assert(gladLoadGLLoader((GLADloadproc)glfwGetProcAddress), "Failed to initialize GLAD");
+	GLFunctions::Load((GLADloadproc)glfwGetProcAddress);
 	Log::Print("'S' + 'I' Keys to hide/show controls");
 
 	glViewport(0, 0, _width, _height);
 	glClearColor(m_ClearColor[0], m_ClearColor[1], m_ClearColor[2], m_ClearColor[3]);
-	glEnable(GL_DEPTH_TEST);
+	GLState::SetCapability(GL_DEPTH_TEST, true);
 	glfwSetFramebufferSizeCallback(m_window, framebuffer_size_callback);
 	SetupImGui(m_window);
 }
@@ -36,13 +37,14 @@ Application::~Application() {
 void Application::Destroy()
 {
 	m_scene.Destroy();
+	GeometryArena::DestroyAll();
 
 	// IMGUI Destroyed
 	ImGui_ImplGlfw_Shutdown();
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui::DestroyContext();
 
-	glDisable(GL_DEPTH_TEST);
+	GLState::SetCapability(GL_DEPTH_TEST, false);
 	glfwDestroyWindow(m_window);
 	glfwTerminate();
 }
@@ -62,6 +64,8 @@ void Application::Update()
 		if (m_ShowControls)
 			ShowImGuiControls();
 		Render(m_window);
+		Mesh::EndFrameStats();
+		GLState::EndFrameStats();
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 		glfwSwapBuffers(m_window);
 	}
@@ -92,6 +96,138 @@ void Application::ShowImGuiControls()
 		}
 		if (ImGui::CollapsingHeader("Camera", ImGuiTreeNodeFlags_DefaultOpen))
 			m_scene.camera.ShowImGuiControls();
+		if (ImGui::CollapsingHeader("Loading"))
+		{
+			ImGui::Text("Applied on next load ('R')");
+			ImGui::Checkbox("Longest job first", &ResourcesManager::longestJobFirst);
+			LoadBatchTiming sourceOrder = ResourcesManager::GetLoadBatchTiming(false);
+			LoadBatchTiming longestFirst = ResourcesManager::GetLoadBatchTiming(true);
+			ImGui::Text("Batch reads measured: source order %.1f ms, longest first %.1f ms", sourceOrder.measuredMs, longestFirst.measuredMs);
+			if (sourceOrder.measuredMs > 0.0 && longestFirst.measuredMs > 0.0)
+				ImGui::Text("Longest first gain: %.1f%% (estimated %.1f%%)", (1.0 - longestFirst.measuredMs / sourceOrder.measuredMs) * 100.0,
+					sourceOrder.estimatedMs > 0.0 ? (1.0 - longestFirst.estimatedMs / sourceOrder.estimatedMs) * 100.0 : 0.0);
+			ImGui::Checkbox("Prefetch files", &ResourcesManager::prefetchEnabled);
+			ImGui::SliderInt("Prefetch distance", &ResourcesManager::prefetchDistance, 1, 32);
+			ImGui::Checkbox("Optimize mesh index order", &ResourcesManager::optimizeMeshes);
+			ImGui::Checkbox("Generate LODs", &ResourcesManager::generateLods);
+			ImGui::Checkbox("Cooked meshes (.mesh)", &ResourcesManager::useCookedMeshes);
+			ImGui::Checkbox("Compact vertices (16 bytes)", &ResourcesManager::compactVertices);
+			ImGui::Checkbox("Share duplicate models", &ResourcesManager::shareDuplicates);
+			ImGui::Checkbox("Free CPU geometry after upload", &ResourcesManager::discardCpuGeometry);
+			ImGui::Text("CPU geometry freed: %.1f KB", Mesh::GetReleasedCpuBytes() / 1024.f);
+			ImGui::Checkbox("Geometry arena", &GeometryArena::enabled);
+			if (ImGui::Button("Benchmark OBJ parsers"))
+				m_objBenchmarks = SelfCheck::BenchmarkObjParsers();
+			for (const ObjParseBenchmark& result : m_objBenchmarks)
+			{
+				auto rate = [&result](double _ms) { return _ms > 0.0 ? result.megaBytes * 1000.0 / _ms : 0.0; };
+				ImGui::BulletText("%s: reference %.0f MB/s, Parse %.0f MB/s, parallel %.0f MB/s%s", result.file.c_str(), rate(result.referenceMs),
+					rate(result.serialMs), rate(result.parallelMs), result.sameOutput ? "" : " (DIFFERENT output)");
+			}
+		}
+		if (ImGui::CollapsingHeader("Rendering"))
+		{
+			ImGui::Text("Triangles: %zu", Mesh::GetLastFrameTriangles());
+			ImGui::Text("Draws: %zu, VAO binds: %zu", Mesh::GetLastFrameDraws(), Mesh::GetLastFrameVAOBinds());
+			ImGui::Checkbox("Skip redundant GL calls", &GLState::enabled);
+			GLStateCounter total = GLState::GetLastFrameTotal();
+			ImGui::Text("GL state calls: %zu issued, %zu skipped", total.issued, total.skipped);
+			const char* kinds[] = { "Programs", "VAOs", "Buffers", "Textures", "Capabilities" };
+			for (size_t i = 0; i < static_cast<size_t>(GLStateKind::Count); i++)
+			{
+				const GLStateCounter& counter = GLState::GetLastFrameStats(static_cast<GLStateKind>(i));
+				ImGui::BulletText("%s: %zu issued, %zu skipped", kinds[i], counter.issued, counter.skipped);
+			}
+			ImGui::Checkbox("Frustum culling", &SceneGraph::frustumCulling);
+			ImGui::SameLine();
+			ImGui::Checkbox("BVH", &SceneGraph::useBvh);
+			ImGui::Text("Culling: %zu visible, %zu culled in %.3f ms (%s)", m_scene.graph.GetLastVisible(), m_scene.graph.GetLastCulled(),
+				m_scene.graph.GetLastCullMs(), SceneGraph::useBvh ? "BVH" : Frustum::GetSimdName());
+			const BvhStats& bvhStats = m_scene.graph.GetBvhStats();
+			ImGui::Text("BVH: %zu nodes over %zu items, depth %zu, cost %.1f (built %.1f), %zu rebuilds, %zu nodes visited", bvhStats.nodes,
+				bvhStats.items, bvhStats.depth, bvhStats.cost, bvhStats.builtCost, bvhStats.rebuilds, bvhStats.lastVisitedNodes);
+			if (ImGui::Button("Benchmark culling (1M boxes)"))
+			{
+				m_cullBenchmark = m_scene.graph.frustum.Benchmark(1000000);
+				DEBUG_LOG("Culled %zu boxes (%zu visible): scalar %.2f ms, %s %.2f ms, %zu mismatches", m_cullBenchmark.boxes, m_cullBenchmark.visible,
+					m_cullBenchmark.scalarMs, Frustum::GetSimdName(), m_cullBenchmark.simdMs, m_cullBenchmark.mismatches);
+			}
+			if (m_cullBenchmark.boxes)
+				ImGui::Text("%zu boxes: scalar %.2f ms, SIMD %.2f ms, %zu mismatches", m_cullBenchmark.boxes, m_cullBenchmark.scalarMs,
+					m_cullBenchmark.simdMs, m_cullBenchmark.mismatches);
+			if (ImGui::Button("Benchmark BVH (1k to 1M boxes)"))
+			{
+				m_bvhBenchmarks.clear();
+				for (size_t boxes = 1000; boxes <= 1000000; boxes *= 10)
+				{
+					BvhBenchmark result = Bvh::Benchmark(m_scene.graph.frustum, boxes);
+					DEBUG_LOG("BVH over %zu boxes: build %.2f ms, refit %.2f ms, query %.3f ms (%zu visible, %zu nodes visited), flat SIMD %.3f ms, %zu mismatches",
+						result.boxes, result.buildMs, result.refitMs, result.queryMs, result.visible, result.visitedNodes, result.flatMs, result.mismatches);
+					m_bvhBenchmarks.push_back(result);
+				}
+			}
+			for (const BvhBenchmark& result : m_bvhBenchmarks)
+				ImGui::BulletText("%zu: build %.2f ms, refit %.2f ms, query %.3f ms, flat %.3f ms, %zu mismatches", result.boxes, result.buildMs,
+					result.refitMs, result.queryMs, result.flatMs, result.mismatches);
+			ImGui::Checkbox("Occlusion culling", &SceneGraph::occlusionCulling);
+			const OcclusionStats& occlusionStats = m_scene.graph.occlusion.GetStats();
+			ImGui::Text("Occlusion: %zu occluders, %zu triangles in %.3f ms, %zu of %zu hidden (%.1f%%) in %.3f ms", occlusionStats.occluders,
+				occlusionStats.triangles, occlusionStats.rasterMs, occlusionStats.occluded, occlusionStats.tested,
+				occlusionStats.tested ? 100.f * occlusionStats.occluded / occlusionStats.tested : 0.f, occlusionStats.testMs);
+			if (ImGui::Button("Save occlusion depth"))
+			{
+				const OcclusionBuffer& occlusion = m_scene.graph.occlusion;
+				if (occlusion.WriteDepthImage("OcclusionDepth.pgm"))
+					DEBUG_LOG("Occlusion depth (%dx%d) written to OcclusionDepth.pgm, hash %016llx", OcclusionBuffer::s_width, OcclusionBuffer::s_height,
+						static_cast<unsigned long long>(occlusion.GetDepthHash()));
+			}
+			ImGui::Checkbox("Parallel draw list", &SceneGraph::parallelDrawList);
+			const DrawListStats& drawListStats = m_scene.graph.GetLastDrawListStats();
+			ImGui::Text("Draw list: %zu nodes, %zu batched draws, built in %.3f ms, submitted in %.3f ms", drawListStats.nodes,
+				drawListStats.batchedDraws, drawListStats.buildMs, drawListStats.submitMs);
+			if (ImGui::Button("Benchmark draw list (crowd 1k to 100k)"))
+			{
+				size_t crowd = m_scene.GetCrowdSize();
+				m_drawListBenchmarks.clear();
+				for (size_t count = 1000; count <= 100000; count *= 10)
+				{
+					m_scene.SpawnCrowd(count);
+					m_scene.graph.Update(0.f);
+					DrawListBenchmark result = m_scene.graph.BenchmarkDrawList(10);
+					DEBUG_LOG("Draw list of %zu nodes (%zu batched draws, %zu nodes one by one, crowd %zu): %.3f ms on the main thread, %.3f ms on the pool",
+						result.nodes, result.batchedDraws, result.unbatchedNodes, count, result.serialMs, result.parallelMs);
+					if (!result.matching)
+						DEBUG_WARNING("Draw list of %zu nodes: the pool list differs from the main thread one", result.nodes);
+					m_drawListBenchmarks.push_back(result);
+				}
+				m_scene.SpawnCrowd(crowd);
+			}
+			for (const DrawListBenchmark& result : m_drawListBenchmarks)
+				ImGui::BulletText("%zu nodes: %.3f ms serial, %.3f ms parallel (x%.1f)%s", result.nodes, result.serialMs, result.parallelMs,
+					result.parallelMs > 0.0 ? result.serialMs / result.parallelMs : 0.0, result.matching ? "" : ", lists DIFFER");
+			ImGui::Checkbox("Sort draws", &RenderQueue::sorted);
+			const RenderQueueStats& queueStats = m_scene.graph.queue.GetLastStats();
+			ImGui::Text("Queue: %zu nodes, switches: %zu programs, %zu textures, %zu VAOs", queueStats.items, queueStats.programSwitches,
+				queueStats.textureSwitches, queueStats.vaoSwitches);
+			ImGui::Checkbox("Batch draws", &DrawBatcher::enabled);
+			ImGui::Checkbox("Instancing", &DrawBatcher::instancing);
+			ImGui::Text("Batched: %zu draws, %zu commands in %zu batches, %zu calls (%s)", m_scene.graph.batcher.GetLastDraws(),
+				m_scene.graph.batcher.GetLastCommands(), m_scene.graph.batcher.GetLastBatches(), m_scene.graph.batcher.GetLastCalls(),
+				DrawBatcher::HasMultiDraw() ? "multi-draw indirect" : "one by one");
+			ImGui::SliderInt("Crowd", &m_crowdCount, 0, 100000);
+			ImGui::SameLine();
+			if (ImGui::Button("Spawn"))
+				m_scene.SpawnCrowd(static_cast<size_t>(m_crowdCount));
+			ImGui::Text("Crowd: %zu cubes", m_scene.GetCrowdSize());
+			GeometryArenaStats arenaStats = GeometryArena::GetStats();
+			ImGui::Text("Geometry arenas: %zu, %zu meshes, %.1f / %.1f KB (%zu free ranges)", arenaStats.arenas, arenaStats.meshes,
+				arenaStats.usedBytes / 1024.f, arenaStats.capacityBytes / 1024.f, arenaStats.freeRanges);
+			ImGui::Text("Index buffers: %.1f KB (%.1f KB at 32 bits)", Mesh::GetIndexBufferBytes() / 1024.f, Mesh::GetIndexBufferBytes32() / 1024.f);
+			ImGui::Checkbox("LOD", &Mesh::lodEnabled);
+			ImGui::SliderFloat("LOD max error (px)", &Mesh::lodMaxPixelError, 0.25f, 8.f);
+		}
+		if (ImGui::CollapsingHeader("Memory"))
+			ResourcesManager::ShowImGuiMemory();
 	}
 	ImGui::End();
 }
@@ -0,0 +1,269 @@
+#include <SelfCheck.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <sstream>
+
+#include <Log.hpp>
+#include <ResourcesManager.hpp>
+
+std::vector<ObjParseBenchmark> SelfCheck::BenchmarkObjParsers()
+{
+	std::vector<ObjParseBenchmark> results;
+	std::error_code error;
+	for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator("assets/meshes", error))
+		if (entry.path().extension() == ".obj")
+			results.push_back(ObjParser::Benchmark(entry.path(), ResourcesManager::GetThreadPool()));
+	std::sort(results.begin(), results.end(), [](const ObjParseBenchmark& _a, const ObjParseBenchmark& _b) {
+		return _a.file < _b.file; });
+
+	for (const ObjParseBenchmark& result : results)
+	{
+		auto rate = [&result](double _ms) { return _ms > 0.0 ? result.megaBytes * 1000.0 / _ms : 0.0; };
+		DEBUG_LOG("%s: %.2f MB, reference %.1f MB/s, Parse %.1f MB/s, ParseParallel %.1f MB/s (%zu chunks), %s", result.file.c_str(),
+			result.megaBytes, rate(result.referenceMs), rate(result.serialMs), rate(result.parallelMs), result.chunks,
+			result.sameOutput ? "same output" : "DIFFERENT output");
+	}
+	return results;
+}
+
+bool SelfCheck::ObjParsers()
+{
+	std::vector<ObjParseBenchmark> results = BenchmarkObjParsers();
+	if (results.empty())
+	{
+		DEBUG_WARNING("No .obj in assets/meshes, run from the solution directory");
+		return false;
+	}
+	return std::all_of(results.begin(), results.end(), [](const ObjParseBenchmark& _result) {
+		return _result.opened && _result.sameOutput; });
+}
+
+std::string SelfCheck::GenerateObj(size_t _bytes, uint32_t _seed)
+{
+	std::mt19937 random(_seed);
+	std::uniform_real_distribution<float> coordinate(-10.f, 10.f);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+	std::string text = "# Generated by SelfCheck::GenerateObj\n";
+	char line[128];
+	uint32_t positions = 0, uvs = 0, normals = 0;
+	for (int group = 0; text.size() < _bytes; group++)
+	{
+		text += "\n# Part " + std::to_string(group) + "\ng part" + std::to_string(group) + " default\n";
+		const uint32_t vertices = 500;
+		for (uint32_t i = 0; i < vertices; i++)
+		{
+			std::snprintf(line, sizeof(line), "v %f %f %f\nvt %f %f\nvn %f %f %f\n", coordinate(random), coordinate(random), coordinate(random),
+				unit(random), unit(random), unit(random), unit(random), unit(random));
+			text += line;
+		}
+		positions += vertices;
+		uvs += vertices;
+		normals += vertices;
+
+		// Corners anywhere in the file so far, the chunks reference the vertices of the chunks before them
+		std::uniform_int_distribution<uint32_t> corner(0, vertices - 1);
+		for (uint32_t face = 0; face < vertices; face++)
+		{
+			text += "f";
+			int corners = face % 3 == 0 ? 4 : 3;
+			for (int c = 0; c < corners; c++)
+			{
+				uint32_t position = positions - corner(random), uv = uvs - corner(random), normal = normals - corner(random);
+				std::snprintf(line, sizeof(line), " %u/%u/%u", position, uv, normal);
+				text += line;
+			}
+			text += "\n";
+		}
+	}
+	return text;
+}
+
+bool SelfCheck::ObjParserChunks()
+{
+	// Over ObjParser's parallel threshold, several chunks even on a small pool
+	std::string text = GenerateObj(6 * 1024 * 1024, 1234);
+	const char* begin = text.data();
+	const char* end = begin + text.size();
+
+	ObjData reference, serial, parallel;
+	std::istringstream stream(text);
+	ObjParser::ParseReference(stream, reference);
+	ObjParser::Parse(begin, end, serial);
+	size_t chunks = ObjParser::ParseParallel(begin, end, parallel, ResourcesManager::GetThreadPool());
+
+	bool sameSerial = ObjParser::SameOutput(reference, serial);
+	bool sameParallel = ObjParser::SameOutput(reference, parallel);
+	DEBUG_LOG("Generated .obj: %.2f MB, %zu groups, %zu triangles, %zu chunks, Parse %s, ParseParallel %s", text.size() / (1024.0 * 1024.0),
+		reference.groups.size(), reference.indices.size() / 3, chunks, sameSerial ? "same output" : "DIFFERENT output",
+		sameParallel ? "same output" : "DIFFERENT output");
+	if (chunks < 2)
+		DEBUG_WARNING("Generated .obj parsed in one chunk: the chunk merge was not checked");
+	return chunks >= 2 && sameSerial && sameParallel;
+}
+
+Matrix4x4 SelfCheck::GetCheckViewProjection()
+{
+	const float nearPlane = 0.1f, farPlane = 100.f;
+	return Matrix4x4{
+		{ 0.5f, 0.f, 0.f, 0.f },
+		{ 0.f, 1.f, 0.f, 0.f },
+		{ 0.f, 0.f, (farPlane + nearPlane) / (nearPlane - farPlane), 2.f * farPlane * nearPlane / (nearPlane - farPlane) },
+		{ 0.f, 0.f, -1.f, 0.f } };
+}
+
+bool SelfCheck::FrustumCulling()
+{
+	Frustum frustum = Frustum::FromViewProjection(GetCheckViewProjection());
+	bool passed = true;
+	for (size_t boxes : { static_cast<size_t>(10000), static_cast<size_t>(10003) })
+	{
+		FrustumBenchmark result = frustum.Benchmark(boxes);
+		DEBUG_LOG("Frustum culling of %zu boxes: %zu visible, %s, %zu mismatches", result.boxes, result.visible, Frustum::GetSimdName(),
+			result.mismatches);
+		// The camera sees part of the boxes: an empty result would compare nothing
+		passed = passed && result.mismatches == 0 && result.visible != 0;
+	}
+	return passed;
+}
+
+bool SelfCheck::BvhQuery()
+{
+	Frustum frustum = Frustum::FromViewProjection(GetCheckViewProjection());
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> position(-120.f, 120.f);
+	std::uniform_real_distribution<float> extent(0.1f, 3.f);
+	std::uniform_real_distribution<float> move(-0.5f, 0.5f);
+	auto place = [&](BvhBox& _box) {
+		for (int k = 0; k < 3; k++)
+		{
+			float center = position(random), half = extent(random);
+			_box.boxMin[k] = center - half;
+			_box.boxMax[k] = center + half;
+		}
+	};
+	std::vector<BvhBox> boxes(2000);
+	for (BvhBox& box : boxes)
+		place(box);
+
+	Bvh bvh;
+	bvh.Build(boxes);
+	std::vector<uint32_t> visible;
+	auto matches = [&](const char* _step) {
+		visible.clear();
+		bvh.Query(frustum, visible);
+		size_t mismatches = Bvh::CountMismatches(frustum, boxes, visible);
+		DEBUG_LOG("BVH %s: %zu of %zu boxes visible, %zu nodes visited, %zu mismatches", _step, visible.size(), boxes.size(),
+			bvh.GetStats().lastVisitedNodes, mismatches);
+		return mismatches == 0 && !visible.empty();
+	};
+	bool passed = matches("built");
+
+	for (uint32_t i = 0; i < boxes.size(); i++)
+	{
+		float offset = move(random);
+		for (int k = 0; k < 3; k++)
+		{
+			boxes[i].boxMin[k] += offset;
+			boxes[i].boxMax[k] += offset;
+		}
+		bvh.SetBox(i, boxes[i]);
+	}
+	bool rebuilt = bvh.Refit();
+	passed = matches("refitted") && passed;
+
+	// Far from where they were built: the leaves grow past Bvh::rebuildRatio
+	for (uint32_t i = 0; i < boxes.size(); i += 2)
+	{
+		place(boxes[i]);
+		bvh.SetBox(i, boxes[i]);
+	}
+	bool scatterRebuilt = bvh.Refit();
+	passed = matches("rebuilt") && passed;
+	DEBUG_LOG("BVH refit %s, scattered refit %s (%zu rebuilds)", rebuilt ? "rebuilt" : "kept the tree", scatterRebuilt ? "rebuilt" : "kept the tree",
+		bvh.GetStats().rebuilds);
+	return passed && scatterRebuilt;
+}
+
+OcclusionBuffer SelfCheck::RasterizeOcclusionScene(ThreadPool* _pool)
+{
+	// The buffer is 2:1 like the camera
+	Matrix4x4 viewProjection = GetCheckViewProjection();
+
+	// Wall at z = -10, the last triangle points past the positions and is skipped
+	OccluderMesh wall;
+	wall.positions = { -6.f, -3.f, -10.f, 6.f, -3.f, -10.f, 6.f, 3.f, -10.f, -6.f, 3.f, -10.f };
+	wall.indices = { 0, 1, 2, 0, 2, 3, 0, 1, 99 };
+	// Clockwise slanted triangle across the wall, moved right by its model matrix
+	OccluderMesh slope;
+	slope.positions = { -8.f, -4.f, -6.f, -5.f, 4.f, -9.f, -2.f, -4.f, -14.f };
+	slope.indices = { 0, 1, 2 };
+	Matrix4x4 slopeModel{
+		{ 1.f, 0.f, 0.f, 1.f },
+		{ 0.f, 1.f, 0.f, 0.f },
+		{ 0.f, 0.f, 1.f, 0.f },
+		{ 0.f, 0.f, 0.f, 1.f } };
+
+	OcclusionBuffer buffer;
+	buffer.Begin(viewProjection);
+	buffer.AddOccluder(wall, Matrix4x4(true));
+	buffer.AddOccluder(slope, slopeModel);
+	buffer.Rasterize(_pool);
+	return buffer;
+}
+
+bool SelfCheck::OcclusionDepth()
+{
+	OcclusionBuffer alone = RasterizeOcclusionScene(nullptr);
+	OcclusionBuffer pooled = RasterizeOcclusionScene(&ResourcesManager::GetThreadPool());
+	uint64_t hash = alone.GetDepthHash();
+	DEBUG_LOG("Occlusion depth hash %016llx alone, %016llx on the pool, %016llx expected, %zu triangles", static_cast<unsigned long long>(hash),
+		static_cast<unsigned long long>(pooled.GetDepthHash()), static_cast<unsigned long long>(s_occlusionDepthHash), alone.GetStats().triangles);
+	if (hash != pooled.GetDepthHash() || hash != s_occlusionDepthHash || alone.GetStats().triangles != 3)
+		return false;
+
+	auto box = [](const Vectorf3& _min, const Vectorf3& _max) {
+		float corners[] = { _min[0], _min[1], _min[2], _max[0], _max[1], _max[2] };
+		return BoundingVolume::FromPoints(corners, 2, 3 * sizeof(float));
+	};
+	bool behindHidden = alone.IsOccluded(box(Vectorf3(-1.f, -1.f, -21.f), Vectorf3(1.f, 1.f, -19.f)));
+	bool frontShown = !alone.IsOccluded(box(Vectorf3(-1.f, -1.f, -6.f), Vectorf3(1.f, 1.f, -5.f)));
+	bool besideShown = !alone.IsOccluded(box(Vectorf3(14.f, -1.f, -21.f), Vectorf3(16.f, 1.f, -19.f)));
+	bool acrossNearShown = !alone.IsOccluded(box(Vectorf3(-1.f, -1.f, -20.f), Vectorf3(1.f, 1.f, 1.f)));
+	return behindHidden && frontShown && besideShown && acrossNearShown;
+}
+
+int SelfCheck::Run()
+{
+	struct Check
+	{
+		const char* name;
+		bool (*run)();
+	};
+	const Check checks[] = {
+		{ "OBJ parsers", ObjParsers },
+		{ "OBJ parser chunks", ObjParserChunks },
+		{ "Frustum culling", FrustumCulling },
+		{ "BVH query", BvhQuery },
+		{ "Occlusion depth", OcclusionDepth },
+	};
+
+	size_t failed = 0;
+	for (const Check& check : checks)
+	{
+		if (check.run())
+		{
+			Log::SuccessColor();
+			DEBUG_LOG("Check %s passed", check.name);
+			Log::ResetColor();
+		}
+		else
+		{
+			DEBUG_WARNING("Check %s FAILED", check.name);
+			failed++;
+		}
+	}
+	DEBUG_LOG("%zu of %zu checks passed", std::size(checks) - failed, std::size(checks));
+	return failed == 0 ? 0 : 1;
+}
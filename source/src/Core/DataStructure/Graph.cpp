@@ -1,5 +1,10 @@
 #include <Graph.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <unordered_set>
+
+#include <MappedFile.hpp>
 #include <Model.hpp>
 #include <Scene.hpp>
 
@@ -96,27 +101,86 @@ bool SceneNode::UpdateChildren()
 			camera->zCamera *= m_transform.ModelMatrix().Inversion().Transposed(); // NormalMatrix
 			camera->ComputeViewProjection();
 		}
+		m_worldBoundsStale = true;
 	}
+	if (m_worldBoundsStale || m_worldBoundsModel != model)
+		UpdateWorldBounds();
 	bool success = Node::UpdateChildren();
 	return success;
 }
 
-void SceneNode::Draw()
+void SceneNode::UpdateWorldBounds()
+{
+	m_worldBounds = BoundingVolume();
+	m_worldBoundsModel = model;
+	m_worldBoundsStale = false;
+	m_boundsMoved = true;
+	if (!model)
+		return;
+
+	// Bounds are set by the worker, before Decoded
+	ResourceState state = model->GetState();
+	if (state == ResourceState::Queued || state == ResourceState::Reading)
+		m_worldBoundsStale = true;
+	else
+		m_worldBounds = model->GetBounds().Transformed(m_transform.ModelMatrix());
+}
+
+const BoundingVolume& SceneNode::GetWorldBounds() const {
+	return m_worldBounds;
+}
+
+namespace
+{
+	// Chunks of nodes on the pool, a task for each node would cost more than its work
+	// Per-frame: untraced, on the calling thread alone while the pool is busy loading
+	template <class F>
+	void ForEachChunk(size_t _count, F&& _func, const char* _name)
+	{
+		const size_t chunkSize = 256;
+		size_t chunks = (_count + chunkSize - 1) / chunkSize;
+		auto run = [&_func, _count, chunkSize](size_t _chunk) {
+			for (size_t i = _chunk * chunkSize; i < std::min(_count, (_chunk + 1) * chunkSize); i++)
+				_func(i);
+		};
+		if (chunks > 1)
+			ResourcesManager::GetThreadPool().ParallelFor(chunks, run, _name, true);
+		else if (chunks == 1)
+			run(0);
+	}
+}
+
+void SceneNode::Enqueue(RenderQueue& _queue)
 {
-	// Here for all components
 	if (model)
+		_queue.Push(MakeRenderItem());
+}
+
+RenderItem SceneNode::MakeRenderItem()
+{
+	Assert(shader, std::string("No Shader for object " + name).c_str());
+	const Camera& camera = scene->camera;
+	const BoundingVolume& bounds = GetWorldBounds();
+	float depth = 0.f;
+	if (!bounds.IsEmpty())
+	{
+		Vectorf3 toCenter(bounds.center[0] - camera.eye[0], bounds.center[1] - camera.eye[1], bounds.center[2] - camera.eye[2]);
+		depth = toCenter.Magnitude() / camera.zFar;
+	}
+	return RenderQueue::MakeItem(RenderPass::Opaque, *shader, material, model->GetGeometryKey(), depth, this);
+}
+
+void SceneNode::Draw(DrawBatcher* _batcher)
+{
+	// Here for all components
+	if (model && (!_batcher || !model->AddDraws(*_batcher, this, scene)))
 	{
 		Assert(shader, std::string("No Shader for object " + name).c_str());
 		shader->Use();
 		material.InitShader(*shader);
 		model->ProcessNode(this, scene);
 
-		model->Draw();
-	}
-	for (Node* child : children)
-	{
-		SceneNode* sceneChild = dynamic_cast<SceneNode*>(child);
-		sceneChild->Draw();
+		model->Draw(model->GetPixelsPerUnit(m_worldBounds, scene->camera));
 	}
 }
 
@@ -154,8 +218,284 @@ void SceneGraph::Update(const float& _deltaTime)
 
 void SceneGraph::Draw()
 {
-	for (size_t i = 0; i < m_RootNode->GetChildNumber(); i++)
-		m_RootNode->GetChild(i)->Draw();
+	bool batching = DrawBatcher::enabled && DrawBatcher::IsSupported();
+	Cull();
+	auto start = std::chrono::steady_clock::now();
+	m_drawListStats.nodes = m_visibleNodes.size();
+	m_drawListStats.batchedDraws = BuildDrawList(parallelDrawList, batching);
+	auto built = std::chrono::steady_clock::now();
+
+	// GL thread: the nodes out of the batcher in the queue order, then the batches
+	const std::vector<RenderItem>& items = queue.GetItems();
+	for (size_t i = 0; i < items.size(); i++)
+		if (!m_drawSlots[i].batched)
+			items[i].node->Draw();
+	if (batching)
+		batcher.Submit(scene->camera.viewProjection);
+	m_drawListStats.buildMs = std::chrono::duration<double, std::milli>(built - start).count();
+	m_drawListStats.submitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - built).count();
+}
+
+size_t SceneGraph::BuildDrawList(bool _parallel, bool _batching)
+{
+	queue.Begin();
+	if (_batching)
+		batcher.Begin();
+	size_t count = m_visibleNodes.size();
+	m_drawSlots.assign(count, { 0, 0, false });
+
+	if (!_parallel)
+	{
+		for (SceneNode* node : m_visibleNodes)
+			node->Enqueue(queue);
+		queue.Sort();
+		if (!_batching)
+			return 0;
+		size_t draws = 0;
+		const std::vector<RenderItem>& items = queue.GetItems();
+		for (size_t i = 0; i < count; i++)
+		{
+			SceneNode* node = items[i].node;
+			m_drawSlots[i].batched = !IsKeptOutOfBatcher(node) && node->model->AddDraws(batcher, node, scene);
+			draws += m_drawSlots[i].batched ? node->model->meshes.size() : 0;
+		}
+		return draws;
+	}
+
+	RenderItem* allocated = queue.Allocate(count);
+	ForEachChunk(count, [this, allocated](size_t _i) { allocated[_i] = m_visibleNodes[_i]->MakeRenderItem(); }, "Render items");
+	// Ids in first seen order and the radix sort, both over the whole list
+	queue.Sort();
+	if (!_batching)
+		return 0;
+	// The sort swaps its buffers on each pass: allocated may now be its scratch
+	const std::vector<RenderItem>& items = queue.GetItems();
+
+	// Slots in the sorted order: the draws come out as the one by one path adds them
+	size_t draws = 0;
+	uint32_t data = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t nodeDraws = IsKeptOutOfBatcher(items[i].node) ? 0 : items[i].node->model->GetBatchedDrawCount(items[i].node);
+		if (!nodeDraws)
+			continue;
+		m_drawSlots[i] = { draws, data++, true };
+		draws += nodeDraws;
+	}
+	batcher.Reserve(draws, data);
+	ForEachChunk(count, [this, &items](size_t _i) {
+		const DrawSlot& slot = m_drawSlots[_i];
+		if (slot.batched)
+			items[_i].node->model->SetDraws(batcher, items[_i].node, scene, slot.firstDraw, slot.data);
+	}, "Draw data");
+	return draws;
+}
+
+DrawListBenchmark SceneGraph::BenchmarkDrawList(size_t _runs)
+{
+	bool batching = DrawBatcher::enabled && DrawBatcher::IsSupported();
+	Cull();
+	DrawListBenchmark result;
+	result.nodes = m_visibleNodes.size();
+	for (bool parallel : { false, true })
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (size_t run = 0; run < _runs; run++)
+			result.batchedDraws = BuildDrawList(parallel, batching);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / std::max<size_t>(_runs, 1);
+		if (parallel)
+			result.parallelMs = ms;
+		else
+			result.serialMs = ms;
+	}
+
+	// Compared as built, then mixed: every third node kept out of the batcher, drawn one by one
+	for (size_t stride : { 0, 3 })
+	{
+		for (size_t i = 0; stride && i < m_visibleNodes.size(); i += stride)
+			m_keptOutOfBatcher.insert(m_visibleNodes[i]);
+		BuildDrawList(false, batching);
+		uint64_t serialHash = HashDrawList();
+		result.unbatchedNodes = std::count_if(m_drawSlots.begin(), m_drawSlots.end(), [](const DrawSlot& _slot) { return !_slot.batched; });
+		BuildDrawList(true, batching);
+		result.matching = result.matching && HashDrawList() == serialHash;
+		m_keptOutOfBatcher.clear();
+	}
+	// Not submitted, the next Draw begins again
+	return result;
+}
+
+uint64_t SceneGraph::HashDrawList() const
+{
+	// Nodes in the queue order, the batched flag of each, then what the batcher holds
+	std::vector<uint64_t> words;
+	const std::vector<RenderItem>& items = queue.GetItems();
+	words.reserve(items.size() * 2 + 1);
+	for (size_t i = 0; i < items.size(); i++)
+	{
+		words.push_back(reinterpret_cast<uintptr_t>(items[i].node));
+		words.push_back(i < m_drawSlots.size() && m_drawSlots[i].batched);
+	}
+	words.push_back(batcher.HashDraws());
+	return MappedFile::Hash(words.data(), words.size() * sizeof(uint64_t));
+}
+
+void SceneGraph::Cull()
+{
+	auto start = std::chrono::steady_clock::now();
+	for (SceneNode* node : m_visibleNodes)
+		node->m_visible = false;
+	m_visibleNodes.clear();
+	m_lastVisible = m_lastCulled = 0;
+	frustum = Frustum::FromViewProjection(scene->camera.viewProjection);
+
+	if (!frustumCulling)
+	{
+		for (SceneNode* entity : entities)
+			if (entity->model)
+				m_visibleNodes.push_back(entity);
+	}
+	else if (useBvh)
+		CullBvh();
+	else
+		CullFlat();
+	if (occlusionCulling)
+		CullOccluded();
+	else
+		occlusion.GetStats() = {};
+
+	for (SceneNode* node : m_visibleNodes)
+		node->m_visible = true;
+	m_lastVisible = m_visibleNodes.size();
+	m_lastCullMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void SceneGraph::CullFlat()
+{
+	m_cullNodes.clear();
+	m_cullBoxes.Clear();
+	for (SceneNode* entity : entities)
+	{
+		if (!entity->model)
+			continue;
+		const BoundingVolume& bounds = entity->GetWorldBounds();
+		if (bounds.IsEmpty())
+			m_visibleNodes.push_back(entity);
+		else
+		{
+			m_cullNodes.push_back(entity);
+			m_cullBoxes.Add(bounds);
+		}
+	}
+
+	m_cullResults.resize(m_cullNodes.size());
+	size_t visible = frustum.Cull(m_cullBoxes, m_cullResults.data());
+	for (size_t i = 0; i < m_cullNodes.size(); i++)
+		if (m_cullResults[i])
+			m_visibleNodes.push_back(m_cullNodes[i]);
+	m_lastCulled = m_cullNodes.size() - visible;
+}
+
+namespace
+{
+	BvhBox ToBvhBox(const BoundingVolume& _bounds)
+	{
+		BvhBox box;
+		for (int k = 0; k < 3; k++)
+		{
+			box.boxMin[k] = _bounds.boxMin[k];
+			box.boxMax[k] = _bounds.boxMax[k];
+		}
+		return box;
+	}
+}
+
+void SceneGraph::RebuildBvh()
+{
+	m_bvhNodes.clear();
+	m_unboundedNodes.clear();
+	std::vector<BvhBox> boxes;
+	for (SceneNode* entity : entities)
+	{
+		entity->m_boundsMoved = false;
+		entity->m_bvhItem = -1;
+		if (!entity->model)
+			continue;
+		const BoundingVolume& bounds = entity->GetWorldBounds();
+		if (bounds.IsEmpty())
+		{
+			m_unboundedNodes.push_back(entity);
+			continue;
+		}
+		entity->m_bvhItem = static_cast<int32_t>(m_bvhNodes.size());
+		m_bvhNodes.push_back(entity);
+		boxes.push_back(ToBvhBox(bounds));
+	}
+	m_bvh.Build(boxes);
+	m_bvhStale = false;
+}
+
+void SceneGraph::CullBvh()
+{
+	// Moved nodes refit their leaf; a node getting or losing its bounds changes the items, that is a rebuild
+	if (!m_bvhStale)
+		for (SceneNode* entity : entities)
+		{
+			if (!entity->m_boundsMoved)
+				continue;
+			entity->m_boundsMoved = false;
+			bool bounded = entity->model && !entity->GetWorldBounds().IsEmpty();
+			if (bounded != (entity->m_bvhItem >= 0))
+			{
+				m_bvhStale = true;
+				break;
+			}
+			if (bounded)
+				m_bvh.SetBox(static_cast<uint32_t>(entity->m_bvhItem), ToBvhBox(entity->GetWorldBounds()));
+		}
+	if (m_bvhStale)
+		RebuildBvh();
+	else
+		m_bvh.Refit();
+
+	m_visibleNodes.insert(m_visibleNodes.end(), m_unboundedNodes.begin(), m_unboundedNodes.end());
+	m_bvhVisible.clear();
+	m_bvh.Query(frustum, m_bvhVisible);
+	for (uint32_t item : m_bvhVisible)
+		m_visibleNodes.push_back(m_bvhNodes[item]);
+	m_lastCulled = m_bvhNodes.size() - m_bvhVisible.size();
+}
+
+void SceneGraph::CullOccluded()
+{
+	occlusion.Begin(scene->camera.viewProjection);
+	for (SceneNode* node : m_visibleNodes)
+		if (node->occluder)
+			occlusion.AddOccluder(node->model->GetOccluderMesh(), node->m_transform.ModelMatrix());
+	OcclusionStats& stats = occlusion.GetStats();
+	if (stats.triangles == 0)
+		return;
+	occlusion.Rasterize(&ResourcesManager::GetThreadPool());
+
+	auto start = std::chrono::steady_clock::now();
+	m_occludedResults.assign(m_visibleNodes.size(), 0);
+	ForEachChunk(m_visibleNodes.size(), [this](size_t _i) {
+		const SceneNode* node = m_visibleNodes[_i];
+		m_occludedResults[_i] = !node->occluder && occlusion.IsOccluded(node->GetWorldBounds());
+	}, "Occlusion test");
+
+	size_t count = m_visibleNodes.size();
+	size_t kept = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		stats.tested += !m_visibleNodes[i]->occluder;
+		if (m_occludedResults[i])
+			stats.occluded++;
+		else
+			m_visibleNodes[kept++] = m_visibleNodes[i];
+	}
+	m_visibleNodes.resize(kept);
+	stats.testMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 }
 
 void SceneGraph::Destroy()
@@ -164,6 +504,12 @@ void SceneGraph::Destroy()
 		delete entity;
 	m_RootNode->children.clear();
 	entities.clear();
+	m_visibleNodes.clear();
+	m_cullNodes.clear();
+	m_bvhNodes.clear();
+	m_unboundedNodes.clear();
+	m_bvh.Clear();
+	m_bvhStale = true;
 }
 
 void SceneGraph::InitDefaultShader(Shader& _shader)
@@ -181,4 +527,24 @@ void  SceneGraph::AddEntity(Model* _model, SceneNode* _parent, Transform _transf
 	if (_parent != nullptr)
 		entity->SetParent(_parent);
 	entities.push_back(entity);
-}
\ No newline at end of file
+	m_bvhStale = true;
+}
+
+void SceneGraph::RemoveEntities(const std::vector<SceneNode*>& _entities)
+{
+	if (_entities.empty())
+		return;
+	// Erasing one by one would be quadratic for a crowd
+	std::unordered_set<Node*> removed(_entities.begin(), _entities.end());
+	std::unordered_set<Node*> parents;
+	for (SceneNode* entity : _entities)
+		if (entity->parent && !removed.contains(entity->parent))
+			parents.insert(entity->parent);
+	for (Node* parent : parents)
+		std::erase_if(parent->children, [&removed](Node* _child) { return removed.contains(_child); });
+	std::erase_if(entities, [&removed](SceneNode* _entity) { return removed.contains(_entity); });
+	std::erase_if(m_visibleNodes, [&removed](SceneNode* _node) { return removed.contains(_node); });
+	m_bvhStale = true;
+	for (SceneNode* entity : _entities)
+		delete entity;
+}
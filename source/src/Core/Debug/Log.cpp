@@ -72,6 +72,7 @@ void Log::InstancePrint(const char* _format, va_list _args)
 	const int bufferSize = 1024;
 	char buffer[bufferSize];
 	vsnprintf(buffer, bufferSize, _format, _args);
+	std::lock_guard<std::mutex> lock(m_printMtx);
 	std::cout << std::string(buffer) << "\n";
 	m_output << std::string(buffer) << "\n";
 	m_output.flush();
@@ -0,0 +1,231 @@
+#include <Tracer.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <Log.hpp>
+
+std::atomic<bool> Tracer::s_m_enabled = true;
+std::atomic<uint64_t> Tracer::s_m_nextAsyncId = 1;
+
+namespace
+{
+	// Single writer (its thread), the exporter reads [0, count) after an acquire
+	struct TraceBuffer
+	{
+		static const size_t s_capacity = 4096;
+
+		TraceEvent events[s_capacity];
+		std::atomic<size_t> count = 0;
+		std::atomic<size_t> dropped = 0;
+		std::atomic<bool> retired = false; // Its thread exited
+		uint32_t threadId = 0;
+		std::string threadName;
+	};
+
+	// Function-local: the thread pool is a static too, its workers can record during static init
+	// Leaked on purpose: pool workers retire their buffer while the statics are destroyed
+	struct Registry
+	{
+		std::mutex mutex;
+		std::vector<std::unique_ptr<TraceBuffer>> buffers;
+		uint32_t nextThreadId = 1;
+	};
+
+	Registry& GetRegistry()
+	{
+		static Registry* s_registry = new Registry;
+		return *s_registry;
+	}
+
+	// Registration is the only locked part, once per thread
+	struct ThreadBufferHandle
+	{
+		TraceBuffer* buffer = nullptr;
+
+		TraceBuffer* Get()
+		{
+			if (buffer)
+				return buffer;
+			Registry& registry = GetRegistry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			registry.buffers.push_back(std::make_unique<TraceBuffer>());
+			buffer = registry.buffers.back().get();
+			buffer->threadId = registry.nextThreadId++;
+			buffer->threadName = "Thread " + std::to_string(buffer->threadId);
+			return buffer;
+		}
+
+		~ThreadBufferHandle()
+		{
+			if (buffer)
+				buffer->retired.store(true, std::memory_order_release);
+		}
+	};
+
+	thread_local ThreadBufferHandle t_threadBuffer;
+
+	void WriteEscaped(std::ofstream& _output, const char* _text)
+	{
+		for (const char* c = _text; *c; c++)
+		{
+			if (*c == '"' || *c == '\\')
+				_output << '\\' << *c;
+			else if (static_cast<unsigned char>(*c) < 0x20)
+				_output << ' ';
+			else
+				_output << *c;
+		}
+	}
+}
+
+int64_t Tracer::NowUs()
+{
+	using namespace std::chrono;
+	static const steady_clock::time_point s_epoch = steady_clock::now();
+	return duration_cast<microseconds>(steady_clock::now() - s_epoch).count();
+}
+
+void Tracer::Record(const char* _category, const char* _name, const char* _detail, int64_t _startUs, int64_t _endUs) {
+	Push(_category, _name, _detail, _startUs, _endUs, 0);
+}
+
+void Tracer::RecordAsync(const char* _category, const char* _name, const char* _detail, int64_t _startUs, int64_t _endUs) {
+	Push(_category, _name, _detail, _startUs, _endUs, s_m_nextAsyncId.fetch_add(1, std::memory_order_relaxed));
+}
+
+void Tracer::Push(const char* _category, const char* _name, const char* _detail, int64_t _startUs, int64_t _endUs, uint64_t _asyncId)
+{
+	if (!s_m_enabled.load(std::memory_order_relaxed))
+		return;
+
+	TraceBuffer* buffer = t_threadBuffer.Get();
+	size_t index = buffer->count.load(std::memory_order_relaxed);
+	if (index >= TraceBuffer::s_capacity)
+	{
+		buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	TraceEvent& event = buffer->events[index];
+	if (_detail)
+		std::snprintf(event.name, TraceEvent::s_nameSize, "%s %s", _name, _detail);
+	else
+		std::snprintf(event.name, TraceEvent::s_nameSize, "%s", _name);
+	event.category = _category;
+	event.startUs = _startUs;
+	event.durationUs = _endUs - _startUs;
+	event.asyncId = _asyncId;
+	// Publish the event
+	buffer->count.store(index + 1, std::memory_order_release);
+}
+
+void Tracer::SetThreadName(const std::string& _name)
+{
+	TraceBuffer* buffer = t_threadBuffer.Get();
+	std::lock_guard<std::mutex> lock(GetRegistry().mutex);
+	buffer->threadName = _name;
+}
+
+void Tracer::SetEnabled(bool _enabled) {
+	s_m_enabled.store(_enabled, std::memory_order_relaxed);
+}
+
+bool Tracer::IsEnabled() {
+	return s_m_enabled.load(std::memory_order_relaxed);
+}
+
+// Resetting count races with a thread still pushing: the caller makes sure none records (ThreadPool::WaitIdle)
+void Tracer::Clear()
+{
+	Registry& registry = GetRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	// Buffers of exited threads are not needed anymore
+	std::erase_if(registry.buffers, [](const std::unique_ptr<TraceBuffer>& _buffer) {
+		return _buffer->retired.load(std::memory_order_acquire); });
+	for (std::unique_ptr<TraceBuffer>& buffer : registry.buffers)
+	{
+		buffer->count.store(0, std::memory_order_release);
+		buffer->dropped.store(0, std::memory_order_relaxed);
+	}
+}
+
+bool Tracer::ExportChromeJson(std::filesystem::path const& _filename)
+{
+	std::ofstream output(_filename, std::ios::out | std::ios::trunc);
+	if (!output.is_open())
+	{
+		DEBUG_WARNING("Could not open trace file %s", _filename.string().c_str());
+		return false;
+	}
+
+	Registry& registry = GetRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	size_t totalEvents = 0;
+	size_t totalDropped = 0;
+	bool first = true;
+	output << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	for (const std::unique_ptr<TraceBuffer>& buffer : registry.buffers)
+	{
+		size_t count = buffer->count.load(std::memory_order_acquire);
+		totalEvents += count;
+		totalDropped += buffer->dropped.load(std::memory_order_relaxed);
+
+		output << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId
+			<< ",\"args\":{\"name\":\"";
+		WriteEscaped(output, buffer->threadName.c_str());
+		output << "\"}}";
+		first = false;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const TraceEvent& event = buffer->events[i];
+			if (event.asyncId == 0)
+			{
+				output << ",\n{\"name\":\"";
+				WriteEscaped(output, event.name);
+				output << "\",\"cat\":\"" << event.category << "\",\"ph\":\"X\",\"ts\":" << event.startUs
+					<< ",\"dur\":" << event.durationUs << ",\"pid\":1,\"tid\":" << buffer->threadId << "}";
+				continue;
+			}
+			// Async spans are a begin/end pair sharing an id
+			const char* phases[2] = { "b", "e" };
+			int64_t times[2] = { event.startUs, event.startUs + event.durationUs };
+			for (int p = 0; p < 2; p++)
+			{
+				output << ",\n{\"name\":\"";
+				WriteEscaped(output, event.name);
+				output << "\",\"cat\":\"" << event.category << "\",\"ph\":\"" << phases[p] << "\",\"id\":" << event.asyncId
+					<< ",\"ts\":" << times[p] << ",\"pid\":1,\"tid\":" << buffer->threadId << "}";
+			}
+		}
+
+		// The buffer filled up at its last event, the rest of the thread's events are missing
+		size_t dropped = buffer->dropped.load(std::memory_order_relaxed);
+		if (dropped > 0 && count > 0)
+		{
+			const TraceEvent& last = buffer->events[count - 1];
+			output << ",\n{\"name\":\"Dropped events\",\"cat\":\"trace\",\"ph\":\"i\",\"s\":\"t\",\"ts\":" << last.startUs + last.durationUs
+				<< ",\"pid\":1,\"tid\":" << buffer->threadId << ",\"args\":{\"dropped\":" << dropped
+				<< ",\"capacity\":" << TraceBuffer::s_capacity << "}}";
+		}
+	}
+	output << "\n],\"otherData\":{\"droppedEvents\":" << totalDropped << "}}\n";
+	output.close();
+
+	if (totalDropped > 0)
+	{
+		DEBUG_WARNING("Trace exported to %s: %zu events, %zu dropped (%zu per thread at most)", _filename.string().c_str(),
+			totalEvents, totalDropped, TraceBuffer::s_capacity);
+		return true;
+	}
+	Log::SuccessColor();
+	DEBUG_LOG("Trace exported to %s: %zu events", _filename.string().c_str(), totalEvents);
+	Log::ResetColor();
+	return true;
+}
@@ -0,0 +1,108 @@
+#include <Prefetcher.hpp>
+
+#include <algorithm>
+#include <chrono>
+
+#include <Log.hpp>
+#include <MappedFile.hpp>
+#include <Tracer.hpp>
+
+Prefetcher::Prefetcher()
+{
+	m_thread = std::thread([this]() {
+		Tracer::SetThreadName("Prefetcher");
+		ThreadTask();
+	});
+}
+
+Prefetcher::~Prefetcher()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_condition.notify_all();
+	m_thread.join();
+}
+
+void Prefetcher::Start(const std::vector<std::filesystem::path>& _orderedFiles, unsigned int _distance)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_files = _orderedFiles;
+		m_nextFile = 0;
+		m_readsStarted = 0;
+		m_distance = _distance;
+		m_prefetchedFiles = 0;
+		m_prefetchedBytes = 0;
+		m_prefetchSeconds = 0.0;
+	}
+	m_condition.notify_all();
+}
+
+void Prefetcher::Append(const std::filesystem::path& _file)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_files.push_back(_file);
+	}
+	m_condition.notify_all();
+}
+
+void Prefetcher::NotifyReadStarted()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_readsStarted++;
+	}
+	m_condition.notify_all();
+}
+
+void Prefetcher::Stop() {
+	Start({}, 0);
+}
+
+void Prefetcher::LogStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_distance == 0)
+		return;
+	DEBUG_LOG("Prefetched %zu files ahead of the workers (distance %u): %.2f MB in %.1f ms",
+		m_prefetchedFiles, m_distance, static_cast<double>(m_prefetchedBytes) / (1024.0 * 1024.0), m_prefetchSeconds * 1000.0);
+}
+
+void Prefetcher::ThreadTask()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		// Only the files the workers will reach soon, prefetching too far evicts what is still to be read
+		m_condition.wait(lock, [this] {
+			return m_quit || (m_nextFile < m_files.size() && m_nextFile < m_readsStarted + m_distance); });
+		if (m_quit)
+			return;
+		// The workers overtook it: the files they already opened would be read twice
+		m_nextFile = std::max(m_nextFile, m_readsStarted);
+		if (m_nextFile >= m_files.size())
+			continue;
+
+		std::filesystem::path file = m_files[m_nextFile++];
+		if (file.empty())
+			continue;
+
+		lock.unlock();
+		auto start = std::chrono::steady_clock::now();
+		size_t bytes = 0;
+		{
+			std::string fileName = file.filename().string();
+			TRACE_SCOPE("io", "Prefetch", fileName.c_str());
+			bytes = MappedFile::PrefetchToPageCache(file);
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		lock.lock();
+
+		m_prefetchedFiles++;
+		m_prefetchedBytes += bytes;
+		m_prefetchSeconds += seconds;
+	}
+}
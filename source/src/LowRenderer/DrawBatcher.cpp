@@ -0,0 +1,307 @@
+#include <DrawBatcher.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <tuple>
+
+#include <glad/glad.h>
+
+#include <GLFunctions.hpp>
+#include <GLState.hpp>
+#include <MappedFile.hpp>
+#include <Material.hpp>
+#include <Mesh.hpp>
+#include <Shader.hpp>
+
+static const size_t s_texelsPerDraw = sizeof(DrawData) / (4 * sizeof(float));
+
+bool DrawBatcher::IsSupported() {
+	return GLFunctions::drawElementsBaseVertex && GLFunctions::vertexAttribDivisor;
+}
+
+bool DrawBatcher::HasMultiDraw() {
+	return GLFunctions::multiDrawElementsIndirect != nullptr;
+}
+
+DrawData DrawBatcher::MakeDrawData(const Matrix4x4& _model, const Matrix4x4& _normalMatrix, const Vectorf3& _positionOffset,
+	const Vectorf3& _positionScale, const Material& _material)
+{
+	DrawData data = {};
+	// Row-major matrices, the shader builds its matrices from columns
+	for (int column = 0; column < 4; column++)
+		for (int row = 0; row < 4; row++)
+			data.model[column][row] = _model[row][column];
+	for (int column = 0; column < 3; column++)
+		for (int row = 0; row < 3; row++)
+			data.normalMatrix[column][row] = _normalMatrix[row][column];
+	for (int k = 0; k < 3; k++)
+	{
+		data.positionOffset[k] = _positionOffset[k];
+		data.positionScale[k] = _positionScale[k];
+		data.ambient[k] = _material.ambient[k];
+		data.diffuse[k] = _material.diffuse[k];
+		data.specular[k] = _material.specular[k];
+	}
+	data.specular[3] = _material.shininess * 128.f; // As Material::InitShader
+	return data;
+}
+
+void DrawBatcher::Begin()
+{
+	m_items.clear();
+	m_data.clear();
+}
+
+bool DrawBatcher::Add(Shader& _shader, Mesh& _mesh, size_t _lod, const Material& _material, const DrawData& _data)
+{
+	Item item;
+	if (!_mesh.GetDrawCommand(_lod, item.command))
+		return false;
+	item.shader = &_shader;
+	item.arena = _mesh.GetArena();
+	item.indexType = _mesh.GetIndexType();
+	item.diffuseUnit = _material.diffuse2DMap;
+	item.specularUnit = _material.specular2DMap;
+	// The meshes of a model share its data
+	if (m_data.empty() || std::memcmp(&m_data.back(), &_data, sizeof(DrawData)) != 0)
+		m_data.push_back(_data);
+	item.data = static_cast<uint32_t>(m_data.size() - 1);
+	m_items.push_back(item);
+	return true;
+}
+
+void DrawBatcher::Reserve(size_t _draws, size_t _data)
+{
+	m_items.resize(m_items.size() + _draws);
+	m_data.resize(m_data.size() + _data);
+}
+
+void DrawBatcher::Set(size_t _draw, Shader& _shader, const Mesh& _mesh, size_t _lod, const Material& _material, uint32_t _data)
+{
+	Item& item = m_items[_draw];
+	_mesh.GetDrawCommand(_lod, item.command);
+	item.shader = &_shader;
+	item.arena = _mesh.GetArena();
+	item.indexType = _mesh.GetIndexType();
+	item.diffuseUnit = _material.diffuse2DMap;
+	item.specularUnit = _material.specular2DMap;
+	item.data = _data;
+}
+
+void DrawBatcher::SetData(uint32_t _data, const DrawData& _drawData) {
+	m_data[_data] = _drawData;
+}
+
+uint64_t DrawBatcher::HashDraws() const
+{
+	std::vector<uint64_t> words;
+	words.reserve(m_items.size() * 11);
+	for (const Item& item : m_items)
+	{
+		words.insert(words.end(), { reinterpret_cast<uintptr_t>(item.shader), reinterpret_cast<uintptr_t>(item.arena), item.indexType,
+			item.diffuseUnit, item.specularUnit, item.command.count, item.command.instanceCount, item.command.firstIndex,
+			static_cast<uint64_t>(static_cast<uint32_t>(item.command.baseVertex)), item.command.baseInstance });
+		words.push_back(item.data < m_data.size() ? MappedFile::Hash(&m_data[item.data], sizeof(DrawData)) : 0);
+	}
+	return MappedFile::Hash(words.data(), words.size() * sizeof(uint64_t));
+}
+
+bool DrawBatcher::SameBatch(const Item& _a, const Item& _b)
+{
+	return _a.shader == _b.shader && _a.arena == _b.arena && _a.indexType == _b.indexType && _a.diffuseUnit == _b.diffuseUnit
+		&& _a.specularUnit == _b.specularUnit;
+}
+
+bool DrawBatcher::SameMesh(const Item& _a, const Item& _b)
+{
+	return _a.command.count == _b.command.count && _a.command.firstIndex == _b.command.firstIndex && _a.command.baseVertex == _b.command.baseVertex;
+}
+
+void DrawBatcher::Submit(const Matrix4x4& _viewProjection)
+{
+	m_lastDraws = m_items.size();
+	m_lastCommands = 0;
+	m_lastCalls = 0;
+	m_lastBatches = 0;
+	if (m_items.empty())
+		return;
+	if (!m_dataBuffer)
+		CreateBuffers();
+
+	size_t triangles = 0;
+	for (const Item& item : m_items)
+		triangles += item.command.count / 3;
+	Mesh::AddFrameDraws(m_items.size(), triangles);
+
+	// Then by mesh, its instances next to each other. Stable: same order as the scene within a command
+	auto key = [](const Item& _item) {
+		return std::make_tuple(reinterpret_cast<uintptr_t>(_item.shader), reinterpret_cast<uintptr_t>(_item.arena), _item.indexType,
+			_item.diffuseUnit, _item.specularUnit, _item.command.baseVertex, _item.command.firstIndex, _item.command.count); };
+	std::stable_sort(m_items.begin(), m_items.end(), [&key](const Item& _a, const Item& _b) { return key(_a) < key(_b); });
+
+	std::vector<Shader*> usedShaders;
+	for (size_t first = 0; first < m_items.size(); first += m_maxDraws)
+		SubmitRange(first, std::min(first + m_maxDraws, m_items.size()), _viewProjection, usedShaders);
+
+	// The draws out of the batcher set their matrices and material as uniforms
+	for (Shader* shader : usedShaders)
+	{
+		shader->Use();
+		shader->SetBool("batched", false);
+	}
+}
+
+int DrawBatcher::GetDrawIdBaseLocation(const Shader& _shader)
+{
+	uint32_t program = _shader.GetShaderProgram();
+	auto it = std::find_if(m_drawIdBaseLocations.begin(), m_drawIdBaseLocations.end(),
+		[program](const std::pair<uint32_t, int>& _location) { return _location.first == program; });
+	if (it != m_drawIdBaseLocations.end())
+		return it->second;
+	int location = glGetUniformLocation(program, "drawIdBase");
+	m_drawIdBaseLocations.emplace_back(program, location);
+	return location;
+}
+
+void DrawBatcher::SubmitRange(size_t _first, size_t _last, const Matrix4x4& _viewProjection, std::vector<Shader*>& _usedShaders)
+{
+	// Data in the sorted order: the instances of a command are consecutive, from its baseInstance
+	size_t count = _last - _first;
+	m_sortedData.resize(count);
+	m_commands.clear();
+	m_batches.clear();
+	// One by one without glDrawElementsInstancedBaseVertex: a merged command would draw its first instance only
+	bool mergeInstances = instancing && (HasMultiDraw() || GLFunctions::drawElementsInstancedBaseVertex);
+	for (size_t i = 0; i < count; i++)
+	{
+		const Item& item = m_items[_first + i];
+		m_sortedData[i] = m_data[item.data];
+		bool sameBatch = i > 0 && SameBatch(m_items[_first + i - 1], item);
+		if (sameBatch && mergeInstances && SameMesh(m_items[_first + i - 1], item))
+		{
+			m_commands.back().instanceCount++;
+			continue;
+		}
+		if (!sameBatch)
+			m_batches.push_back({ m_commands.size(), 0, _first + i });
+		m_commands.push_back(item.command);
+		m_commands.back().baseInstance = static_cast<uint32_t>(i);
+		m_batches.back().commandCount++;
+	}
+	m_lastCommands += m_commands.size();
+
+	// New storage each time, the driver does not wait for the previous frame draws
+	GLState::BindBuffer(GL_TEXTURE_BUFFER, m_dataBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, count * sizeof(DrawData), m_sortedData.data(), GL_STREAM_DRAW);
+	GLState::BindTexture(m_dataUnit, GL_TEXTURE_BUFFER, m_dataTexture);
+
+	// Multi-draw: aDrawId is baseInstance + instance. One by one: instance only, drawIdBase adds the baseInstance
+	ReserveDrawIds(count);
+	bool multiDraw = HasMultiDraw();
+	if (multiDraw)
+	{
+		GLState::BindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, m_commands.size() * sizeof(DrawElementsIndirectCommand), m_commands.data(), GL_STREAM_DRAW);
+	}
+
+	for (const Batch& batch : m_batches)
+	{
+		const Item& item = m_items[batch.item];
+		Shader& shader = *item.shader;
+		shader.Use();
+		if (std::find(_usedShaders.begin(), _usedShaders.end(), &shader) == _usedShaders.end())
+			_usedShaders.push_back(&shader);
+		shader.SetBool("batched", true);
+		shader.SetInt("drawData", m_dataUnit);
+		shader.SetMat4("viewProjection", _viewProjection);
+		shader.SetBool("compactVertices", item.arena->GetLayout() == VertexLayout::Compact16());
+		if (item.diffuseUnit != static_cast<unsigned int>(-1))
+			shader.SetInt("material.diffuse2D", item.diffuseUnit);
+		if (item.specularUnit != static_cast<unsigned int>(-1))
+			shader.SetInt("material.specular2D", item.specularUnit);
+		item.arena->Bind();
+
+		if (multiDraw)
+		{
+			shader.SetInt("drawIdBase", 0);
+			GLFunctions::multiDrawElementsIndirect(GL_TRIANGLES, item.indexType,
+				reinterpret_cast<void*>(batch.firstCommand * sizeof(DrawElementsIndirectCommand)), static_cast<GLsizei>(batch.commandCount), 0);
+			m_lastCalls++;
+		}
+		else
+		{
+			size_t indexSize = item.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+			int drawIdBase = GetDrawIdBaseLocation(shader);
+			for (size_t c = batch.firstCommand; c < batch.firstCommand + batch.commandCount; c++)
+			{
+				const DrawElementsIndirectCommand& command = m_commands[c];
+				const void* indices = reinterpret_cast<void*>(command.firstIndex * indexSize);
+				glUniform1i(drawIdBase, static_cast<int>(command.baseInstance));
+				if (command.instanceCount > 1)
+					GLFunctions::drawElementsInstancedBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(command.count), item.indexType, indices,
+						static_cast<GLsizei>(command.instanceCount), command.baseVertex);
+				else
+					GLFunctions::drawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(command.count), item.indexType, indices, command.baseVertex);
+			}
+			m_lastCalls += batch.commandCount;
+		}
+		m_lastBatches++;
+	}
+}
+
+void DrawBatcher::CreateBuffers()
+{
+	GLint texels = 0, units = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &texels);
+	glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &units);
+	m_maxDraws = std::max<size_t>(1, static_cast<size_t>(texels) / s_texelsPerDraw);
+	// Last unit, the textures take theirs from their id
+	m_dataUnit = units - 1;
+
+	glGenBuffers(1, &m_dataBuffer);
+	GLState::BindBuffer(GL_TEXTURE_BUFFER, m_dataBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(DrawData), nullptr, GL_STREAM_DRAW);
+	glGenTextures(1, &m_dataTexture);
+	GLState::BindTexture(m_dataUnit, GL_TEXTURE_BUFFER, m_dataTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_dataBuffer);
+	glGenBuffers(1, &m_indirectBuffer);
+}
+
+void DrawBatcher::ReserveDrawIds(size_t _count)
+{
+	if (_count <= m_drawIdCapacity)
+		return;
+	m_drawIdCapacity = std::max({ _count, m_drawIdCapacity * 2, static_cast<size_t>(1024) });
+	std::vector<uint32_t> ids(m_drawIdCapacity);
+	std::iota(ids.begin(), ids.end(), 0u);
+
+	bool created = !m_drawIdBuffer;
+	if (created)
+		glGenBuffers(1, &m_drawIdBuffer);
+	GLState::BindBuffer(GL_ARRAY_BUFFER, m_drawIdBuffer);
+	glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(uint32_t), ids.data(), GL_STATIC_DRAW);
+	// The VAOs keep pointing at the buffer when its storage changes
+	if (created)
+		GeometryArena::SetDrawIdBuffer(m_drawIdBuffer);
+}
+
+void DrawBatcher::Release()
+{
+	if (m_drawIdBuffer)
+		GeometryArena::SetDrawIdBuffer(0);
+	unsigned int buffers[] = { m_dataBuffer, m_indirectBuffer, m_drawIdBuffer };
+	glDeleteBuffers(3, buffers);
+	for (unsigned int buffer : buffers)
+		GLState::ForgetBuffer(buffer);
+	if (m_dataTexture)
+	{
+		glDeleteTextures(1, &m_dataTexture);
+		GLState::ForgetTexture(m_dataTexture);
+	}
+	m_dataBuffer = m_dataTexture = m_indirectBuffer = m_drawIdBuffer = 0;
+	m_drawIdCapacity = 0;
+	m_items.clear();
+	m_data.clear();
+	m_drawIdBaseLocations.clear();
+}
@@ -0,0 +1,20 @@
+#include <GLFunctions.hpp>
+
+#include <Log.hpp>
+
+void GLFunctions::Load(GLADloadproc _load)
+{
+	drawElementsBaseVertex = reinterpret_cast<DrawElementsBaseVertexProc>(_load("glDrawElementsBaseVertex"));
+	if (!drawElementsBaseVertex)
+		DEBUG_WARNING("glDrawElementsBaseVertex not found, meshes keep their own buffers");
+	drawElementsInstancedBaseVertex = reinterpret_cast<DrawElementsInstancedBaseVertexProc>(_load("glDrawElementsInstancedBaseVertex"));
+	vertexAttribDivisor = reinterpret_cast<VertexAttribDivisorProc>(_load("glVertexAttribDivisor"));
+
+	// Drivers may export it whatever the context version
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if (major > 4 || (major == 4 && minor >= 3))
+		multiDrawElementsIndirect = reinterpret_cast<MultiDrawElementsIndirectProc>(_load("glMultiDrawElementsIndirect"));
+	DEBUG_LOG("OpenGL %d.%d, multi-draw indirect %s", major, minor, multiDrawElementsIndirect ? "available" : "not available");
+}
@@ -0,0 +1,134 @@
+#include <GLState.hpp>
+
+#include <iterator>
+
+bool GLState::Change(GLStateKind _kind, bool _changed)
+{
+	bool send = _changed || !enabled;
+	GLStateCounter& counter = s_m_frame[static_cast<size_t>(_kind)];
+	if (send)
+		counter.issued++;
+	else
+		counter.skipped++;
+	return send;
+}
+
+bool GLState::UseProgram(GLuint _program)
+{
+	if (!Change(GLStateKind::Program, s_m_program != _program))
+		return false;
+	glUseProgram(_program);
+	s_m_program = _program;
+	return true;
+}
+
+bool GLState::BindVertexArray(GLuint _vertexArray)
+{
+	if (!Change(GLStateKind::VertexArray, s_m_vertexArray != _vertexArray))
+		return false;
+	glBindVertexArray(_vertexArray);
+	s_m_vertexArray = _vertexArray;
+	return true;
+}
+
+bool GLState::BindBuffer(GLenum _target, GLuint _buffer)
+{
+	auto it = s_m_buffers.find(_target);
+	if (!Change(GLStateKind::Buffer, it == s_m_buffers.end() || it->second != _buffer))
+		return false;
+	glBindBuffer(_target, _buffer);
+	s_m_buffers[_target] = _buffer;
+	return true;
+}
+
+bool GLState::ActiveTexture(GLuint _unit)
+{
+	if (!Change(GLStateKind::Texture, s_m_activeTexture != _unit))
+		return false;
+	glActiveTexture(GL_TEXTURE0 + _unit);
+	s_m_activeTexture = _unit;
+	return true;
+}
+
+bool GLState::BindTexture(GLuint _unit, GLenum _target, GLuint _texture)
+{
+	uint64_t key = (static_cast<uint64_t>(_unit) << 32) | _target;
+	auto it = s_m_textures.find(key);
+	if (!Change(GLStateKind::Texture, it == s_m_textures.end() || it->second != _texture))
+		return false;
+	ActiveTexture(_unit);
+	glBindTexture(_target, _texture);
+	s_m_textures[key] = _texture;
+	return true;
+}
+
+bool GLState::SetCapability(GLenum _capability, bool _enabled)
+{
+	auto it = s_m_capabilities.find(_capability);
+	if (!Change(GLStateKind::Capability, it == s_m_capabilities.end() || it->second != _enabled))
+		return false;
+	if (_enabled)
+		glEnable(_capability);
+	else
+		glDisable(_capability);
+	s_m_capabilities[_capability] = _enabled;
+	return true;
+}
+
+void GLState::ForgetProgram(GLuint _program)
+{
+	if (s_m_program == _program)
+		s_m_program = 0;
+}
+
+void GLState::ForgetVertexArray(GLuint _vertexArray)
+{
+	if (s_m_vertexArray == _vertexArray)
+		s_m_vertexArray = 0;
+}
+
+void GLState::ForgetBuffer(GLuint _buffer)
+{
+	for (auto& [target, buffer] : s_m_buffers)
+		if (buffer == _buffer)
+			buffer = 0;
+}
+
+void GLState::ForgetTexture(GLuint _texture)
+{
+	for (auto& [key, texture] : s_m_textures)
+		if (texture == _texture)
+			texture = 0;
+}
+
+void GLState::Invalidate()
+{
+	s_m_program = s_m_vertexArray = s_m_activeTexture = s_unknown;
+	s_m_buffers.clear();
+	s_m_textures.clear();
+	s_m_capabilities.clear();
+}
+
+void GLState::EndFrameStats()
+{
+	for (size_t i = 0; i < std::size(s_m_frame); i++)
+	{
+		s_m_lastFrame[i] = s_m_frame[i];
+		s_m_frame[i] = {};
+	}
+}
+
+const GLStateCounter& GLState::GetLastFrameStats(GLStateKind _kind) {
+	return s_m_lastFrame[static_cast<size_t>(_kind)];
+}
+
+GLStateCounter GLState::GetLastFrameTotal()
+{
+	GLStateCounter total;
+	for (const GLStateCounter& counter : s_m_lastFrame)
+	{
+		total.issued += counter.issued;
+		total.skipped += counter.skipped;
+	}
+	return total;
+}
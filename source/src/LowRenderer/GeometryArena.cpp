@@ -0,0 +1,224 @@
+#include <GeometryArena.hpp>
+
+#include <algorithm>
+
+#include <glad/glad.h>
+
+#include <GLFunctions.hpp>
+#include <GLState.hpp>
+#include <Log.hpp>
+
+// First buffers: 4 MB of Float32 vertices, 2 MB of indices
+static const size_t s_initialVertices = 1 << 17;
+static const size_t s_initialIndexBytes = 1 << 21;
+
+size_t RangeAllocator::Allocate(size_t _size, size_t _alignment)
+{
+	if (_size == 0)
+		return s_invalid;
+	for (auto it = m_free.begin(); it != m_free.end(); it++)
+	{
+		size_t offset = (it->first + _alignment - 1) / _alignment * _alignment;
+		size_t end = it->first + it->second;
+		if (offset + _size > end)
+			continue;
+
+		// What is left on both sides stays free
+		size_t start = it->first;
+		m_free.erase(it);
+		if (offset > start)
+			m_free.emplace(start, offset - start);
+		if (offset + _size < end)
+			m_free.emplace(offset + _size, end - offset - _size);
+		m_used += _size;
+		return offset;
+	}
+	return s_invalid;
+}
+
+void RangeAllocator::Free(size_t _offset, size_t _size)
+{
+	if (_size == 0)
+		return;
+	m_used -= _size;
+	auto next = m_free.lower_bound(_offset);
+	if (next != m_free.begin())
+	{
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == _offset)
+		{
+			_offset = previous->first;
+			_size += previous->second;
+			m_free.erase(previous);
+		}
+	}
+	if (next != m_free.end() && _offset + _size == next->first)
+	{
+		_size += next->second;
+		m_free.erase(next);
+	}
+	m_free.emplace(_offset, _size);
+}
+
+void RangeAllocator::Grow(size_t _capacity)
+{
+	if (_capacity <= m_capacity)
+		return;
+	size_t added = _capacity - m_capacity;
+	// Free(), without counting it as used before
+	m_used += added;
+	Free(m_capacity, added);
+	m_capacity = _capacity;
+}
+
+bool GeometryArena::IsSupported() {
+	return GLFunctions::drawElementsBaseVertex != nullptr;
+}
+
+GeometryArena& GeometryArena::Get(const VertexLayout& _layout)
+{
+	for (const std::unique_ptr<GeometryArena>& arena : s_m_arenas)
+		if (arena->m_layout == _layout)
+			return *arena;
+	s_m_arenas.emplace_back(new GeometryArena(_layout));
+	return *s_m_arenas.back();
+}
+
+void GeometryArena::DestroyAll()
+{
+	for (const std::unique_ptr<GeometryArena>& arena : s_m_arenas)
+		if (arena->m_meshCount)
+			DEBUG_WARNING("Geometry arena destroyed with %zu meshes in it", arena->m_meshCount);
+	s_m_arenas.clear();
+}
+
+void GeometryArena::SetDrawIdBuffer(unsigned int _buffer)
+{
+	s_m_drawIdBuffer = _buffer;
+	for (const std::unique_ptr<GeometryArena>& arena : s_m_arenas)
+		arena->AttachBuffers();
+}
+
+GeometryArenaStats GeometryArena::GetStats()
+{
+	GeometryArenaStats stats;
+	for (const std::unique_ptr<GeometryArena>& arena : s_m_arenas)
+	{
+		stats.arenas++;
+		stats.meshes += arena->m_meshCount;
+		stats.usedBytes += arena->m_vertices.GetUsed() * arena->m_layout.stride + arena->m_indices.GetUsed();
+		stats.capacityBytes += arena->m_vertices.GetCapacity() * arena->m_layout.stride + arena->m_indices.GetCapacity();
+		stats.freeRanges += arena->m_vertices.GetFreeRangeCount() + arena->m_indices.GetFreeRangeCount();
+	}
+	return stats;
+}
+
+GeometryArena::GeometryArena(const VertexLayout& _layout) : m_layout(_layout)
+{
+	glGenVertexArrays(1, &m_VAO);
+	Reallocate(m_VBO, 0, s_initialVertices * m_layout.stride);
+	Reallocate(m_EBO, 0, s_initialIndexBytes);
+	m_vertices.Grow(s_initialVertices);
+	m_indices.Grow(s_initialIndexBytes);
+	AttachBuffers();
+}
+
+GeometryArena::~GeometryArena()
+{
+	glDeleteVertexArrays(1, &m_VAO);
+	glDeleteBuffers(1, &m_VBO);
+	glDeleteBuffers(1, &m_EBO);
+	GLState::ForgetVertexArray(m_VAO);
+	GLState::ForgetBuffer(m_VBO);
+	GLState::ForgetBuffer(m_EBO);
+}
+
+ArenaRange GeometryArena::Allocate(const std::vector<unsigned char>& _vertexData, size_t _vertexCount, const std::vector<unsigned char>& _indexData)
+{
+	ArenaRange range;
+	// Nothing to place: an empty range, the buffers are not grown for it
+	if (_vertexCount == 0 || _indexData.empty())
+		return range;
+	range.vertexCount = _vertexCount;
+	range.indexBytes = (_indexData.size() + 3) & ~static_cast<size_t>(3);
+
+	bool grown = false;
+	range.baseVertex = m_vertices.Allocate(_vertexCount);
+	if (range.baseVertex == RangeAllocator::s_invalid)
+	{
+		size_t capacity = std::max(m_vertices.GetCapacity() * 2, m_vertices.GetCapacity() + _vertexCount);
+		Reallocate(m_VBO, m_vertices.GetCapacity() * m_layout.stride, capacity * m_layout.stride);
+		m_vertices.Grow(capacity);
+		range.baseVertex = m_vertices.Allocate(_vertexCount);
+		grown = true;
+	}
+	range.indexOffset = m_indices.Allocate(range.indexBytes, 4);
+	if (range.indexOffset == RangeAllocator::s_invalid)
+	{
+		size_t capacity = std::max(m_indices.GetCapacity() * 2, m_indices.GetCapacity() + range.indexBytes);
+		Reallocate(m_EBO, m_indices.GetCapacity(), capacity);
+		m_indices.Grow(capacity);
+		range.indexOffset = m_indices.Allocate(range.indexBytes, 4);
+		grown = true;
+	}
+	if (grown)
+	{
+		DEBUG_LOG("Geometry arena (stride %u) grown to %zu vertices, %.1f KB of indices", m_layout.stride, m_vertices.GetCapacity(),
+			m_indices.GetCapacity() / 1024.f);
+		AttachBuffers();
+	}
+
+	// Copy targets: binding the element buffer would change the bound VAO
+	GLState::BindBuffer(GL_COPY_WRITE_BUFFER, m_VBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, range.baseVertex * m_layout.stride, _vertexData.size(), _vertexData.data());
+	GLState::BindBuffer(GL_COPY_WRITE_BUFFER, m_EBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, range.indexOffset, _indexData.size(), _indexData.data());
+	m_meshCount++;
+	return range;
+}
+
+void GeometryArena::Free(const ArenaRange& _range)
+{
+	if (_range.indexBytes == 0)
+		return;
+	m_vertices.Free(_range.baseVertex, _range.vertexCount);
+	m_indices.Free(_range.indexOffset, _range.indexBytes);
+	m_meshCount--;
+}
+
+bool GeometryArena::Bind() {
+	return GLState::BindVertexArray(m_VAO);
+}
+
+void GeometryArena::Reallocate(unsigned int& _buffer, size_t _oldBytes, size_t _newBytes)
+{
+	unsigned int buffer;
+	glGenBuffers(1, &buffer);
+	GLState::BindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, _newBytes, nullptr, GL_STATIC_DRAW);
+	if (_buffer)
+	{
+		GLState::BindBuffer(GL_COPY_READ_BUFFER, _buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, _oldBytes);
+		glDeleteBuffers(1, &_buffer);
+		GLState::ForgetBuffer(_buffer);
+	}
+	_buffer = buffer;
+}
+
+void GeometryArena::AttachBuffers()
+{
+	Bind();
+	GLState::BindBuffer(GL_ARRAY_BUFFER, m_VBO);
+	m_layout.Apply();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+	if (s_m_drawIdBuffer && GLFunctions::vertexAttribDivisor)
+	{
+		GLState::BindBuffer(GL_ARRAY_BUFFER, s_m_drawIdBuffer);
+		glVertexAttribIPointer(s_drawIdLocation, 1, GL_UNSIGNED_INT, sizeof(uint32_t), nullptr);
+		glEnableVertexAttribArray(s_drawIdLocation);
+		GLFunctions::vertexAttribDivisor(s_drawIdLocation, 1);
+	}
+	else
+		glDisableVertexAttribArray(s_drawIdLocation);
+}
@@ -1,86 +1,551 @@
 #include <Mesh.hpp>
 
-Mesh::Mesh(const std::vector<Vertex>& _tmpVertices, const std::vector<uint32_t>& _tmpIdxPos, const std::vector<uint32_t>& _tmpIdxUvs, const std::vector<uint32_t>& _tmpIdxNormals)
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+#include <GLFunctions.hpp>
+#include <GLState.hpp>
+#include <Log.hpp>
+#include <MeshOptimizer.hpp>
+#include <OcclusionBuffer.hpp>
+
+namespace
+{
+	inline uint16_t ToUnorm16(float _value) {
+		return static_cast<uint16_t>(std::lround(std::clamp(_value, 0.f, 1.f) * 65535.f));
+	}
+
+	// IEEE half, rounded to nearest (ties away), small values flushed through the denormals
+	uint16_t FloatToHalf(float _value)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &_value, sizeof(bits));
+		uint32_t sign = (bits >> 16) & 0x8000;
+		uint32_t floatExponent = (bits >> 23) & 0xff;
+		uint32_t mantissa = bits & 0x7fffff;
+		if (floatExponent == 0xff) // Inf, NaN
+			return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+
+		int32_t exponent = static_cast<int32_t>(floatExponent) - 127 + 15;
+		if (exponent >= 31)
+			return static_cast<uint16_t>(sign | 0x7c00);
+		if (exponent <= 0)
+		{
+			if (exponent < -10)
+				return static_cast<uint16_t>(sign);
+			mantissa |= 0x800000;
+			uint32_t shift = static_cast<uint32_t>(14 - exponent);
+			uint32_t half = (mantissa >> shift) + ((mantissa >> (shift - 1)) & 1);
+			return static_cast<uint16_t>(sign | half);
+		}
+		// A carry out of the mantissa rightly bumps the exponent
+		uint32_t half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+		half += (mantissa >> 12) & 1;
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	// Octahedral mapping (Cigolle et al., "A Survey of Efficient Representations for Independent Unit Vectors")
+	void OctEncode(const Vectorf3& _normal, uint16_t _out[2])
+	{
+		float length = std::abs(_normal[0]) + std::abs(_normal[1]) + std::abs(_normal[2]);
+		float x = 0.f, y = 0.f;
+		if (length > 0.f)
+		{
+			x = _normal[0] / length;
+			y = _normal[1] / length;
+			// Lower half folded over the diagonals
+			if (_normal[2] < 0.f)
+			{
+				float foldedX = (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f);
+				y = (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f);
+				x = foldedX;
+			}
+		}
+		_out[0] = ToUnorm16(x * 0.5f + 0.5f);
+		_out[1] = ToUnorm16(y * 0.5f + 0.5f);
+	}
+}
+
+Mesh::Mesh(const std::vector<Vertex>& _tmpVertices, const std::vector<uint32_t>& _tmpIdxPos, const std::vector<uint32_t>& _tmpIdxUvs, const std::vector<uint32_t>& _tmpIdxNormals,
+	const std::vector<uint32_t>& _corners)
 {
-	// Build final VAO (Mesh)
-	size_t total_size = std::max({ _tmpIdxPos.size(), _tmpIdxUvs.size(), _tmpIdxNormals.size() });
-	std::vector<Vertex> vertices;
-	vertices.resize(total_size);
-	for (size_t i = 0; i < total_size; i++)
+	// Build final VAO (Mesh), one vertex per distinct (position, uv, normal)
+	std::vector<uint32_t> remap;
+	std::vector<uint32_t> firstCorners;
+	MeshOptimizer::WeldCorners(_tmpIdxPos, _tmpIdxUvs, _tmpIdxNormals, remap, firstCorners);
+
+	m_vertices.resize(firstCorners.size());
+	for (size_t i = 0; i < firstCorners.size(); i++)
 	{
-		vertices[i].Position = _tmpVertices[_tmpIdxPos[i] - 1].Position;
+		uint32_t corner = firstCorners[i];
+		m_vertices[i].Position = _tmpVertices[_tmpIdxPos[corner] - 1].Position;
 
-		if (!_tmpIdxUvs.empty())
-			vertices[i].Uv = _tmpVertices[_tmpIdxUvs[i] - 1].Uv;
+		if (corner < _tmpIdxUvs.size())
+			m_vertices[i].Uv = _tmpVertices[_tmpIdxUvs[corner] - 1].Uv;
 		else
-			vertices[i].Uv = { 0 };
+			m_vertices[i].Uv = { 0 };
 
-		if (!_tmpIdxNormals.empty())
-			vertices[i].Normal = _tmpVertices[_tmpIdxNormals[i] - 1].Normal;
+		if (corner < _tmpIdxNormals.size())
+			m_vertices[i].Normal = _tmpVertices[_tmpIdxNormals[corner] - 1].Normal;
 		else
-			vertices[i].Normal = { 0 };
+			m_vertices[i].Normal = { 0 };
+	}
+
+	m_indices.resize(_corners.size());
+	for (size_t i = 0; i < _corners.size(); i++)
+		m_indices[i] = remap[_corners[i]];
+	m_vertexCount = m_vertices.size();
+	ResetLods();
+	ComputeBounds();
+
+	// Unwelded, every corner was its own vertex: only the corners of a same face were reused by the cache
+	size_t cornerCount = remap.size();
+	DEBUG_LOG("Mesh welded: %zu -> %zu vertices, VBO %.1f -> %.1f KB, vertex shader invocations %zu -> %zu (cache of %u)",
+		cornerCount, m_vertices.size(), cornerCount * sizeof(GpuVertex) / 1024.f, m_vertices.size() * sizeof(GpuVertex) / 1024.f,
+		MeshOptimizer::SimulateVertexCache(_corners, cornerCount), MeshOptimizer::SimulateVertexCache(m_indices, m_vertices.size()),
+		MeshOptimizer::s_cacheSize);
+}
+
+Mesh::Mesh(const VertexLayout& _layout, std::vector<unsigned char>&& _vertexData, size_t _vertexCount, std::vector<unsigned char>&& _indexData,
+	unsigned int _indexType, std::vector<MeshLod>&& _lods, const BoundingVolume& _bounds)
+	: m_vertexData(std::move(_vertexData)), m_layout(_layout), m_vertexCount(_vertexCount), m_indexData(std::move(_indexData)), m_indexType(_indexType),
+	m_lods(std::move(_lods)), m_bounds(_bounds)
+{
+	if (m_lods.empty())
+		m_lods = { { 0, m_indexData.size() / GetIndexSize(), 0.f } };
+}
+
+void Mesh::OptimizeIndexOrder()
+{
+	// Packed vertices are final
+	if (m_vertices.empty() || m_lods.empty() || m_lods[0].indexCount == 0)
+		return;
+
+	auto lodIndices = [this](const MeshLod& _lod) {
+		return std::vector<uint32_t>(m_indices.begin() + _lod.indexOffset, m_indices.begin() + _lod.indexOffset + _lod.indexCount); };
+
+	// ACMR: vertices shaded per triangle (0.5 at best, 3 at worst), ATVR: per vertex (1 at best)
+	size_t triangleCount = m_lods[0].indexCount / 3;
+	size_t shadedBefore = MeshOptimizer::SimulateVertexCache(lodIndices(m_lods[0]), m_vertices.size());
+	for (const MeshLod& lod : m_lods)
+	{
+		std::vector<uint32_t> indices = lodIndices(lod);
+		MeshOptimizer::OptimizeVertexCache(indices, m_vertices.size());
+		std::copy(indices.begin(), indices.end(), m_indices.begin() + lod.indexOffset);
+	}
+	size_t shadedAfter = MeshOptimizer::SimulateVertexCache(lodIndices(m_lods[0]), m_vertices.size());
+
+	// The finest level comes first, the order of first use is its own
+	std::vector<uint32_t> remap = MeshOptimizer::OptimizeVertexFetch(m_indices, m_vertices.size());
+	std::vector<Vertex> vertices(m_vertices.size());
+	for (size_t i = 0; i < m_vertices.size(); i++)
+		vertices[remap[i]] = m_vertices[i];
+	m_vertices.swap(vertices);
+
+	DEBUG_LOG("Mesh index order optimized: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (%zu triangles)",
+		static_cast<float>(shadedBefore) / triangleCount, static_cast<float>(shadedAfter) / triangleCount,
+		static_cast<float>(shadedBefore) / m_vertices.size(), static_cast<float>(shadedAfter) / m_vertices.size(), triangleCount);
+}
+
+void Mesh::BuildLods()
+{
+	const size_t maxLods = 5;
+	const size_t minIndices = 3 * 64;
+	if (m_lods.size() != 1 || m_vertices.empty())
+		return;
+
+	std::vector<float> positions(m_vertices.size() * 3);
+	for (size_t i = 0; i < m_vertices.size(); i++)
+		for (int k = 0; k < 3; k++)
+			positions[i * 3 + k] = m_vertices[i].Position[k];
+
+	// Every level comes from the full mesh, so its error is measured against it
+	const std::vector<uint32_t> full = m_indices;
+	size_t target = full.size();
+	std::string levels = std::to_string(full.size() / 3);
+	while (m_lods.size() < maxLods && m_lods.back().indexCount > minIndices)
+	{
+		target /= 2;
+		float error = 0.f;
+		std::vector<uint32_t> indices = MeshOptimizer::Simplify(full, positions, target / 3 * 3, error);
+		// Stuck on borders/seams, not worth a level
+		if (indices.empty() || indices.size() > m_lods.back().indexCount * 3 / 4)
+			break;
+		m_lods.push_back({ m_indices.size(), indices.size(), error });
+		m_indices.insert(m_indices.end(), indices.begin(), indices.end());
+		levels += " / " + std::to_string(indices.size() / 3) + " (" + std::to_string(error) + ")";
+	}
+	DEBUG_LOG("Mesh LODs: %zu levels, triangles (error): %s", m_lods.size(), levels.c_str());
+}
+
+size_t Mesh::SelectLod(float _pixelsPerUnit) const
+{
+	if (!lodEnabled)
+		return 0;
+	for (size_t lod = m_lods.size() - 1; lod > 0; lod--)
+		if (m_lods[lod].error * _pixelsPerUnit <= lodMaxPixelError)
+			return lod;
+	return 0;
+}
+
+void Mesh::PackVertices() {
+	PackVertices(VertexFormat::Float32, Vectorf3(0.f, 0.f, 0.f), Vectorf3(1.f, 1.f, 1.f));
+}
+
+void Mesh::PackVertices(VertexFormat _format, const Vectorf3& _positionOffset, const Vectorf3& _positionScale)
+{
+	if (m_vertices.empty())
+		return;
+	m_layout = VertexLayout::Get(_format);
+	m_vertexCount = m_vertices.size();
+	m_vertexData.resize(m_vertexCount * m_layout.stride);
+
+	if (_format == VertexFormat::Compact16)
+	{
+		GpuVertexCompact* packed = reinterpret_cast<GpuVertexCompact*>(m_vertexData.data());
+		for (size_t i = 0; i < m_vertexCount; i++)
+		{
+			const Vertex& vertex = m_vertices[i];
+			for (int k = 0; k < 3; k++)
+				packed[i].position[k] = ToUnorm16((vertex.Position[k] - _positionOffset[k]) / _positionScale[k]);
+			packed[i].position[3] = 0;
+			OctEncode(vertex.Normal, packed[i].normal);
+			packed[i].uv[0] = FloatToHalf(vertex.Uv[0]);
+			packed[i].uv[1] = FloatToHalf(vertex.Uv[1]);
+		}
+	}
+	else
+	{
+		GpuVertex* packed = reinterpret_cast<GpuVertex*>(m_vertexData.data());
+		for (size_t i = 0; i < m_vertexCount; i++)
+		{
+			const Vertex& vertex = m_vertices[i];
+			packed[i] = { { vertex.Position[0], vertex.Position[1], vertex.Position[2] }, { vertex.Uv[0], vertex.Uv[1] },
+				{ vertex.Normal[0], vertex.Normal[1], vertex.Normal[2] } };
+		}
 	}
-	this->SetVertices(vertices);
+
+	// Compact16 quantization step in model units, positions are off by half of it at most
+	float step = _format == VertexFormat::Compact16 ? std::max({ _positionScale[0], _positionScale[1], _positionScale[2] }) / 65535.f : 0.f;
+	DEBUG_LOG("Mesh vertices packed as %s: %u bytes per vertex (%zu as Vertex, %zu as GpuVertex), VBO %.1f KB, position step %g",
+		_format == VertexFormat::Compact16 ? "Compact16" : "Float32", m_layout.stride, sizeof(Vertex), sizeof(GpuVertex),
+		m_vertexData.size() / 1024.f, step);
+	m_vertices.clear();
+	m_vertices.shrink_to_fit();
+}
+
+void Mesh::PackIndices()
+{
+	if (m_indices.empty())
+		return;
+	if (m_vertexCount <= 65536)
+	{
+		m_indexType = GL_UNSIGNED_SHORT;
+		m_indexData.resize(m_indices.size() * sizeof(uint16_t));
+		uint16_t* packed = reinterpret_cast<uint16_t*>(m_indexData.data());
+		for (size_t i = 0; i < m_indices.size(); i++)
+			packed[i] = static_cast<uint16_t>(m_indices[i]);
+	}
+	else
+	{
+		m_indexType = GL_UNSIGNED_INT;
+		m_indexData.resize(m_indices.size() * sizeof(uint32_t));
+		std::memcpy(m_indexData.data(), m_indices.data(), m_indexData.size());
+	}
+	m_indices.clear();
+	m_indices.shrink_to_fit();
+}
+
+void Mesh::ResetLods() {
+	m_lods = { { 0, m_indices.size(), 0.f } };
+}
+
+void Mesh::ComputeBounds()
+{
+	if (m_vertices.empty())
+		return;
+	m_bounds = BoundingVolume::FromPoints(&m_vertices[0].Position[0], m_vertices.size(), sizeof(Vertex));
 }
 
 Mesh::~Mesh()
 {
 	m_indices.clear();
 	m_vertices.clear();
-	glDeleteVertexArrays(1, &m_VAO);
-	glDeleteBuffers(1, &m_VBO);
-	glDeleteBuffers(1, &m_EBO);
+	ReleaseGpu();
 }
 
 void Mesh::Unload()
 {
+	ReleaseGpu();
+	s_m_releasedCpuBytes -= m_releasedBytes;
+	m_releasedBytes = 0;
 	m_indices.clear();
+	ResetLods();
 	m_vertices.clear();
-	glDeleteVertexArrays(1, &m_VAO);
-	glDeleteBuffers(1, &m_VBO);
-	glDeleteBuffers(1, &m_EBO);
+	m_vertexData.clear();
+	m_vertexCount = 0;
+	m_indexData.clear();
 }
 
-void Mesh::SetVertices(const std::vector<Vertex>& _vertices) {
+void Mesh::ReleaseGpu()
+{
+	// Never uploaded: may be destroyed on a worker, without GL context
+	if (m_arena)
+	{
+		m_arena->Free(m_arenaRange);
+		m_arena = nullptr;
+	}
+	else if (m_VAO != static_cast<unsigned int>(-1))
+	{
+		glDeleteVertexArrays(1, &m_VAO);
+		glDeleteBuffers(1, &m_VBO);
+		glDeleteBuffers(1, &m_EBO);
+		GLState::ForgetVertexArray(m_VAO);
+		GLState::ForgetBuffer(m_VBO);
+		m_VAO = m_VBO = m_EBO = -1;
+	}
+	else
+		return;
+
+	s_m_indexBufferBytes -= m_indexBytes;
+	s_m_indexBufferBytes32 -= m_indexBytes / GetIndexSize() * sizeof(uint32_t);
+	s_m_shortIndexMeshes -= m_indexType == GL_UNSIGNED_SHORT;
+	s_m_uploadedMeshes--;
+	m_gpuBytes = 0;
+	m_indexBytes = 0;
+}
+
+size_t Mesh::ReleaseCpuData()
+{
+	if (m_gpuBytes == 0 || !HasCpuData())
+		return 0;
+	size_t bytes = m_vertexData.capacity() + m_indexData.capacity();
+	std::vector<unsigned char>().swap(m_vertexData);
+	std::vector<unsigned char>().swap(m_indexData);
+	m_releasedBytes += bytes;
+	s_m_releasedCpuBytes += bytes;
+	return bytes;
+}
+
+bool Mesh::RestoreCpuData(Mesh& _read)
+{
+	if (_read.m_vertexCount != m_vertexCount || _read.m_layout.stride != m_layout.stride || _read.m_indexType != m_indexType
+		|| _read.m_vertexData.size() + _read.m_indexData.size() != GetBufferBytes())
+		return false;
+	m_vertexData = std::move(_read.m_vertexData);
+	m_indexData = std::move(_read.m_indexData);
+	s_m_releasedCpuBytes -= m_releasedBytes;
+	m_releasedBytes = 0;
+	return true;
+}
+
+void Mesh::SetVertices(const std::vector<Vertex>& _vertices)
+{
 	m_vertices = _vertices;
+	m_vertexData.clear();
+	m_vertexCount = m_vertices.size();
+	ComputeBounds();
 }
 
-void Mesh::SetIndices(const std::vector<unsigned int>& _indices) {
+void Mesh::SetIndices(const std::vector<unsigned int>& _indices)
+{
 	m_indices = _indices;
+	m_indexData.clear();
+	ResetLods();
 }
 
 void Mesh::SetupMesh()
 {
-	glGenVertexArrays(1, &m_VAO);
-	glGenBuffers(1, &m_VBO);
-	glGenBuffers(1, &m_EBO);
+	if (m_vertexData.empty())
+		PackVertices();
+	if (m_indexData.empty())
+		PackIndices();
+	// Nothing to draw: not uploaded, Draw and GetDrawCommand skip it
+	if (m_vertexCount == 0 || m_indexData.empty())
+	{
+		DEBUG_WARNING("Mesh with %zu vertices and %zu index bytes not uploaded", m_vertexCount, m_indexData.size());
+		return;
+	}
+
+	if (GeometryArena::enabled && GeometryArena::IsSupported())
+	{
+		m_arena = &GeometryArena::Get(m_layout);
+		m_arenaRange = m_arena->Allocate(m_vertexData, m_vertexCount, m_indexData);
+	}
+	else
+	{
+		glGenVertexArrays(1, &m_VAO);
+		glGenBuffers(1, &m_VBO);
+		glGenBuffers(1, &m_EBO);
 
-	glBindVertexArray(m_VAO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+		GLState::BindVertexArray(m_VAO);
+		GLState::BindBuffer(GL_ARRAY_BUFFER, m_VBO);
 
-	glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(Vertex), &m_vertices[0].Position[0], GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, m_vertexData.size(), m_vertexData.data(), GL_STATIC_DRAW);
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indices.size() * sizeof(unsigned int), &m_indices[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indexData.size(), m_indexData.data(), GL_STATIC_DRAW);
 
-	// Vertex positions
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-	// Vertex texture coords
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, Uv)));
-	// Vertex normals
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(2);
-	glEnableVertexAttribArray(3);
+		m_layout.Apply();
+	}
+	m_gpuBytes = m_vertexData.size() + m_indexData.size();
+	m_indexBytes = m_indexData.size();
 
-	glBindVertexArray(0);
+	s_m_indexBufferBytes += m_indexBytes;
+	s_m_indexBufferBytes32 += m_indexBytes / GetIndexSize() * sizeof(uint32_t);
+	s_m_shortIndexMeshes += m_indexType == GL_UNSIGNED_SHORT;
+	s_m_uploadedMeshes++;
 }
 
-void Mesh::Draw()
+void Mesh::Draw(size_t _lod)
 {
+	// Empty, never uploaded
+	if (!m_arena && m_VAO == static_cast<unsigned int>(-1))
+		return;
+	const MeshLod& lod = m_lods[std::min(_lod, m_lods.size() - 1)];
+	s_m_frameTriangles += lod.indexCount / 3;
+	s_m_frameDraws++;
 	// Draw mesh
-	glBindVertexArray(m_VAO);
-	glDrawElements(GL_TRIANGLES, (GLsizei)m_indices.size(), GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
-	glActiveTexture(GL_TEXTURE0);
-}
\ No newline at end of file
+	if (m_arena)
+	{
+		// The meshes of the arena share its VAO, bound once for all of them
+		s_m_frameVAOBinds += m_arena->Bind();
+		GLFunctions::drawElementsBaseVertex(GL_TRIANGLES, (GLsizei)lod.indexCount, m_indexType,
+			(void*)(m_arenaRange.indexOffset + lod.indexOffset * GetIndexSize()), (GLint)m_arenaRange.baseVertex);
+	}
+	else
+	{
+		// Left bound: the next draw of this mesh does not bind it again
+		s_m_frameVAOBinds += GLState::BindVertexArray(m_VAO);
+		glDrawElements(GL_TRIANGLES, (GLsizei)lod.indexCount, m_indexType, (void*)(lod.indexOffset * GetIndexSize()));
+	}
+}
+
+bool Mesh::GetDrawCommand(size_t _lod, DrawElementsIndirectCommand& _command) const
+{
+	if (!m_arena)
+		return false;
+	const MeshLod& lod = m_lods[std::min(_lod, m_lods.size() - 1)];
+	_command.count = static_cast<uint32_t>(lod.indexCount);
+	_command.instanceCount = 1;
+	// Arena index ranges are 4 bytes aligned, whole indices of either size
+	_command.firstIndex = static_cast<uint32_t>(m_arenaRange.indexOffset / GetIndexSize() + lod.indexOffset);
+	_command.baseVertex = static_cast<int32_t>(m_arenaRange.baseVertex);
+	_command.baseInstance = 0;
+	return true;
+}
+
+void Mesh::AppendTriangles(OccluderMesh& _mesh, const Vectorf3& _positionOffset, const Vectorf3& _positionScale) const
+{
+	if (m_vertexData.empty() || m_indexData.empty() || m_lods.empty())
+		return;
+	auto position = std::find_if(m_layout.attributes.begin(), m_layout.attributes.end(),
+		[](const VertexAttribute& _attribute) { return _attribute.location == 0; });
+	if (position == m_layout.attributes.end())
+		return;
+
+	uint32_t firstVertex = static_cast<uint32_t>(_mesh.positions.size() / 3);
+	_mesh.positions.reserve(_mesh.positions.size() + m_vertexCount * 3);
+	for (size_t i = 0; i < m_vertexCount; i++)
+	{
+		const unsigned char* vertex = m_vertexData.data() + i * m_layout.stride + position->offset;
+		for (int k = 0; k < 3; k++)
+		{
+			if (position->type == GL_UNSIGNED_SHORT)
+			{
+				uint16_t quantized;
+				std::memcpy(&quantized, vertex + k * sizeof(uint16_t), sizeof(quantized));
+				_mesh.positions.push_back(_positionOffset[k] + quantized / 65535.f * _positionScale[k]);
+			}
+			else
+			{
+				float value;
+				std::memcpy(&value, vertex + k * sizeof(float), sizeof(value));
+				_mesh.positions.push_back(value);
+			}
+		}
+	}
+
+	// A triangle with an index past the vertices is dropped, a lod past the index data is not read
+	const MeshLod& lod = m_lods[0];
+	size_t indexCount = m_indexData.size() / (m_indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t));
+	if (lod.indexOffset > indexCount || lod.indexCount > indexCount - lod.indexOffset)
+		return;
+	_mesh.indices.reserve(_mesh.indices.size() + lod.indexCount);
+	for (size_t i = lod.indexOffset; i + 2 < lod.indexOffset + lod.indexCount; i += 3)
+	{
+		uint32_t triangle[3];
+		for (int k = 0; k < 3; k++)
+			if (m_indexType == GL_UNSIGNED_SHORT)
+				triangle[k] = reinterpret_cast<const uint16_t*>(m_indexData.data())[i + k];
+			else
+				triangle[k] = reinterpret_cast<const uint32_t*>(m_indexData.data())[i + k];
+		if (triangle[0] >= m_vertexCount || triangle[1] >= m_vertexCount || triangle[2] >= m_vertexCount)
+			continue;
+		for (int k = 0; k < 3; k++)
+			_mesh.indices.push_back(firstVertex + triangle[k]);
+	}
+}
+
+// Capacity: what is actually allocated
+size_t Mesh::GetCpuBytes() const {
+	return sizeof(Mesh) + m_vertices.capacity() * sizeof(Vertex) + m_vertexData.capacity() + m_indices.capacity() * sizeof(unsigned int)
+		+ m_indexData.capacity();
+}
+
+size_t Mesh::GetGpuBytes() const {
+	return m_gpuBytes;
+}
+void Mesh::EndFrameStats()
+{
+	s_m_lastFrameTriangles = s_m_frameTriangles;
+	s_m_frameTriangles = 0;
+	s_m_lastFrameDraws = s_m_frameDraws;
+	s_m_frameDraws = 0;
+	s_m_lastFrameVAOBinds = s_m_frameVAOBinds;
+	s_m_frameVAOBinds = 0;
+}
+
+size_t Mesh::GetLastFrameTriangles() {
+	return s_m_lastFrameTriangles;
+}
+
+size_t Mesh::GetLastFrameDraws() {
+	return s_m_lastFrameDraws;
+}
+
+size_t Mesh::GetLastFrameVAOBinds() {
+	return s_m_lastFrameVAOBinds;
+}
+
+void Mesh::AddFrameDraws(size_t _draws, size_t _triangles)
+{
+	s_m_frameDraws += _draws;
+	s_m_frameTriangles += _triangles;
+}
+
+void Mesh::LogIndexStats()
+{
+	size_t uploadedMeshes = s_m_uploadedMeshes;
+	if (uploadedMeshes == 0)
+		return;
+	size_t indexBufferBytes = s_m_indexBufferBytes;
+	size_t indexBufferBytes32 = s_m_indexBufferBytes32;
+	DEBUG_LOG("Index buffers: %.1f KB, %.1f KB at 32 bits (%zu of %zu meshes at 16 bits, %.1f KB saved)",
+		indexBufferBytes / 1024.f, indexBufferBytes32 / 1024.f, s_m_shortIndexMeshes.load(), uploadedMeshes,
+		(indexBufferBytes32 - indexBufferBytes) / 1024.f);
+}
+
+size_t Mesh::GetIndexBufferBytes() {
+	return s_m_indexBufferBytes;
+}
+
+size_t Mesh::GetIndexBufferBytes32() {
+	return s_m_indexBufferBytes32;
+}
+
+size_t Mesh::GetReleasedCpuBytes() {
+	return s_m_releasedCpuBytes;
+}
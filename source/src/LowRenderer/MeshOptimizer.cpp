@@ -0,0 +1,484 @@
+#include <MeshOptimizer.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+namespace
+{
+	// Symmetric 4x4 matrix of the squared distances to a set of planes, weighted by their area
+	struct Quadric
+	{
+		double xx = 0, xy = 0, xz = 0, xw = 0, yy = 0, yz = 0, yw = 0, zz = 0, zw = 0, ww = 0;
+		double weight = 0;
+
+		void AddPlane(double _a, double _b, double _c, double _d, double _weight)
+		{
+			xx += _a * _a * _weight; xy += _a * _b * _weight; xz += _a * _c * _weight; xw += _a * _d * _weight;
+			yy += _b * _b * _weight; yz += _b * _c * _weight; yw += _b * _d * _weight;
+			zz += _c * _c * _weight; zw += _c * _d * _weight;
+			ww += _d * _d * _weight;
+			weight += _weight;
+		}
+
+		Quadric& operator+=(const Quadric& _other)
+		{
+			xx += _other.xx; xy += _other.xy; xz += _other.xz; xw += _other.xw;
+			yy += _other.yy; yz += _other.yz; yw += _other.yw;
+			zz += _other.zz; zw += _other.zw;
+			ww += _other.ww;
+			weight += _other.weight;
+			return *this;
+		}
+
+		// Weighted sum of the squared distances from the point to the planes
+		double Evaluate(double _x, double _y, double _z) const
+		{
+			return xx * _x * _x + yy * _y * _y + zz * _z * _z + ww
+				+ 2.0 * (xy * _x * _y + xz * _x * _z + yz * _y * _z + xw * _x + yw * _y + zw * _z);
+		}
+	};
+
+	void TriangleNormal(const float* _p0, const float* _p1, const float* _p2, double _normal[3])
+	{
+		double e1[3] = { _p1[0] - _p0[0], _p1[1] - _p0[1], _p1[2] - _p0[2] };
+		double e2[3] = { _p2[0] - _p0[0], _p2[1] - _p0[1], _p2[2] - _p0[2] };
+		_normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		_normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		_normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	}
+}
+
+void MeshOptimizer::WeldCorners(const std::vector<uint32_t>& _idxPositions, const std::vector<uint32_t>& _idxUvs, const std::vector<uint32_t>& _idxNormals,
+	std::vector<uint32_t>& _remap, std::vector<uint32_t>& _firstCorners)
+{
+	size_t cornerCount = std::max({ _idxPositions.size(), _idxUvs.size(), _idxNormals.size() });
+	auto at = [](const std::vector<uint32_t>& _indices, size_t _i) { return _i < _indices.size() ? _indices[_i] : 0u; };
+
+	_remap.resize(cornerCount);
+	_firstCorners.clear();
+	_firstCorners.reserve(cornerCount / 4);
+
+	// Open addressing, at most half full. Slots hold welded vertex ids
+	const uint32_t empty = ~0u;
+	size_t capacity = 16;
+	while (capacity < cornerCount * 2)
+		capacity *= 2;
+	std::vector<uint32_t> table(capacity, empty);
+
+	for (size_t corner = 0; corner < cornerCount; corner++)
+	{
+		uint32_t p = at(_idxPositions, corner), u = at(_idxUvs, corner), n = at(_idxNormals, corner);
+		uint64_t hash = (p * 0x9E3779B1ull) ^ (u * 0x85EBCA77ull) ^ (n * 0xC2B2AE3Dull);
+		hash ^= hash >> 29;
+
+		size_t slot = hash & (capacity - 1);
+		while (true)
+		{
+			uint32_t vertex = table[slot];
+			if (vertex == empty)
+			{
+				vertex = static_cast<uint32_t>(_firstCorners.size());
+				table[slot] = vertex;
+				_firstCorners.push_back(static_cast<uint32_t>(corner));
+				_remap[corner] = vertex;
+				break;
+			}
+			uint32_t other = _firstCorners[vertex];
+			if (at(_idxPositions, other) == p && at(_idxUvs, other) == u && at(_idxNormals, other) == n)
+			{
+				_remap[corner] = vertex;
+				break;
+			}
+			slot = (slot + 1) & (capacity - 1);
+		}
+	}
+}
+
+size_t MeshOptimizer::SimulateVertexCache(const std::vector<uint32_t>& _indices, size_t _vertexCount, unsigned int _cacheSize)
+{
+	// A vertex is in the cache while fewer than _cacheSize misses happened since its own miss
+	std::vector<size_t> missTime(_vertexCount, 0);
+	size_t misses = 0;
+	for (uint32_t index : _indices)
+	{
+		if (index >= _vertexCount)
+			continue;
+		if (missTime[index] == 0 || misses - missTime[index] >= _cacheSize)
+		{
+			misses++;
+			missTime[index] = misses;
+		}
+	}
+	return misses;
+}
+
+float MeshOptimizer::ForsythVertexScore(int _cachePosition, uint32_t _activeTriangles)
+{
+	// No triangle left to draw
+	if (_activeTriangles == 0)
+		return -1.f;
+
+	const float cacheDecayPower = 1.5f;
+	const float lastTriangleScore = 0.75f;
+	const float valenceBoostScale = 2.f;
+	const float valenceBoostPower = 0.5f;
+
+	float score = 0.f;
+	if (_cachePosition >= 0)
+	{
+		// The last triangle's vertices get a fixed score, to not favour a strip over a fan
+		if (_cachePosition < 3)
+			score = lastTriangleScore;
+		else
+			score = std::pow(1.f - static_cast<float>(_cachePosition - 3) / (s_cacheSize - 3), cacheDecayPower);
+	}
+	// Vertices with few triangles left go first, so they do not come back later with a cold cache
+	return score + valenceBoostScale * std::pow(static_cast<float>(_activeTriangles), -valenceBoostPower);
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<uint32_t>& _indices, size_t _vertexCount)
+{
+	size_t triangleCount = _indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	// Triangles of each vertex, the first activeTriangles[v] ones are not drawn yet
+	std::vector<uint32_t> activeTriangles(_vertexCount, 0);
+	for (uint32_t index : _indices)
+		activeTriangles[index]++;
+	std::vector<uint32_t> adjacencyStart(_vertexCount + 1, 0);
+	for (size_t v = 0; v < _vertexCount; v++)
+		adjacencyStart[v + 1] = adjacencyStart[v] + activeTriangles[v];
+	std::vector<uint32_t> adjacency(_indices.size());
+	{
+		std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+		for (size_t i = 0; i < _indices.size(); i++)
+			adjacency[fill[_indices[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+
+	std::vector<int> cachePositions(_vertexCount, -1);
+	std::vector<float> vertexScores(_vertexCount);
+	for (size_t v = 0; v < _vertexCount; v++)
+		vertexScores[v] = ForsythVertexScore(-1, activeTriangles[v]);
+
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	size_t bestTriangle = 0;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		triangleScores[t] = vertexScores[_indices[t * 3]] + vertexScores[_indices[t * 3 + 1]] + vertexScores[_indices[t * 3 + 2]];
+		if (triangleScores[t] > triangleScores[bestTriangle])
+			bestTriangle = t;
+	}
+
+	// 3 more entries for the vertices pushed out by the last triangle, their scores drop
+	uint32_t cache[s_cacheSize + 3];
+	size_t cacheCount = 0;
+	size_t scanCursor = 0;
+
+	std::vector<uint32_t> result;
+	result.reserve(_indices.size());
+	while (result.size() < triangleCount * 3)
+	{
+		// Nothing in the cache has triangles left: take the next one in file order
+		if (bestTriangle == triangleCount)
+		{
+			while (emitted[scanCursor])
+				scanCursor++;
+			bestTriangle = scanCursor;
+		}
+
+		const uint32_t* triangle = &_indices[bestTriangle * 3];
+		emitted[bestTriangle] = true;
+		result.insert(result.end(), triangle, triangle + 3);
+
+		uint32_t newCache[s_cacheSize + 3];
+		size_t newCount = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t v = triangle[k];
+			// Not drawable anymore
+			uint32_t* first = &adjacency[adjacencyStart[v]];
+			uint32_t* last = first + activeTriangles[v];
+			uint32_t* it = std::find(first, last, static_cast<uint32_t>(bestTriangle));
+			if (it != last)
+			{
+				*it = *(last - 1);
+				activeTriangles[v]--;
+			}
+			if (std::find(newCache, newCache + newCount, v) == newCache + newCount)
+				newCache[newCount++] = v;
+		}
+		for (size_t i = 0; i < cacheCount; i++)
+			if (std::find(triangle, triangle + 3, cache[i]) == triangle + 3)
+				newCache[newCount++] = cache[i];
+
+		// Rescore what moved in the cache, then pick the best triangle around it
+		for (size_t i = 0; i < newCount; i++)
+		{
+			uint32_t v = newCache[i];
+			cachePositions[v] = i < s_cacheSize ? static_cast<int>(i) : -1;
+			float score = ForsythVertexScore(cachePositions[v], activeTriangles[v]);
+			float delta = score - vertexScores[v];
+			vertexScores[v] = score;
+			for (uint32_t a = adjacencyStart[v]; a < adjacencyStart[v] + activeTriangles[v]; a++)
+				triangleScores[adjacency[a]] += delta;
+		}
+
+		bestTriangle = triangleCount;
+		float bestScore = -1.f;
+		cacheCount = std::min<size_t>(newCount, s_cacheSize);
+		for (size_t i = 0; i < cacheCount; i++)
+		{
+			cache[i] = newCache[i];
+			uint32_t v = newCache[i];
+			for (uint32_t a = adjacencyStart[v]; a < adjacencyStart[v] + activeTriangles[v]; a++)
+			{
+				uint32_t t = adjacency[a];
+				if (triangleScores[t] > bestScore)
+				{
+					bestScore = triangleScores[t];
+					bestTriangle = t;
+				}
+			}
+		}
+	}
+	_indices.swap(result);
+}
+
+std::vector<uint32_t> MeshOptimizer::OptimizeVertexFetch(std::vector<uint32_t>& _indices, size_t _vertexCount)
+{
+	const uint32_t unused = ~0u;
+	std::vector<uint32_t> remap(_vertexCount, unused);
+	uint32_t next = 0;
+	for (uint32_t& index : _indices)
+	{
+		if (remap[index] == unused)
+			remap[index] = next++;
+		index = remap[index];
+	}
+	// Vertices no triangle uses go last
+	for (uint32_t& newIndex : remap)
+		if (newIndex == unused)
+			newIndex = next++;
+	return remap;
+}
+
+std::vector<uint32_t> MeshOptimizer::Simplify(const std::vector<uint32_t>& _indices, const std::vector<float>& _positions, size_t _targetIndexCount, float& _error)
+{
+	size_t vertexCount = _positions.size() / 3;
+	std::vector<uint32_t> indices = _indices;
+	double maxError = 0.0;
+	auto position = [&_positions](uint32_t _vertex) { return &_positions[_vertex * 3]; };
+
+	// Collapses work on positions: the vertices sharing one (uv/normal seams) move together
+	std::vector<uint32_t> positionIds(vertexCount);
+	uint32_t positionCount = 0;
+	{
+		struct PositionHash
+		{
+			const std::vector<float>* positions;
+			size_t operator()(uint32_t _vertex) const {
+				const float* p = &(*positions)[_vertex * 3];
+				return std::hash<float>()(p[0]) ^ (std::hash<float>()(p[1]) * 31) ^ (std::hash<float>()(p[2]) * 961);
+			}
+		};
+		struct PositionEqual
+		{
+			const std::vector<float>* positions;
+			bool operator()(uint32_t _a, uint32_t _b) const {
+				return std::equal(&(*positions)[_a * 3], &(*positions)[_a * 3] + 3, &(*positions)[_b * 3]);
+			}
+		};
+		std::unordered_map<uint32_t, uint32_t, PositionHash, PositionEqual> firstVertex(vertexCount, PositionHash{ &_positions }, PositionEqual{ &_positions });
+		for (uint32_t v = 0; v < vertexCount; v++)
+		{
+			auto it = firstVertex.try_emplace(v, positionCount).first;
+			if (it->second == positionCount)
+				positionCount++;
+			positionIds[v] = it->second;
+		}
+	}
+	// Vertices of each position
+	std::vector<uint32_t> wedgeStart(positionCount + 1, 0);
+	std::vector<uint32_t> wedges(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; v++)
+		wedgeStart[positionIds[v] + 1]++;
+	std::partial_sum(wedgeStart.begin(), wedgeStart.end(), wedgeStart.begin());
+	{
+		std::vector<uint32_t> fill(wedgeStart.begin(), wedgeStart.end() - 1);
+		for (uint32_t v = 0; v < vertexCount; v++)
+			wedges[fill[positionIds[v]]++] = v;
+	}
+
+	// Edges with a single triangle are the mesh borders, they stay
+	std::vector<bool> locked(positionCount, false);
+	{
+		std::unordered_map<uint64_t, uint32_t> edgeUses;
+		edgeUses.reserve(indices.size());
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			uint32_t a = positionIds[indices[i]], b = positionIds[indices[i % 3 == 2 ? i - 2 : i + 1]];
+			edgeUses[static_cast<uint64_t>(std::min(a, b)) << 32 | std::max(a, b)]++;
+		}
+		for (const std::pair<const uint64_t, uint32_t>& edge : edgeUses)
+			if (edge.second == 1)
+				locked[edge.first >> 32] = locked[edge.first & 0xFFFFFFFF] = true;
+	}
+
+	std::vector<Quadric> quadrics(positionCount);
+	for (size_t t = 0; t + 2 < indices.size(); t += 3)
+	{
+		const float* p0 = position(indices[t]);
+		double normal[3];
+		TriangleNormal(p0, position(indices[t + 1]), position(indices[t + 2]), normal);
+		double length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (length <= 0.0)
+			continue;
+		double a = normal[0] / length, b = normal[1] / length, c = normal[2] / length;
+		double d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+		for (int k = 0; k < 3; k++)
+			quadrics[positionIds[indices[t + k]]].AddPlane(a, b, c, d, length * 0.5);
+	}
+
+	struct Collapse
+	{
+		uint32_t from;	// Positions
+		uint32_t to;
+		double cost;
+	};
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<bool> touched(positionCount);
+	std::vector<uint32_t> adjacencyStart(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<uint32_t> wedgeTargets;
+
+	// Each pass collapses independent edges (no shared neighbourhood), then rebuilds the triangles
+	while (indices.size() > _targetIndexCount)
+	{
+		auto cost = [&](uint32_t _from, uint32_t _to) {
+			if (locked[_from])
+				return std::numeric_limits<double>::infinity();
+			Quadric merged = quadrics[_from];
+			merged += quadrics[_to];
+			const float* p = position(wedges[wedgeStart[_to]]);
+			return std::max(merged.Evaluate(p[0], p[1], p[2]), 0.0) / std::max(merged.weight, 1e-12);
+		};
+
+		collapses.clear();
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			uint32_t a = positionIds[indices[i]], b = positionIds[indices[i % 3 == 2 ? i - 2 : i + 1]];
+			// An inner edge is seen once per side, keep one
+			if (a >= b)
+				continue;
+			double ab = cost(a, b), ba = cost(b, a);
+			if (ab <= ba && ab != std::numeric_limits<double>::infinity())
+				collapses.push_back({ a, b, ab });
+			else if (ba < ab)
+				collapses.push_back({ b, a, ba });
+		}
+		if (collapses.empty())
+			break;
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& _a, const Collapse& _b) { return _a.cost < _b.cost; });
+
+		// Triangles of each vertex
+		std::fill(adjacencyStart.begin(), adjacencyStart.end(), 0);
+		for (uint32_t index : indices)
+			adjacencyStart[index + 1]++;
+		std::partial_sum(adjacencyStart.begin(), adjacencyStart.end(), adjacencyStart.begin());
+		adjacency.resize(indices.size());
+		{
+			std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+			for (size_t i = 0; i < indices.size(); i++)
+				adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		std::iota(remap.begin(), remap.end(), 0);
+		std::fill(touched.begin(), touched.end(), false);
+		// A collapse removes about 2 triangles
+		size_t collapsesLeft = (indices.size() - _targetIndexCount) / 6 + 1;
+		size_t collapsed = 0;
+		for (const Collapse& collapse : collapses)
+		{
+			if (collapsed >= collapsesLeft)
+				break;
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			// Each vertex of "from" goes to the vertex of "to" it shares an edge with (same side of a seam)
+			bool valid = true;
+			wedgeTargets.clear();
+			for (uint32_t w = wedgeStart[collapse.from]; w < wedgeStart[collapse.from + 1] && valid; w++)
+			{
+				uint32_t vertex = wedges[w];
+				uint32_t target = ~0u;
+				for (uint32_t a = adjacencyStart[vertex]; a < adjacencyStart[vertex + 1] && target == ~0u; a++)
+					for (int k = 0; k < 3; k++)
+						if (positionIds[indices[adjacency[a] * 3 + k]] == collapse.to)
+							target = indices[adjacency[a] * 3 + k];
+				// No longer used, or its side of the seam does not reach "to"
+				if (target == ~0u && adjacencyStart[vertex] != adjacencyStart[vertex + 1])
+					valid = false;
+				wedgeTargets.push_back(target);
+			}
+
+			// Moving "from" onto "to" must not flip a triangle that stays
+			const float* destination = position(wedges[wedgeStart[collapse.to]]);
+			for (uint32_t w = wedgeStart[collapse.from]; w < wedgeStart[collapse.from + 1] && valid; w++)
+			{
+				uint32_t vertex = wedges[w];
+				for (uint32_t a = adjacencyStart[vertex]; a < adjacencyStart[vertex + 1] && valid; a++)
+				{
+					const uint32_t* triangle = &indices[adjacency[a] * 3];
+					if (positionIds[triangle[0]] == collapse.to || positionIds[triangle[1]] == collapse.to || positionIds[triangle[2]] == collapse.to)
+						continue;
+					const float* corners[3] = { position(triangle[0]), position(triangle[1]), position(triangle[2]) };
+					double before[3], after[3];
+					TriangleNormal(corners[0], corners[1], corners[2], before);
+					for (int k = 0; k < 3; k++)
+						if (triangle[k] == vertex)
+							corners[k] = destination;
+					TriangleNormal(corners[0], corners[1], corners[2], after);
+					valid = before[0] * after[0] + before[1] * after[1] + before[2] * after[2] > 0.0;
+				}
+			}
+			if (!valid)
+				continue;
+
+			for (uint32_t w = wedgeStart[collapse.from]; w < wedgeStart[collapse.from + 1]; w++)
+				if (wedgeTargets[w - wedgeStart[collapse.from]] != ~0u)
+					remap[wedges[w]] = wedgeTargets[w - wedgeStart[collapse.from]];
+			quadrics[collapse.to] += quadrics[collapse.from];
+			maxError = std::max(maxError, collapse.cost);
+			collapsed++;
+			// Its neighbourhood changed, the other checks of this pass would be stale
+			for (uint32_t w = wedgeStart[collapse.from]; w < wedgeStart[collapse.from + 1]; w++)
+				for (uint32_t a = adjacencyStart[wedges[w]]; a < adjacencyStart[wedges[w] + 1]; a++)
+					for (int k = 0; k < 3; k++)
+						touched[positionIds[indices[adjacency[a] * 3 + k]]] = true;
+		}
+		if (collapsed == 0)
+			break;
+
+		// Triangles that lost an edge disappear
+		size_t kept = 0;
+		for (size_t t = 0; t + 2 < indices.size(); t += 3)
+		{
+			uint32_t a = remap[indices[t]], b = remap[indices[t + 1]], c = remap[indices[t + 2]];
+			if (positionIds[a] == positionIds[b] || positionIds[b] == positionIds[c] || positionIds[a] == positionIds[c])
+				continue;
+			indices[kept++] = a;
+			indices[kept++] = b;
+			indices[kept++] = c;
+		}
+		indices.resize(kept);
+	}
+
+	_error = static_cast<float>(std::sqrt(maxError));
+	return indices;
+}
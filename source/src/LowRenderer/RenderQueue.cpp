@@ -0,0 +1,120 @@
+#include <RenderQueue.hpp>
+
+#include <algorithm>
+
+#include <MappedFile.hpp>
+#include <Material.hpp>
+#include <Shader.hpp>
+
+void RenderQueue::Begin()
+{
+	m_items.clear();
+	// Keeps the buckets, a frame usually sees the same states
+	m_shaderIds.clear();
+	m_textureIds.clear();
+	m_geometryIds.clear();
+	m_materialIds.clear();
+}
+
+uint32_t RenderQueue::GetId(std::unordered_map<uint64_t, uint32_t>& _ids, uint64_t _value, uint32_t _bits)
+{
+	uint32_t last = (1u << _bits) - 1;
+	auto [it, inserted] = _ids.try_emplace(_value, static_cast<uint32_t>(std::min<size_t>(_ids.size(), last)));
+	return it->second;
+}
+
+void RenderQueue::Push(const RenderItem& _item) {
+	m_items.push_back(_item);
+}
+
+RenderItem RenderQueue::MakeItem(RenderPass _pass, const Shader& _shader, const Material& _material, const void* _geometry, float _depth,
+	SceneNode* _node)
+{
+	RenderItem item;
+	item.node = _node;
+	item.program = _shader.GetShaderProgram();
+	item.textures = (static_cast<uint64_t>(_material.diffuse2DMap) << 32) | _material.specular2DMap;
+	item.geometry = _geometry;
+
+	// Uniform values only, the maps are in the texture set
+	float colors[10] = { _material.ambient[0], _material.ambient[1], _material.ambient[2], _material.diffuse[0], _material.diffuse[1],
+		_material.diffuse[2], _material.specular[0], _material.specular[1], _material.specular[2], _material.shininess };
+	item.material = MappedFile::Hash(colors, sizeof(colors));
+	uint64_t depth = static_cast<uint64_t>(std::clamp(_depth, 0.f, 1.f) * 65535.f);
+	item.key = (static_cast<uint64_t>(_pass) & 0x3) << 62 | depth;
+	return item;
+}
+
+RenderItem* RenderQueue::Allocate(size_t _count)
+{
+	size_t first = m_items.size();
+	m_items.resize(first + _count);
+	return m_items.data() + first;
+}
+
+void RenderQueue::AssignIds()
+{
+	// First seen order: the same keys as when pushed one by one
+	for (RenderItem& item : m_items)
+		item.key |= static_cast<uint64_t>(GetId(m_shaderIds, item.program, 8)) << 54
+			| static_cast<uint64_t>(GetId(m_textureIds, item.textures, 12)) << 42
+			| static_cast<uint64_t>(GetId(m_geometryIds, reinterpret_cast<uintptr_t>(item.geometry), 12)) << 30
+			| static_cast<uint64_t>(GetId(m_materialIds, item.material, 14)) << 16;
+}
+
+void RenderQueue::Sort()
+{
+	AssignIds();
+	if (sorted)
+		RadixSort();
+	CountSwitches();
+}
+
+void RenderQueue::RadixSort()
+{
+	size_t count = m_items.size();
+	if (count < 2)
+		return;
+	m_scratch.resize(count);
+
+	// Every histogram in one read
+	size_t histograms[8][256] = {};
+	for (const RenderItem& item : m_items)
+		for (int pass = 0; pass < 8; pass++)
+			histograms[pass][(item.key >> (pass * 8)) & 0xFF]++;
+
+	for (int pass = 0; pass < 8; pass++)
+	{
+		size_t* histogram = histograms[pass];
+		int shift = pass * 8;
+		if (histogram[(m_items[0].key >> shift) & 0xFF] == count)
+			continue;
+
+		size_t offset = 0;
+		for (int digit = 0; digit < 256; digit++)
+		{
+			size_t digitCount = histogram[digit];
+			histogram[digit] = offset;
+			offset += digitCount;
+		}
+		// Stable: equal keys stay in push order
+		for (const RenderItem& item : m_items)
+			m_scratch[histogram[(item.key >> shift) & 0xFF]++] = item;
+		m_items.swap(m_scratch);
+	}
+}
+
+void RenderQueue::CountSwitches()
+{
+	m_stats = {};
+	m_stats.items = m_items.size();
+	const RenderItem* previous = nullptr;
+	for (const RenderItem& item : m_items)
+	{
+		// The first draw binds everything
+		m_stats.programSwitches += !previous || previous->program != item.program;
+		m_stats.textureSwitches += !previous || previous->textures != item.textures;
+		m_stats.vaoSwitches += !previous || previous->geometry != item.geometry;
+		previous = &item;
+	}
+}
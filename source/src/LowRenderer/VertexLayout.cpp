@@ -0,0 +1,42 @@
+#include <VertexLayout.hpp>
+
+#include <cstddef>
+
+#include <glad/glad.h>
+
+VertexLayout VertexLayout::Float32()
+{
+	VertexLayout layout;
+	layout.stride = sizeof(GpuVertex);
+	layout.attributes = {
+		{ 0, 3, GL_FLOAT, GL_FALSE, offsetof(GpuVertex, position) },
+		{ 2, 2, GL_FLOAT, GL_FALSE, offsetof(GpuVertex, uv) },
+		{ 3, 3, GL_FLOAT, GL_FALSE, offsetof(GpuVertex, normal) } };
+	return layout;
+}
+
+VertexLayout VertexLayout::Compact16()
+{
+	// Unsigned: GL 3.3 maps signed normalized values with (2c + 1) / (2^16 - 1), 0 would not be exact
+	VertexLayout layout;
+	layout.stride = sizeof(GpuVertexCompact);
+	layout.attributes = {
+		{ 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(GpuVertexCompact, position) },
+		{ 2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(GpuVertexCompact, uv) },
+		{ 3, 2, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(GpuVertexCompact, normal) } };
+	return layout;
+}
+
+VertexLayout VertexLayout::Get(VertexFormat _format) {
+	return _format == VertexFormat::Compact16 ? Compact16() : Float32();
+}
+
+void VertexLayout::Apply() const
+{
+	for (const VertexAttribute& attribute : attributes)
+	{
+		glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized ? GL_TRUE : GL_FALSE,
+			stride, reinterpret_cast<void*>(static_cast<uintptr_t>(attribute.offset)));
+		glEnableVertexAttribArray(attribute.location);
+	}
+}
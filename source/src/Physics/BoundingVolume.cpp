@@ -0,0 +1,114 @@
+#include <BoundingVolume.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#include <xmmintrin.h>
+
+namespace
+{
+	// xyz in the first 3 lanes. Reads a 4th float: fine inside a vertex, not past the last point
+	inline __m128 LoadPoint(const unsigned char* _point, bool _last)
+	{
+		const float* xyz = reinterpret_cast<const float*>(_point);
+		return _last ? _mm_set_ps(0.f, xyz[2], xyz[1], xyz[0]) : _mm_loadu_ps(xyz);
+	}
+}
+
+BoundingVolume BoundingVolume::FromPoints(const float* _first, size_t _count, size_t _strideBytes)
+{
+	BoundingVolume volume;
+	if (_count == 0)
+		return volume;
+
+	const unsigned char* points = reinterpret_cast<const unsigned char*>(_first);
+	__m128 lowest = LoadPoint(points, _count == 1);
+	__m128 highest = lowest;
+	for (size_t i = 1; i < _count; i++)
+	{
+		__m128 point = LoadPoint(points + i * _strideBytes, i == _count - 1);
+		lowest = _mm_min_ps(lowest, point);
+		highest = _mm_max_ps(highest, point);
+	}
+
+	// Sphere on the box center, as far as the farthest point (tighter than the half diagonal)
+	__m128 center = _mm_mul_ps(_mm_add_ps(lowest, highest), _mm_set1_ps(0.5f));
+	__m128 farthest = _mm_setzero_ps();
+	for (size_t i = 0; i < _count; i++)
+	{
+		__m128 offset = _mm_sub_ps(LoadPoint(points + i * _strideBytes, i == _count - 1), center);
+		offset = _mm_mul_ps(offset, offset);
+		__m128 squared = _mm_add_ss(offset, _mm_add_ss(_mm_shuffle_ps(offset, offset, _MM_SHUFFLE(1, 1, 1, 1)),
+			_mm_shuffle_ps(offset, offset, _MM_SHUFFLE(2, 2, 2, 2))));
+		farthest = _mm_max_ss(farthest, squared);
+	}
+
+	alignas(16) float lanes[3][4];
+	_mm_store_ps(lanes[0], lowest);
+	_mm_store_ps(lanes[1], highest);
+	_mm_store_ps(lanes[2], center);
+	volume.boxMin = Vectorf3(lanes[0][0], lanes[0][1], lanes[0][2]);
+	volume.boxMax = Vectorf3(lanes[1][0], lanes[1][1], lanes[1][2]);
+	volume.center = Vectorf3(lanes[2][0], lanes[2][1], lanes[2][2]);
+	volume.radius = std::sqrt(_mm_cvtss_f32(farthest));
+	return volume;
+}
+
+void BoundingVolume::Merge(const BoundingVolume& _other)
+{
+	if (_other.IsEmpty())
+		return;
+	if (IsEmpty())
+	{
+		*this = _other;
+		return;
+	}
+
+	for (int k = 0; k < 3; k++)
+	{
+		boxMin[k] = std::min(boxMin[k], _other.boxMin[k]);
+		boxMax[k] = std::max(boxMax[k], _other.boxMax[k]);
+	}
+
+	// Smallest sphere around both spheres
+	Vectorf3 toOther(_other.center[0] - center[0], _other.center[1] - center[1], _other.center[2] - center[2]);
+	float distance = toOther.Magnitude();
+	if (distance + _other.radius <= radius)
+		return;
+	if (distance + radius <= _other.radius)
+	{
+		center = _other.center;
+		radius = _other.radius;
+		return;
+	}
+	float newRadius = (distance + radius + _other.radius) * 0.5f;
+	float t = (newRadius - radius) / distance;
+	center = Vectorf3(center[0] + toOther[0] * t, center[1] + toOther[1] * t, center[2] + toOther[2] * t);
+	radius = newRadius;
+}
+
+BoundingVolume BoundingVolume::Transformed(const Matrix4x4& _matrix) const
+{
+	if (IsEmpty())
+		return *this;
+
+	// Rows are the axes, the 4th column the translation
+	BoundingVolume result;
+	float scale = 0.f;
+	for (int i = 0; i < 3; i++)
+	{
+		result.boxMin[i] = result.boxMax[i] = result.center[i] = _matrix[i][3];
+		for (int j = 0; j < 3; j++)
+		{
+			float a = _matrix[i][j] * boxMin[j];
+			float b = _matrix[i][j] * boxMax[j];
+			result.boxMin[i] += std::min(a, b);
+			result.boxMax[i] += std::max(a, b);
+			result.center[i] += _matrix[i][j] * center[j];
+		}
+		float axis = std::sqrt(_matrix[0][i] * _matrix[0][i] + _matrix[1][i] * _matrix[1][i] + _matrix[2][i] * _matrix[2][i]);
+		scale = std::max(scale, axis);
+	}
+	result.radius = radius * scale;
+	return result;
+}
@@ -0,0 +1,377 @@
+#include <Bvh.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <random>
+
+namespace
+{
+	inline float Area(const float (&_boxMin)[3], const float (&_boxMax)[3])
+	{
+		float x = _boxMax[0] - _boxMin[0], y = _boxMax[1] - _boxMin[1], z = _boxMax[2] - _boxMin[2];
+		return 2.f * (x * y + y * z + z * x);
+	}
+
+	inline void Grow(float (&_boxMin)[3], float (&_boxMax)[3], const float (&_otherMin)[3], const float (&_otherMax)[3])
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			_boxMin[k] = std::min(_boxMin[k], _otherMin[k]);
+			_boxMax[k] = std::max(_boxMax[k], _otherMax[k]);
+		}
+	}
+
+	inline void SetEmpty(float (&_boxMin)[3], float (&_boxMax)[3])
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			_boxMin[k] = std::numeric_limits<float>::max();
+			_boxMax[k] = -std::numeric_limits<float>::max();
+		}
+	}
+
+	// Center and half extents, as the flat culling takes them
+	BoxList ToBoxList(const std::vector<BvhBox>& _boxes)
+	{
+		BoxList list;
+		list.Reserve(_boxes.size());
+		for (const BvhBox& box : _boxes)
+		{
+			list.centerX.push_back((box.boxMin[0] + box.boxMax[0]) * 0.5f);
+			list.centerY.push_back((box.boxMin[1] + box.boxMax[1]) * 0.5f);
+			list.centerZ.push_back((box.boxMin[2] + box.boxMax[2]) * 0.5f);
+			list.extentX.push_back((box.boxMax[0] - box.boxMin[0]) * 0.5f);
+			list.extentY.push_back((box.boxMax[1] - box.boxMin[1]) * 0.5f);
+			list.extentZ.push_back((box.boxMax[2] - box.boxMin[2]) * 0.5f);
+		}
+		return list;
+	}
+}
+
+void Bvh::Clear()
+{
+	m_entries.clear();
+	m_nodes.clear();
+	m_itemSlot.clear();
+	m_itemLeaf.clear();
+	m_dirty.clear();
+	m_anyDirty = false;
+	m_stats = {};
+}
+
+void Bvh::Build(const std::vector<BvhBox>& _boxes)
+{
+	m_entries.resize(_boxes.size());
+	for (uint32_t i = 0; i < _boxes.size(); i++)
+		m_entries[i] = { _boxes[i], i };
+	BuildEntries();
+}
+
+void Bvh::BuildEntries()
+{
+	size_t rebuilds = m_stats.rebuilds;
+	m_nodes.clear();
+	m_stats = {};
+	m_stats.rebuilds = rebuilds;
+	m_anyDirty = false;
+
+	m_itemSlot.resize(m_entries.size());
+	m_itemLeaf.resize(m_entries.size());
+	if (!m_entries.empty())
+	{
+		m_nodes.reserve(2 * m_entries.size() / s_leafSize + 1);
+		BuildNode(0, static_cast<uint32_t>(m_entries.size()), 0, 1);
+	}
+	for (uint32_t i = 0; i < m_entries.size(); i++)
+		m_itemSlot[m_entries[i].item] = i;
+
+	m_dirty.assign(m_nodes.size(), 0);
+	m_stats.items = m_entries.size();
+	m_stats.nodes = m_nodes.size();
+	m_stats.builtCost = m_stats.cost = ComputeCost();
+}
+
+void Bvh::FitNode(Node& _node) const
+{
+	SetEmpty(_node.boxMin, _node.boxMax);
+	for (uint32_t i = _node.first; i < _node.first + _node.count; i++)
+	{
+		const BvhBox& box = m_entries[i].box;
+		Grow(_node.boxMin, _node.boxMax, box.boxMin, box.boxMax);
+	}
+}
+
+uint32_t Bvh::BuildNode(uint32_t _first, uint32_t _count, uint32_t _parent, size_t _depth)
+{
+	uint32_t index = static_cast<uint32_t>(m_nodes.size());
+	m_nodes.emplace_back();
+	Node node = {};
+	node.first = _first;
+	node.count = _count;
+	node.parent = _parent;
+	FitNode(node);
+	m_stats.depth = std::max(m_stats.depth, _depth);
+
+	if (_count <= s_leafSize)
+	{
+		for (uint32_t i = _first; i < _first + _count; i++)
+			m_itemLeaf[m_entries[i].item] = index;
+		m_nodes[index] = node;
+		return index;
+	}
+
+	// Bins over the centroids (doubled, the halving changes nothing)
+	float centroidMin[3], centroidMax[3];
+	SetEmpty(centroidMin, centroidMax);
+	for (uint32_t i = _first; i < _first + _count; i++)
+	{
+		const BvhBox& box = m_entries[i].box;
+		for (int k = 0; k < 3; k++)
+		{
+			float centroid = box.boxMin[k] + box.boxMax[k];
+			centroidMin[k] = std::min(centroidMin[k], centroid);
+			centroidMax[k] = std::max(centroidMax[k], centroid);
+		}
+	}
+
+	int bestAxis = -1;
+	size_t bestSplit = 0;
+	float bestCost = std::numeric_limits<float>::max();
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float extent = centroidMax[axis] - centroidMin[axis];
+		if (extent <= 0.f)
+			continue;
+		float scale = s_bins / extent;
+		size_t counts[s_bins] = {};
+		float binMin[s_bins][3], binMax[s_bins][3];
+		for (size_t b = 0; b < s_bins; b++)
+			SetEmpty(binMin[b], binMax[b]);
+		for (uint32_t i = _first; i < _first + _count; i++)
+		{
+			const BvhBox& box = m_entries[i].box;
+			size_t bin = std::min(s_bins - 1, static_cast<size_t>((box.boxMin[axis] + box.boxMax[axis] - centroidMin[axis]) * scale));
+			counts[bin]++;
+			Grow(binMin[bin], binMax[bin], box.boxMin, box.boxMax);
+		}
+
+		// Right sides swept first, then each split with the left side so far
+		float rightArea[s_bins];
+		size_t rightCount[s_bins];
+		float sweepMin[3], sweepMax[3];
+		SetEmpty(sweepMin, sweepMax);
+		size_t count = 0;
+		for (size_t b = s_bins - 1; b > 0; b--)
+		{
+			Grow(sweepMin, sweepMax, binMin[b], binMax[b]);
+			count += counts[b];
+			rightArea[b] = count ? Area(sweepMin, sweepMax) : 0.f;
+			rightCount[b] = count;
+		}
+		SetEmpty(sweepMin, sweepMax);
+		count = 0;
+		for (size_t split = 1; split < s_bins; split++)
+		{
+			Grow(sweepMin, sweepMax, binMin[split - 1], binMax[split - 1]);
+			count += counts[split - 1];
+			if (count == 0 || rightCount[split] == 0)
+				continue;
+			float cost = count * Area(sweepMin, sweepMax) + rightCount[split] * rightArea[split];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = split;
+			}
+		}
+	}
+
+	uint32_t middle = _first + _count / 2;
+	if (bestAxis >= 0)
+	{
+		float scale = s_bins / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+		auto it = std::partition(m_entries.begin() + _first, m_entries.begin() + _first + _count, [&](const Entry& _entry) {
+			const BvhBox& box = _entry.box;
+			return std::min(s_bins - 1, static_cast<size_t>((box.boxMin[bestAxis] + box.boxMax[bestAxis] - centroidMin[bestAxis]) * scale)) < bestSplit;
+		});
+		middle = static_cast<uint32_t>(it - m_entries.begin());
+	}
+	// Every centroid in one spot: halves, any split is as good
+	if (middle == _first || middle == _first + _count)
+		middle = _first + _count / 2;
+
+	BuildNode(_first, middle - _first, index, _depth + 1);
+	node.right = BuildNode(middle, _first + _count - middle, index, _depth + 1);
+	m_nodes[index] = node;
+	return index;
+}
+
+void Bvh::SetBox(uint32_t _item, const BvhBox& _box)
+{
+	m_entries[m_itemSlot[_item]].box = _box;
+	m_dirty[m_itemLeaf[_item]] = 1;
+	m_anyDirty = true;
+}
+
+bool Bvh::Refit()
+{
+	if (!m_anyDirty)
+		return false;
+	m_anyDirty = false;
+
+	// Children are after their parent: one backward pass sees them first
+	for (size_t i = m_nodes.size(); i-- > 0;)
+	{
+		if (!m_dirty[i])
+			continue;
+		m_dirty[i] = 0;
+		Node& node = m_nodes[i];
+		if (node.right == 0)
+			FitNode(node);
+		else
+		{
+			const Node& left = m_nodes[i + 1];
+			const Node& right = m_nodes[node.right];
+			std::copy(std::begin(left.boxMin), std::end(left.boxMin), node.boxMin);
+			std::copy(std::begin(left.boxMax), std::end(left.boxMax), node.boxMax);
+			Grow(node.boxMin, node.boxMax, right.boxMin, right.boxMax);
+		}
+		if (i != 0)
+			m_dirty[node.parent] = 1;
+	}
+
+	m_stats.cost = ComputeCost();
+	if (m_stats.cost <= m_stats.builtCost * rebuildRatio)
+		return false;
+	m_stats.rebuilds++;
+	BuildEntries();
+	return true;
+}
+
+float Bvh::ComputeCost() const
+{
+	if (m_nodes.empty())
+		return 0.f;
+	float rootArea = Area(m_nodes[0].boxMin, m_nodes[0].boxMax);
+	if (rootArea <= 0.f)
+		return 0.f;
+	// Traversal of the inner nodes, a test per item in the leaves
+	float cost = 0.f;
+	for (const Node& node : m_nodes)
+		cost += Area(node.boxMin, node.boxMax) * (node.right == 0 ? node.count : 1.f);
+	return cost / rootArea;
+}
+
+void Bvh::Query(const Frustum& _frustum, std::vector<uint32_t>& _out)
+{
+	m_stats.lastVisitedNodes = 0;
+	if (m_nodes.empty())
+		return;
+
+	m_stack.clear();
+	m_stack.push_back({ 0, static_cast<uint8_t>(0x3F) });
+	while (!m_stack.empty())
+	{
+		auto [index, planeMask] = m_stack.back();
+		m_stack.pop_back();
+		const Node& node = m_nodes[index];
+		m_stats.lastVisitedNodes++;
+
+		FrustumTest test = _frustum.Classify(node.boxMin, node.boxMax, planeMask);
+		if (test == FrustumTest::Outside)
+			continue;
+		if (test == FrustumTest::Inside)
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; i++)
+				_out.push_back(m_entries[i].item);
+			continue;
+		}
+		if (node.right == 0)
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; i++)
+			{
+				uint8_t itemMask = planeMask;
+				const BvhBox& box = m_entries[i].box;
+				if (_frustum.Classify(box.boxMin, box.boxMax, itemMask) != FrustumTest::Outside)
+					_out.push_back(m_entries[i].item);
+			}
+			continue;
+		}
+		m_stack.push_back({ node.right, planeMask });
+		m_stack.push_back({ index + 1, planeMask });
+	}
+}
+
+BvhBenchmark Bvh::Benchmark(const Frustum& _frustum, size_t _boxes)
+{
+	BvhBenchmark result;
+	result.boxes = _boxes;
+
+	// Same spread as Frustum::Benchmark
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(-200.f, 200.f);
+	std::uniform_real_distribution<float> extent(0.1f, 2.f);
+	std::uniform_real_distribution<float> move(-0.5f, 0.5f);
+	std::vector<BvhBox> boxes(_boxes);
+	for (BvhBox& box : boxes)
+		for (int k = 0; k < 3; k++)
+		{
+			float center = position(random), half = extent(random);
+			box.boxMin[k] = center - half;
+			box.boxMax[k] = center + half;
+		}
+
+	Bvh bvh;
+	auto start = std::chrono::steady_clock::now();
+	bvh.Build(boxes);
+	auto built = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < _boxes; i++)
+	{
+		BvhBox& box = boxes[i];
+		for (int k = 0; k < 3; k++)
+		{
+			float offset = move(random);
+			box.boxMin[k] += offset;
+			box.boxMax[k] += offset;
+		}
+		bvh.SetBox(i, box);
+	}
+	auto moved = std::chrono::steady_clock::now();
+	bvh.Refit();
+	auto refitted = std::chrono::steady_clock::now();
+	std::vector<uint32_t> visible;
+	visible.reserve(_boxes);
+	bvh.Query(_frustum, visible);
+	auto queried = std::chrono::steady_clock::now();
+	BoxList list = ToBoxList(boxes);
+	std::vector<uint8_t> flat(_boxes);
+	auto flatStart = std::chrono::steady_clock::now();
+	_frustum.Cull(list, flat.data());
+	auto end = std::chrono::steady_clock::now();
+	result.mismatches = CountMismatches(_frustum, boxes, visible);
+
+	result.visible = visible.size();
+	result.visitedNodes = bvh.GetStats().lastVisitedNodes;
+	result.buildMs = std::chrono::duration<double, std::milli>(built - start).count();
+	result.refitMs = std::chrono::duration<double, std::milli>(refitted - moved).count();
+	result.queryMs = std::chrono::duration<double, std::milli>(queried - refitted).count();
+	result.flatMs = std::chrono::duration<double, std::milli>(end - flatStart).count();
+	return result;
+}
+
+size_t Bvh::CountMismatches(const Frustum& _frustum, const std::vector<BvhBox>& _boxes, const std::vector<uint32_t>& _items)
+{
+	std::vector<uint8_t> expected(_boxes.size());
+	_frustum.CullScalar(ToBoxList(_boxes), expected.data());
+	std::vector<uint32_t> found(_boxes.size());
+	size_t mismatches = 0;
+	for (uint32_t item : _items)
+		if (item < found.size())
+			found[item]++;
+		else
+			mismatches++;
+	for (size_t i = 0; i < _boxes.size(); i++)
+		mismatches += found[i] != expected[i];
+	return mismatches;
+}
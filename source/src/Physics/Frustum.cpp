@@ -0,0 +1,245 @@
+#include <Frustum.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <random>
+
+#include <immintrin.h>
+
+void BoxList::Clear()
+{
+	centerX.clear();
+	centerY.clear();
+	centerZ.clear();
+	extentX.clear();
+	extentY.clear();
+	extentZ.clear();
+}
+
+void BoxList::Reserve(size_t _count)
+{
+	centerX.reserve(_count);
+	centerY.reserve(_count);
+	centerZ.reserve(_count);
+	extentX.reserve(_count);
+	extentY.reserve(_count);
+	extentZ.reserve(_count);
+}
+
+void BoxList::Add(const BoundingVolume& _bounds)
+{
+	centerX.push_back((_bounds.boxMin[0] + _bounds.boxMax[0]) * 0.5f);
+	centerY.push_back((_bounds.boxMin[1] + _bounds.boxMax[1]) * 0.5f);
+	centerZ.push_back((_bounds.boxMin[2] + _bounds.boxMax[2]) * 0.5f);
+	extentX.push_back((_bounds.boxMax[0] - _bounds.boxMin[0]) * 0.5f);
+	extentY.push_back((_bounds.boxMax[1] - _bounds.boxMin[1]) * 0.5f);
+	extentZ.push_back((_bounds.boxMax[2] - _bounds.boxMin[2]) * 0.5f);
+}
+
+Frustum Frustum::FromViewProjection(const Matrix4x4& _viewProjection)
+{
+	// Left, right, bottom, top, near, far: row 3 plus or minus rows 0, 1, 2 (GL clip depth is -w..w)
+	Frustum frustum;
+	for (int i = 0; i < 6; i++)
+	{
+		int row = i / 2;
+		float sign = i % 2 == 0 ? 1.f : -1.f;
+		for (int j = 0; j < 4; j++)
+			frustum.planes[i][j] = _viewProjection[3][j] + sign * _viewProjection[row][j];
+		float length = std::sqrt(frustum.planes[i][0] * frustum.planes[i][0] + frustum.planes[i][1] * frustum.planes[i][1]
+			+ frustum.planes[i][2] * frustum.planes[i][2]);
+		if (length > 0.f)
+			for (int j = 0; j < 4; j++)
+				frustum.planes[i][j] /= length;
+	}
+	return frustum;
+}
+
+namespace
+{
+	// Center distance to the plane, plus the box reach along its normal
+	inline bool BoxInside(const float (&_planes)[6][4], float _cx, float _cy, float _cz, float _ex, float _ey, float _ez)
+	{
+		for (const float* plane : _planes)
+		{
+			float distance = plane[0] * _cx + plane[1] * _cy + plane[2] * _cz + plane[3];
+			float reach = std::abs(plane[0]) * _ex + std::abs(plane[1]) * _ey + std::abs(plane[2]) * _ez;
+			if (distance + reach < 0.f)
+				return false;
+		}
+		return true;
+	}
+}
+
+bool Frustum::IsVisible(const BoundingVolume& _bounds) const
+{
+	if (_bounds.IsEmpty())
+		return true;
+	return BoxInside(planes, (_bounds.boxMin[0] + _bounds.boxMax[0]) * 0.5f, (_bounds.boxMin[1] + _bounds.boxMax[1]) * 0.5f,
+		(_bounds.boxMin[2] + _bounds.boxMax[2]) * 0.5f, (_bounds.boxMax[0] - _bounds.boxMin[0]) * 0.5f,
+		(_bounds.boxMax[1] - _bounds.boxMin[1]) * 0.5f, (_bounds.boxMax[2] - _bounds.boxMin[2]) * 0.5f);
+}
+
+FrustumTest Frustum::Classify(const float (&_boxMin)[3], const float (&_boxMax)[3], uint8_t& _planeMask) const
+{
+	for (int i = 0; i < 6; i++)
+	{
+		if (!(_planeMask & (1 << i)))
+			continue;
+		const float* plane = planes[i];
+		float center = 0.f, reach = 0.f;
+		for (int k = 0; k < 3; k++)
+		{
+			center += plane[k] * (_boxMin[k] + _boxMax[k]) * 0.5f;
+			reach += std::abs(plane[k]) * (_boxMax[k] - _boxMin[k]) * 0.5f;
+		}
+		center += plane[3];
+		if (center + reach < 0.f)
+			return FrustumTest::Outside;
+		if (center - reach >= 0.f)
+			_planeMask &= ~(1 << i);
+	}
+	return _planeMask ? FrustumTest::Intersects : FrustumTest::Inside;
+}
+
+size_t Frustum::CullScalar(const BoxList& _boxes, uint8_t* _visible) const
+{
+	size_t visible = 0;
+	for (size_t i = 0; i < _boxes.Size(); i++)
+	{
+		_visible[i] = BoxInside(planes, _boxes.centerX[i], _boxes.centerY[i], _boxes.centerZ[i], _boxes.extentX[i], _boxes.extentY[i],
+			_boxes.extentZ[i]);
+		visible += _visible[i];
+	}
+	return visible;
+}
+
+size_t Frustum::Cull(const BoxList& _boxes, uint8_t* _visible) const
+{
+	size_t count = _boxes.Size();
+	size_t visible = 0;
+	size_t i = 0;
+#ifdef __AVX__
+	const size_t lanes = 8;
+	__m256 normals[6][3], absNormals[6][3], distances[6];
+	__m256 signMask = _mm256_set1_ps(-0.f);
+	for (int p = 0; p < 6; p++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			normals[p][k] = _mm256_set1_ps(planes[p][k]);
+			absNormals[p][k] = _mm256_andnot_ps(signMask, normals[p][k]);
+		}
+		distances[p] = _mm256_set1_ps(planes[p][3]);
+	}
+	for (; i + lanes <= count; i += lanes)
+	{
+		__m256 cx = _mm256_loadu_ps(&_boxes.centerX[i]), cy = _mm256_loadu_ps(&_boxes.centerY[i]), cz = _mm256_loadu_ps(&_boxes.centerZ[i]);
+		__m256 ex = _mm256_loadu_ps(&_boxes.extentX[i]), ey = _mm256_loadu_ps(&_boxes.extentY[i]), ez = _mm256_loadu_ps(&_boxes.extentZ[i]);
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			// Same order as BoxInside, both paths give the same answer on the edges
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(normals[p][0], cx), _mm256_mul_ps(normals[p][1], cy)),
+				_mm256_mul_ps(normals[p][2], cz)), distances[p]);
+			__m256 reach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(absNormals[p][0], ex), _mm256_mul_ps(absNormals[p][1], ey)),
+				_mm256_mul_ps(absNormals[p][2], ez));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+		int mask = _mm256_movemask_ps(inside);
+		for (size_t lane = 0; lane < lanes; lane++)
+		{
+			_visible[i + lane] = (mask >> lane) & 1;
+			visible += _visible[i + lane];
+		}
+	}
+#else
+	const size_t lanes = 4;
+	__m128 normals[6][3], absNormals[6][3], distances[6];
+	__m128 signMask = _mm_set1_ps(-0.f);
+	for (int p = 0; p < 6; p++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			normals[p][k] = _mm_set1_ps(planes[p][k]);
+			absNormals[p][k] = _mm_andnot_ps(signMask, normals[p][k]);
+		}
+		distances[p] = _mm_set1_ps(planes[p][3]);
+	}
+	for (; i + lanes <= count; i += lanes)
+	{
+		__m128 cx = _mm_loadu_ps(&_boxes.centerX[i]), cy = _mm_loadu_ps(&_boxes.centerY[i]), cz = _mm_loadu_ps(&_boxes.centerZ[i]);
+		__m128 ex = _mm_loadu_ps(&_boxes.extentX[i]), ey = _mm_loadu_ps(&_boxes.extentY[i]), ez = _mm_loadu_ps(&_boxes.extentZ[i]);
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			// Same order as BoxInside, both paths give the same answer on the edges
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(normals[p][0], cx), _mm_mul_ps(normals[p][1], cy)),
+				_mm_mul_ps(normals[p][2], cz)), distances[p]);
+			__m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absNormals[p][0], ex), _mm_mul_ps(absNormals[p][1], ey)),
+				_mm_mul_ps(absNormals[p][2], ez));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+		}
+		int mask = _mm_movemask_ps(inside);
+		for (size_t lane = 0; lane < lanes; lane++)
+		{
+			_visible[i + lane] = (mask >> lane) & 1;
+			visible += _visible[i + lane];
+		}
+	}
+#endif
+	// Tail, fewer than a register
+	for (; i < count; i++)
+	{
+		_visible[i] = BoxInside(planes, _boxes.centerX[i], _boxes.centerY[i], _boxes.centerZ[i], _boxes.extentX[i], _boxes.extentY[i],
+			_boxes.extentZ[i]);
+		visible += _visible[i];
+	}
+	return visible;
+}
+
+const char* Frustum::GetSimdName()
+{
+#ifdef __AVX__
+	return "AVX, 8 boxes";
+#else
+	return "SSE, 4 boxes";
+#endif
+}
+
+FrustumBenchmark Frustum::Benchmark(size_t _boxes) const
+{
+	FrustumBenchmark result;
+	result.boxes = _boxes;
+
+	// Around the origin, a fraction of them in view
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(-200.f, 200.f);
+	std::uniform_real_distribution<float> extent(0.1f, 2.f);
+	BoxList boxes;
+	boxes.Reserve(_boxes);
+	for (size_t i = 0; i < _boxes; i++)
+	{
+		boxes.centerX.push_back(position(random));
+		boxes.centerY.push_back(position(random));
+		boxes.centerZ.push_back(position(random));
+		boxes.extentX.push_back(extent(random));
+		boxes.extentY.push_back(extent(random));
+		boxes.extentZ.push_back(extent(random));
+	}
+
+	std::vector<uint8_t> scalar(_boxes), simd(_boxes);
+	auto start = std::chrono::steady_clock::now();
+	size_t scalarVisible = CullScalar(boxes, scalar.data());
+	auto middle = std::chrono::steady_clock::now();
+	result.visible = Cull(boxes, simd.data());
+	auto end = std::chrono::steady_clock::now();
+	result.scalarMs = std::chrono::duration<double, std::milli>(middle - start).count();
+	result.simdMs = std::chrono::duration<double, std::milli>(end - middle).count();
+
+	for (size_t i = 0; i < _boxes; i++)
+		result.mismatches += scalar[i] != simd[i];
+	if (scalarVisible != result.visible && result.mismatches == 0)
+		result.mismatches = 1;
+	return result;
+}
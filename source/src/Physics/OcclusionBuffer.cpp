@@ -0,0 +1,277 @@
+#include <OcclusionBuffer.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <limits>
+
+#include <immintrin.h>
+
+#include <Log.hpp>
+#include <MappedFile.hpp>
+#include <ThreadPool.hpp>
+
+namespace
+{
+	// clip = column0 * x + column1 * y + column2 * z + column3
+	struct ClipTransform
+	{
+		__m128 columns[4];
+
+		ClipTransform(const Matrix4x4& _matrix)
+		{
+			for (int j = 0; j < 4; j++)
+				columns[j] = _mm_setr_ps(_matrix[0][j], _matrix[1][j], _matrix[2][j], _matrix[3][j]);
+		}
+
+		inline void Apply(float _x, float _y, float _z, float* _clip) const
+		{
+			__m128 clip = _mm_add_ps(_mm_add_ps(_mm_mul_ps(columns[0], _mm_set1_ps(_x)), _mm_mul_ps(columns[1], _mm_set1_ps(_y))),
+				_mm_add_ps(_mm_mul_ps(columns[2], _mm_set1_ps(_z)), columns[3]));
+			_mm_storeu_ps(_clip, clip);
+		}
+	};
+
+	// In front of the near plane (GL clip depth is -w..w)
+	inline bool InFront(const float* _clip)
+	{
+		return _clip[3] > 0.f && _clip[2] + _clip[3] >= 0.f;
+	}
+
+	// Pixels, row 0 at the bottom, and window depth
+	inline void ToScreen(const float* _clip, float& _x, float& _y, float& _depth)
+	{
+		float inverseW = 1.f / _clip[3];
+		_x = (_clip[0] * inverseW * 0.5f + 0.5f) * OcclusionBuffer::s_width;
+		_y = (_clip[1] * inverseW * 0.5f + 0.5f) * OcclusionBuffer::s_height;
+		_depth = _clip[2] * inverseW * 0.5f + 0.5f;
+	}
+
+	// Far out of the screen (w near 0) would overflow the pixel ints
+	inline float ClampPixel(float _value, int _size)
+	{
+		return std::clamp(_value, -1.f, static_cast<float>(_size + 1));
+	}
+}
+
+void OcclusionBuffer::Begin(const Matrix4x4& _viewProjection)
+{
+	m_viewProjection = _viewProjection;
+	std::fill(m_depth.begin(), m_depth.end(), std::numeric_limits<float>::infinity());
+	m_triangles.clear();
+	for (std::vector<uint32_t>& band : m_bands)
+		band.clear();
+	m_stats = {};
+}
+
+void OcclusionBuffer::AddOccluder(const OccluderMesh& _mesh, const Matrix4x4& _model)
+{
+	if (_mesh.IsEmpty())
+		return;
+	m_stats.occluders++;
+
+	ClipTransform transform(m_viewProjection * _model);
+	size_t vertexCount = _mesh.positions.size() / 3;
+	m_clip.resize(vertexCount * 4);
+	for (size_t v = 0; v < vertexCount; v++)
+		transform.Apply(_mesh.positions[v * 3], _mesh.positions[v * 3 + 1], _mesh.positions[v * 3 + 2], &m_clip[v * 4]);
+
+	for (size_t i = 0; i + 2 < _mesh.indices.size(); i += 3)
+	{
+		if (_mesh.indices[i] >= vertexCount || _mesh.indices[i + 1] >= vertexCount || _mesh.indices[i + 2] >= vertexCount)
+			continue;
+		const float* clip[3] = { &m_clip[_mesh.indices[i] * 4], &m_clip[_mesh.indices[i + 1] * 4], &m_clip[_mesh.indices[i + 2] * 4] };
+		if (!InFront(clip[0]) || !InFront(clip[1]) || !InFront(clip[2]))
+			continue;
+
+		Triangle triangle;
+		float depth[3];
+		for (int k = 0; k < 3; k++)
+			ToScreen(clip[k], triangle.x[k], triangle.y[k], depth[k]);
+		float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) - (triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+		if (area == 0.f || !std::isfinite(area))
+			continue;
+		// Both windings are occluders, clockwise ones are flipped
+		if (area < 0.f)
+		{
+			std::swap(triangle.x[1], triangle.x[2]);
+			std::swap(triangle.y[1], triangle.y[2]);
+			std::swap(depth[1], depth[2]);
+			area = -area;
+		}
+
+		// Pixel centers at + 0.5
+		float minX = std::min({ triangle.x[0], triangle.x[1], triangle.x[2] }), maxX = std::max({ triangle.x[0], triangle.x[1], triangle.x[2] });
+		float minY = std::min({ triangle.y[0], triangle.y[1], triangle.y[2] }), maxY = std::max({ triangle.y[0], triangle.y[1], triangle.y[2] });
+		triangle.minX = std::max(0, static_cast<int>(std::ceil(ClampPixel(minX, s_width) - 0.5f)));
+		triangle.maxX = std::min(s_width - 1, static_cast<int>(std::floor(ClampPixel(maxX, s_width) - 0.5f)));
+		triangle.minY = std::max(0, static_cast<int>(std::ceil(ClampPixel(minY, s_height) - 0.5f)));
+		triangle.maxY = std::min(s_height - 1, static_cast<int>(std::floor(ClampPixel(maxY, s_height) - 0.5f)));
+		if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+			continue;
+
+		float dx1 = triangle.x[1] - triangle.x[0], dy1 = triangle.y[1] - triangle.y[0], dz1 = depth[1] - depth[0];
+		float dx2 = triangle.x[2] - triangle.x[0], dy2 = triangle.y[2] - triangle.y[0], dz2 = depth[2] - depth[0];
+		triangle.depthX = (dz1 * dy2 - dz2 * dy1) / area;
+		triangle.depthY = (dx1 * dz2 - dx2 * dz1) / area;
+		triangle.depthC = depth[0] - triangle.depthX * triangle.x[0] - triangle.depthY * triangle.y[0];
+
+		uint32_t index = static_cast<uint32_t>(m_triangles.size());
+		m_triangles.push_back(triangle);
+		for (int band = triangle.minY / s_bandRows; band <= triangle.maxY / s_bandRows; band++)
+			m_bands[band].push_back(index);
+		m_stats.triangles++;
+	}
+}
+
+void OcclusionBuffer::Rasterize(ThreadPool* _pool)
+{
+	auto start = std::chrono::steady_clock::now();
+	if (_pool)
+		_pool->ParallelFor(s_bands, [this](size_t _band) { RasterizeBand(static_cast<int>(_band)); }, "Occlusion raster", true);
+	else
+		for (int band = 0; band < s_bands; band++)
+			RasterizeBand(band);
+	m_stats.rasterMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void OcclusionBuffer::RasterizeBand(int _band)
+{
+	const int bandMinY = _band * s_bandRows, bandMaxY = bandMinY + s_bandRows - 1;
+	const __m128 laneOffsets = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (uint32_t index : m_bands[_band])
+	{
+		const Triangle& triangle = m_triangles[index];
+		// Edge a to b: (xb - xa) * (py - ya) - (yb - ya) * (px - xa), positive inside a counterclockwise triangle
+		__m128 edgeX[3];
+		float edgeY[3], edgeC[3];
+		for (int k = 0; k < 3; k++)
+		{
+			int a = k, b = (k + 1) % 3;
+			edgeX[k] = _mm_set1_ps(triangle.y[a] - triangle.y[b]);
+			edgeY[k] = triangle.x[b] - triangle.x[a];
+			edgeC[k] = (triangle.y[b] - triangle.y[a]) * triangle.x[a] - (triangle.x[b] - triangle.x[a]) * triangle.y[a];
+		}
+		__m128 depthX = _mm_set1_ps(triangle.depthX);
+		__m128 minX = _mm_set1_ps(static_cast<float>(triangle.minX)), maxX = _mm_set1_ps(static_cast<float>(triangle.maxX));
+
+		int startX = triangle.minX & ~3;
+		for (int y = std::max(triangle.minY, bandMinY); y <= std::min(triangle.maxY, bandMaxY); y++)
+		{
+			float centerY = y + 0.5f;
+			__m128 rowEdge[3];
+			for (int k = 0; k < 3; k++)
+				rowEdge[k] = _mm_set1_ps(edgeY[k] * centerY + edgeC[k]);
+			__m128 rowDepth = _mm_set1_ps(triangle.depthY * centerY + triangle.depthC);
+			float* row = &m_depth[static_cast<size_t>(y) * s_width];
+
+			// s_width is a multiple of 4: a group never crosses the row end
+			for (int x = startX; x <= triangle.maxX; x += 4)
+			{
+				__m128 pixel = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+				__m128 center = _mm_add_ps(pixel, half);
+				__m128 inside = _mm_and_ps(_mm_cmpge_ps(pixel, minX), _mm_cmple_ps(pixel, maxX));
+				for (int k = 0; k < 3; k++)
+					inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX[k], center), rowEdge[k]), zero));
+				if (!_mm_movemask_ps(inside))
+					continue;
+				__m128 depth = _mm_add_ps(_mm_mul_ps(depthX, center), rowDepth);
+				__m128 stored = _mm_loadu_ps(row + x);
+				__m128 nearest = _mm_min_ps(stored, depth);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, stored)));
+			}
+		}
+	}
+}
+
+bool OcclusionBuffer::IsOccluded(const BoundingVolume& _bounds) const
+{
+	if (_bounds.IsEmpty())
+		return false;
+
+	ClipTransform transform(m_viewProjection);
+	float minX = std::numeric_limits<float>::max(), minY = minX, nearest = minX;
+	float maxX = std::numeric_limits<float>::lowest(), maxY = maxX;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		float clip[4];
+		transform.Apply(corner & 1 ? _bounds.boxMax[0] : _bounds.boxMin[0], corner & 2 ? _bounds.boxMax[1] : _bounds.boxMin[1],
+			corner & 4 ? _bounds.boxMax[2] : _bounds.boxMin[2], clip);
+		if (!InFront(clip))
+			return false;
+		float x, y, depth;
+		ToScreen(clip, x, y, depth);
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		// Window depth follows the view depth: the nearest point of the box is a corner
+		nearest = std::min(nearest, depth);
+	}
+
+	// Every pixel the box touches, not only the ones with their center inside
+	int pixelMinX = std::max(0, static_cast<int>(std::floor(ClampPixel(minX, s_width))));
+	int pixelMaxX = std::min(s_width - 1, static_cast<int>(std::floor(ClampPixel(maxX, s_width))));
+	int pixelMinY = std::max(0, static_cast<int>(std::floor(ClampPixel(minY, s_height))));
+	int pixelMaxY = std::min(s_height - 1, static_cast<int>(std::floor(ClampPixel(maxY, s_height))));
+	if (pixelMinX > pixelMaxX || pixelMinY > pixelMaxY)
+		return false;
+
+	const __m128 laneOffsets = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+	__m128 boxDepth = _mm_set1_ps(nearest);
+	__m128 first = _mm_set1_ps(static_cast<float>(pixelMinX)), last = _mm_set1_ps(static_cast<float>(pixelMaxX));
+	for (int y = pixelMinY; y <= pixelMaxY; y++)
+	{
+		const float* row = &m_depth[static_cast<size_t>(y) * s_width];
+		for (int x = pixelMinX & ~3; x <= pixelMaxX; x += 4)
+		{
+			__m128 pixel = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+			__m128 covered = _mm_and_ps(_mm_cmpge_ps(pixel, first), _mm_cmple_ps(pixel, last));
+			// Not hidden at a pixel where the occluders are not nearer than the box
+			if (_mm_movemask_ps(_mm_and_ps(covered, _mm_cmpge_ps(_mm_loadu_ps(row + x), boxDepth))))
+				return false;
+		}
+	}
+	return true;
+}
+
+uint64_t OcclusionBuffer::GetDepthHash() const {
+	return MappedFile::Hash(m_depth.data(), m_depth.size() * sizeof(float));
+}
+
+bool OcclusionBuffer::WriteDepthImage(const std::filesystem::path& _path) const
+{
+	std::ofstream output(_path, std::ios::binary | std::ios::trunc);
+	if (!output.is_open())
+	{
+		DEBUG_WARNING("Could not open %s", _path.string().c_str());
+		return false;
+	}
+
+	// Window depth crowds near 1, the drawn range is stretched over the grays
+	float nearest = 1.f, farthest = 0.f;
+	for (float depth : m_depth)
+		if (std::isfinite(depth))
+		{
+			nearest = std::min(nearest, depth);
+			farthest = std::max(farthest, depth);
+		}
+	float range = farthest > nearest ? farthest - nearest : 1.f;
+
+	output << "P5\n" << s_width << " " << s_height << "\n255\n";
+	std::vector<unsigned char> row(s_width);
+	for (int y = s_height - 1; y >= 0; y--)
+	{
+		for (int x = 0; x < s_width; x++)
+		{
+			float depth = m_depth[static_cast<size_t>(y) * s_width + x];
+			row[x] = std::isfinite(depth) ? static_cast<unsigned char>(std::clamp((depth - nearest) / range, 0.f, 1.f) * 254.f) : 255;
+		}
+		output.write(reinterpret_cast<const char*>(row.data()), row.size());
+	}
+	return output.good();
+}
@@ -2,9 +2,8 @@
 
 Material::Material() 
 {
-	m_isRead = true;
-	m_isLoaded = true;
 	*this = material::none;
+	SetState(ResourceState::Ready);
 };
 
 void Material::InitShader(Shader& _lightShader)
@@ -0,0 +1,272 @@
+#include <MeshFile.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include <Log.hpp>
+#include <MappedFile.hpp>
+#include <Mesh.hpp>
+
+static_assert(sizeof(MeshFileHeader) == 96, "MeshFileHeader is stored as is");
+static_assert(sizeof(MeshFileAttribute) == 20, "MeshFileAttribute is stored as is");
+static_assert(sizeof(MeshFileSubmesh) == 80, "MeshFileSubmesh is stored as is");
+static_assert(sizeof(MeshFileLod) == 12, "MeshFileLod is stored as is");
+
+static const char s_magic[4] = { 'M', 'E', 'S', 'H' };
+
+static uint64_t Align16(uint64_t _offset) {
+	return (_offset + 15) & ~static_cast<uint64_t>(15);
+}
+
+// [_offset, _offset + _bytes) within _size, without overflowing
+static bool InRange(uint64_t _offset, uint64_t _bytes, uint64_t _size) {
+	return _offset <= _size && _bytes <= _size - _offset;
+}
+
+// Bytes of one component of an attribute, 0 for a type the layouts do not use
+static uint32_t ComponentBytes(uint32_t _type)
+{
+	switch (_type)
+	{
+	case GL_FLOAT:			return sizeof(float);
+	case GL_HALF_FLOAT:
+	case GL_SHORT:
+	case GL_UNSIGNED_SHORT:	return sizeof(uint16_t);
+	case GL_BYTE:
+	case GL_UNSIGNED_BYTE:	return sizeof(uint8_t);
+	default:				return 0;
+	}
+}
+
+// Every index names a vertex of the submesh, the GPU and the occlusion buffer read them unchecked
+template<typename T>
+static bool IndicesInRange(const std::vector<unsigned char>& _indexData, uint32_t _vertexCount)
+{
+	const T* indices = reinterpret_cast<const T*>(_indexData.data());
+	return std::all_of(indices, indices + _indexData.size() / sizeof(T), [_vertexCount](T _index) { return _index < _vertexCount; });
+}
+
+bool MeshFile::Write(const std::filesystem::path& _path, const std::vector<Mesh*>& _meshes, uint32_t _flags, uint64_t _sourceHash)
+{
+	if (_meshes.empty())
+		return false;
+	const VertexLayout& layout = _meshes[0]->GetLayout();
+	for (const Mesh* mesh : _meshes)
+		if (mesh->GetVertexData().empty() || mesh->GetIndexData().empty() || mesh->GetLayout() != layout)
+			return false;
+
+	MeshFileHeader header = {};
+	std::memcpy(header.magic, s_magic, sizeof(s_magic));
+	header.version = s_version;
+	header.flags = _flags;
+	header.attributeCount = static_cast<uint32_t>(layout.attributes.size());
+	header.submeshCount = static_cast<uint32_t>(_meshes.size());
+	header.vertexStride = layout.stride;
+	header.sourceHash = _sourceHash;
+
+	std::vector<MeshFileSubmesh> submeshes;
+	std::vector<MeshFileLod> lods;
+	for (size_t i = 0; i < _meshes.size(); i++)
+	{
+		const Mesh& mesh = *_meshes[i];
+		MeshFileSubmesh submesh = {};
+		submesh.vertexOffset = header.vertexBlobBytes;
+		submesh.indexOffset = header.indexBlobBytes;
+		submesh.vertexCount = static_cast<uint32_t>(mesh.GetVertexCount());
+		submesh.indexCount = static_cast<uint32_t>(mesh.GetIndexData().size() / mesh.GetIndexSize());
+		submesh.indexSize = static_cast<uint32_t>(mesh.GetIndexSize());
+		submesh.firstLod = static_cast<uint32_t>(lods.size());
+		submesh.lodCount = static_cast<uint32_t>(mesh.GetLods().size());
+		const BoundingVolume& bounds = mesh.GetBounds();
+		for (int k = 0; k < 3; k++)
+		{
+			submesh.boundsMin[k] = bounds.boxMin[k];
+			submesh.boundsMax[k] = bounds.boxMax[k];
+			submesh.sphereCenter[k] = bounds.center[k];
+			header.boundsMin[k] = i == 0 ? submesh.boundsMin[k] : std::min(header.boundsMin[k], submesh.boundsMin[k]);
+			header.boundsMax[k] = i == 0 ? submesh.boundsMax[k] : std::max(header.boundsMax[k], submesh.boundsMax[k]);
+		}
+		submesh.sphereRadius = bounds.radius;
+		for (const MeshLod& lod : mesh.GetLods())
+			lods.push_back({ static_cast<uint32_t>(lod.indexOffset), static_cast<uint32_t>(lod.indexCount), lod.error });
+
+		submeshes.push_back(submesh);
+		header.vertexBlobBytes += mesh.GetVertexData().size();
+		// Each submesh starts 4 bytes aligned, after 16-bit ones
+		header.indexBlobBytes += (mesh.GetIndexData().size() + 3) & ~static_cast<uint64_t>(3);
+	}
+	header.lodCount = static_cast<uint32_t>(lods.size());
+
+	uint64_t tablesEnd = sizeof(MeshFileHeader) + header.attributeCount * sizeof(MeshFileAttribute)
+		+ header.submeshCount * sizeof(MeshFileSubmesh) + header.lodCount * sizeof(MeshFileLod);
+	header.vertexBlobOffset = Align16(tablesEnd);
+	header.indexBlobOffset = Align16(header.vertexBlobOffset + header.vertexBlobBytes);
+
+	std::filesystem::path tmpPath = _path;
+	tmpPath += ".tmp";
+	{
+		std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+		if (!out)
+			return false;
+		const char padding[16] = {};
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		for (const VertexAttribute& attribute : layout.attributes)
+		{
+			MeshFileAttribute stored = { attribute.location, attribute.components, attribute.type, attribute.normalized, attribute.offset };
+			out.write(reinterpret_cast<const char*>(&stored), sizeof(stored));
+		}
+		out.write(reinterpret_cast<const char*>(submeshes.data()), submeshes.size() * sizeof(MeshFileSubmesh));
+		out.write(reinterpret_cast<const char*>(lods.data()), lods.size() * sizeof(MeshFileLod));
+
+		out.write(padding, header.vertexBlobOffset - tablesEnd);
+		for (const Mesh* mesh : _meshes)
+			out.write(reinterpret_cast<const char*>(mesh->GetVertexData().data()), mesh->GetVertexData().size());
+		out.write(padding, header.indexBlobOffset - header.vertexBlobOffset - header.vertexBlobBytes);
+		for (const Mesh* mesh : _meshes)
+		{
+			out.write(reinterpret_cast<const char*>(mesh->GetIndexData().data()), mesh->GetIndexData().size());
+			out.write(padding, ((mesh->GetIndexData().size() + 3) & ~static_cast<size_t>(3)) - mesh->GetIndexData().size());
+		}
+		if (!out)
+			return false;
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tmpPath, _path, error);
+	if (error)
+	{
+		std::filesystem::remove(tmpPath, error);
+		return false;
+	}
+	return true;
+}
+
+size_t MeshFile::Read(const std::filesystem::path& _path, std::vector<Mesh*>& _out, uint32_t _flags)
+{
+	MappedFile file(_path);
+	if (!file.IsOpen() || file.Size() < sizeof(MeshFileHeader))
+		return 0;
+	const char* data = file.Data();
+	uint64_t size = file.Size();
+
+	// Tables are copied out: nothing after the header is aligned for them
+	MeshFileHeader header;
+	std::memcpy(&header, data, sizeof(header));
+	if (std::memcmp(header.magic, s_magic, sizeof(s_magic)) != 0 || header.version != s_version || header.flags != _flags
+		|| header.vertexStride == 0)
+		return 0;
+
+	uint64_t attributesOffset = sizeof(MeshFileHeader);
+	uint64_t submeshesOffset = attributesOffset + static_cast<uint64_t>(header.attributeCount) * sizeof(MeshFileAttribute);
+	uint64_t lodsOffset = submeshesOffset + static_cast<uint64_t>(header.submeshCount) * sizeof(MeshFileSubmesh);
+	uint64_t tablesEnd = lodsOffset + static_cast<uint64_t>(header.lodCount) * sizeof(MeshFileLod);
+	if (tablesEnd > size || !InRange(header.vertexBlobOffset, header.vertexBlobBytes, size)
+		|| !InRange(header.indexBlobOffset, header.indexBlobBytes, size))
+		return 0;
+
+	VertexLayout layout;
+	layout.stride = header.vertexStride;
+	layout.attributes.resize(header.attributeCount);
+	for (uint32_t i = 0; i < header.attributeCount; i++)
+	{
+		MeshFileAttribute stored;
+		std::memcpy(&stored, data + attributesOffset + i * sizeof(MeshFileAttribute), sizeof(stored));
+		// Inside the vertex, else the GPU fetches past the buffer
+		uint32_t componentBytes = ComponentBytes(stored.type);
+		if (componentBytes == 0 || stored.components == 0 || stored.components > 4
+			|| !InRange(stored.offset, static_cast<uint64_t>(stored.components) * componentBytes, header.vertexStride))
+			return 0;
+		layout.attributes[i] = { stored.location, stored.components, stored.type, stored.normalized, stored.offset };
+	}
+
+	std::vector<MeshFileLod> lods(header.lodCount);
+	if (header.lodCount)
+		std::memcpy(lods.data(), data + lodsOffset, lods.size() * sizeof(MeshFileLod));
+
+	std::vector<Mesh*> read;
+	for (uint32_t i = 0; i < header.submeshCount; i++)
+	{
+		MeshFileSubmesh submesh;
+		std::memcpy(&submesh, data + submeshesOffset + i * sizeof(MeshFileSubmesh), sizeof(submesh));
+		uint64_t vertexBytes = static_cast<uint64_t>(submesh.vertexCount) * header.vertexStride;
+		uint64_t indexBytes = static_cast<uint64_t>(submesh.indexCount) * submesh.indexSize;
+		// No vertex: the arena has no range to give, the upload would write at a garbage offset
+		bool valid = submesh.vertexCount != 0 && submesh.indexCount != 0
+			&& (submesh.indexSize == sizeof(uint16_t) || submesh.indexSize == sizeof(uint32_t))
+			&& InRange(submesh.vertexOffset, vertexBytes, header.vertexBlobBytes) && InRange(submesh.indexOffset, indexBytes, header.indexBlobBytes)
+			&& InRange(submesh.firstLod, submesh.lodCount, header.lodCount);
+
+		std::vector<MeshLod> meshLods;
+		for (uint32_t l = 0; valid && l < submesh.lodCount; l++)
+		{
+			const MeshFileLod& lod = lods[submesh.firstLod + l];
+			valid = InRange(lod.indexOffset, lod.indexCount, submesh.indexCount);
+			meshLods.push_back({ lod.indexOffset, lod.indexCount, lod.error });
+		}
+		if (!valid)
+		{
+			for (Mesh* mesh : read)
+				delete mesh;
+			return 0;
+		}
+
+		// The blobs are what glBufferData takes, a plain copy each
+		std::vector<unsigned char> vertexData(vertexBytes);
+		std::memcpy(vertexData.data(), data + header.vertexBlobOffset + submesh.vertexOffset, vertexBytes);
+		std::vector<unsigned char> indexData(indexBytes);
+		std::memcpy(indexData.data(), data + header.indexBlobOffset + submesh.indexOffset, indexBytes);
+		if (submesh.indexSize == sizeof(uint16_t) ? !IndicesInRange<uint16_t>(indexData, submesh.vertexCount)
+			: !IndicesInRange<uint32_t>(indexData, submesh.vertexCount))
+		{
+			for (Mesh* mesh : read)
+				delete mesh;
+			return 0;
+		}
+
+		BoundingVolume bounds;
+		bounds.boxMin = Vectorf3(submesh.boundsMin[0], submesh.boundsMin[1], submesh.boundsMin[2]);
+		bounds.boxMax = Vectorf3(submesh.boundsMax[0], submesh.boundsMax[1], submesh.boundsMax[2]);
+		bounds.center = Vectorf3(submesh.sphereCenter[0], submesh.sphereCenter[1], submesh.sphereCenter[2]);
+		bounds.radius = submesh.sphereRadius;
+		read.push_back(new Mesh(layout, std::move(vertexData), submesh.vertexCount, std::move(indexData),
+			submesh.indexSize == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, std::move(meshLods), bounds));
+	}
+
+	_out.insert(_out.end(), read.begin(), read.end());
+	return static_cast<size_t>(size);
+}
+
+uint64_t MeshFile::ReadSourceHash(const std::filesystem::path& _path)
+{
+	std::ifstream in(_path, std::ios::binary);
+	MeshFileHeader header;
+	if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return 0;
+	if (std::memcmp(header.magic, s_magic, sizeof(s_magic)) != 0 || header.version != s_version)
+		return 0;
+	return header.sourceHash;
+}
+
+bool MeshFile::ReadCounts(const std::filesystem::path& _path, uint32_t _flags, uint64_t& _vertexCount, uint64_t& _indexCount)
+{
+	std::ifstream in(_path, std::ios::binary);
+	MeshFileHeader header;
+	if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return false;
+	if (std::memcmp(header.magic, s_magic, sizeof(s_magic)) != 0 || header.version != s_version || header.flags != _flags)
+		return false;
+
+	in.seekg(sizeof(MeshFileHeader) + static_cast<uint64_t>(header.attributeCount) * sizeof(MeshFileAttribute));
+	_vertexCount = 0;
+	_indexCount = 0;
+	for (uint32_t i = 0; i < header.submeshCount; i++)
+	{
+		MeshFileSubmesh submesh;
+		if (!in.read(reinterpret_cast<char*>(&submesh), sizeof(submesh)))
+			return false;
+		_vertexCount += submesh.vertexCount;
+		_indexCount += submesh.indexCount;
+	}
+	return true;
+}
@@ -1,172 +1,447 @@
 #include <Model.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
 #include <Scene.hpp>
 #include <Graph.hpp>
+#include <DrawBatcher.hpp>
+#include <MappedFile.hpp>
+#include <MeshFile.hpp>
+#include <ResourcesManager.hpp>
+
+static std::atomic<unsigned int> s_ModelNumber = 0;
+static std::mutex s_VertexFormatMtx;
+static std::unordered_map<std::string, VertexFormat> s_VertexFormats;
+static std::mutex s_RetentionMtx;
+static std::unordered_map<std::string, GeometryRetention> s_Retentions;
+static std::mutex s_OccluderMtx;
+static std::unordered_set<std::string> s_Occluders;
+
+// What the cooked meshes went through, a .mesh with other flags is cooked again
+static uint32_t GetCookFlags(VertexFormat _format)
+{
+	return (ResourcesManager::generateLods ? static_cast<uint32_t>(MeshFile::LodsGenerated) : 0u)
+		| (ResourcesManager::optimizeMeshes ? static_cast<uint32_t>(MeshFile::IndexOrderOptimized) : 0u)
+		| (_format == VertexFormat::Compact16 ? static_cast<uint32_t>(MeshFile::CompactVertices) : 0u);
+}
 
-static unsigned int s_ModelNumber = 0;
+Model::~Model() {
+	ResourcesManager::ReleaseContent(this);
+}
+
+Model::SharedMeshes::~SharedMeshes()
+{
+	for (Mesh* mesh : meshes)
+	{
+		mesh->Unload();
+		delete mesh;
+	}
+}
 
 void Model::ResourceFileRead(const std::string _name)
 {
 	m_resourceId = s_ModelNumber++;
-	std::ifstream file;
-	std::filesystem::path path = "assets/meshes/";
-	path += _name + std::string(".obj");
-	file.open(path);
+	m_vertexFormat = GetVertexFormat(_name);
+	m_name = _name;
+	m_retention = GetGeometryRetention(_name);
+	std::filesystem::path path = GetSourceFile(_name);
 	// If we want to have the full path
 	//m_resourcePath = path.generic_string();
-	if (file.bad())
+	if (path.extension() == ".mesh" && IsCookStale(path, _name))
 	{
-		DEBUG_ERROR("Model File %s is BAD", _name.c_str());
-		file.close();
-		return;
+		DEBUG_WARNING("Model File %s: %s was cooked from another .obj, reading the .obj", _name.c_str(), path.generic_string().c_str());
+		path = GetObjFile(_name);
 	}
-	if (file.fail())
+	if (ResourcesManager::shareDuplicates && ReadShared(path, _name))
 	{
-		DEBUG_WARNING("Model File %s opening has FAILED", _name.c_str());
-		file.close();
+		if (IsOccluder(_name))
+			BuildOccluder();
+		SetState(ResourceState::Decoded);
 		return;
 	}
-	if (file.is_open())
+
+	bool read = false;
+	if (path.extension() == ".mesh")
+	{
+		read = ReadCooked(path, _name);
+		if (!read)
+		{
+			DEBUG_WARNING("Model File %s: %s is corrupted or cooked with other settings, reading the .obj", _name.c_str(), path.generic_string().c_str());
+			path = GetObjFile(_name);
+		}
+	}
+
+	if (!read)
 	{
-		Log::SuccessColor();
-		DEBUG_LOG("Model File %s has been opened", _name.c_str());
-		Log::ResetColor();
+		double objSeconds = ReadObj(path, _name);
+		if (objSeconds < 0.0)
+		{
+			DEBUG_WARNING("Model File %s opening has FAILED", _name.c_str());
+			SetState(ResourceState::Failed);
+			return;
+		}
 
-		// Clear in case of double load
-		m_tmpVertices.clear();
-		// Load .obj
-		std::string line;
-		unsigned int vIdx = 0;
-		unsigned int vtIdx = 0;
-		unsigned int vnIdx = 0;
-		unsigned int faceIdx = 0;
+		if (ResourcesManager::useCookedMeshes)
+			Cook(_name, objSeconds);
+	}
 
-		while (std::getline(file, line))
+	// From now on the models of the same content may take them
+	{
+		std::lock_guard<std::mutex> lock(m_meshMtx);
+		m_shared = std::make_shared<SharedMeshes>();
+		m_shared->meshes = meshes;
+		m_shared->owner = _name;
+		std::error_code error;
+		m_shared->objBytes = std::filesystem::file_size(GetObjFile(_name), error);
+		if (error)
+			m_shared->objBytes = 0;
+		for (const Mesh* mesh : meshes)
 		{
-			if (line.empty())
-				continue;
-			float x, y, z;
-			// Process each line
-			std::istringstream iss(line);
-			std::string type;
-			iss >> type;
-			if (type == "#")
-				continue;
-			if (type[0] == 'v')
-			{
-				iss >> x >> y >> z;
-				if (type == "v") // Vertex position
-				{
-					if (vIdx < m_tmpVertices.size())
-						m_tmpVertices[vIdx].Position = Vectorf3{ x, y, z };
-					else
-						m_tmpVertices.push_back({ Vectorf3(x, y,z) });
-					vIdx++;
-				}
-				else if (type[1] == 't') // Texture position
-				{
-					if (vtIdx < m_tmpVertices.size())
-						m_tmpVertices[vtIdx].Uv = Vectorf2(x, y);
-					else
-						m_tmpVertices.push_back({ {}, Vectorf2(x, y) });
-					vtIdx++;
-				}
-				else if (type[1] == 'n') // Normal position
-				{
-					if (vnIdx < m_tmpVertices.size())
-						m_tmpVertices[vnIdx].Normal = Vectorf3(x, y, z);
-					else
-						m_tmpVertices.push_back({ {},{}, Vectorf3(x, y, z) });
-					vnIdx++;
-				}
-			}
-			else if (type == "g"
-				&& line.find("default") != -1
-				&& !m_tmpVertices.empty()) // Group
-			{
-				m_meshMtx.lock();
-				Mesh* next_mesh = new Mesh(m_tmpVertices, m_tmpIdxPositions, m_tmpIdxUvs, m_tmpIdxNormals);
-				next_mesh->SetIndices(m_indices);
-				meshes.push_back(next_mesh);
-				m_meshMtx.unlock();
-			}
-			else if (type == "f") // Face indices (assumes that model is an assembly of triangles only)
-			{
-				unsigned int vertexIdx = 0;
-				do {
-					while (iss.peek() == ' ')
-						iss.ignore();
-					for (int elementsToAdd = 3; elementsToAdd > 0; --elementsToAdd)
-					{
-						unsigned int i = 0;
-						// Extract the value into i
-						iss >> i;
-						if (!i)
-							break;
-
-						if (elementsToAdd == 1)
-							m_tmpIdxNormals.push_back(i);
-
-						if (elementsToAdd == 2)
-							m_tmpIdxUvs.push_back(i);
-
-						if (elementsToAdd == 3)
-						{
-							m_tmpIdxPositions.push_back(i);
-							if (vertexIdx / 2) // New triangle
-							{
-								m_indices.push_back(faceIdx);
-								m_indices.push_back(faceIdx + vertexIdx - 1);
-								m_indices.push_back(faceIdx + vertexIdx);
-							}
-							vertexIdx++;
-						}
-
-						if (iss.peek() == '/')
-						{
-							iss.ignore();
-							if (iss.peek() == '/')
-							{
-								iss.ignore();
-								elementsToAdd--;
-							}
-						}
-
-						if (iss.peek() == ' ')
-							break;
-					}
-				} while (iss);
-				faceIdx += vertexIdx; // Triangle count
-			}
-			//Success
+			m_shared->vertexCount += mesh->GetVertexCount();
+			m_shared->indexCount += mesh->GetIndexData().size() / mesh->GetIndexSize();
 		}
-		file.close();
+		ApplyRetention(*m_shared);
 	}
-	m_isRead = true;
+	// Before Decoded: the upload may free the CPU geometry right after
+	if (IsOccluder(_name))
+		BuildOccluder();
+	SetState(ResourceState::Decoded);
 }
 
-void Model::ResourceLoadOpenGL(const std::string _name)
+bool Model::IsCookStale(const std::filesystem::path& _cooked, const std::string& _name)
 {
-	if (meshes.empty())
+	TRACE_SCOPE("model", "Hash source", _name.c_str());
+	MappedFile file(GetObjFile(_name));
+	// Shipped without its .obj: nothing to compare to
+	if (!file.IsOpen())
+		return false;
+	m_sourceHash = file.ContentHash();
+	return MeshFile::ReadSourceHash(_cooked) != m_sourceHash;
+}
+
+uint64_t Model::GetContentKey(const std::filesystem::path& _path, const std::string& _name)
+{
+	TRACE_SCOPE("model", "Hash content", _name.c_str());
+	// A .mesh shipped without its .obj carries its hash
+	if (m_sourceHash == 0 && _path.extension() == ".mesh")
+		m_sourceHash = MeshFile::ReadSourceHash(_path);
+	if (m_sourceHash == 0)
 	{
-		Mesh* next_mesh = new Mesh(m_tmpVertices, m_tmpIdxPositions, m_tmpIdxUvs, m_tmpIdxNormals);
-		next_mesh->SetIndices(m_indices);
-		meshes.push_back(next_mesh);
+		MappedFile file(GetObjFile(_name));
+		if (!file.IsOpen())
+			return 0;
+		m_sourceHash = file.ContentHash();
 	}
+	// Other LODs, index order or vertex format: other meshes
+	return m_sourceHash ^ (static_cast<uint64_t>(GetCookFlags(m_vertexFormat)) * 0x9E3779B97F4A7C15ull);
+}
 
-	for (Mesh* mesh : meshes)
-		mesh->SetupMesh();
+bool Model::ReadShared(const std::filesystem::path& _path, const std::string& _name)
+{
+	uint64_t key = GetContentKey(_path, _name);
+	if (key == 0)
+		return false;
+	std::string ownerName;
+	Model* owner = dynamic_cast<Model*>(ResourcesManager::ClaimContent(key, this, _name, ownerName));
+	if (!owner)
+		return false;
+
+	// The owner claimed it from its own ResourceFileRead: it is being read on another worker, not queued
+	TRACE_SCOPE("model", "Wait shared", _name.c_str());
+	ResourceState state = owner->WaitForState(ResourceState::Decoded);
+	std::shared_ptr<SharedMeshes> shared;
+	{
+		std::lock_guard<std::mutex> lock(owner->m_meshMtx);
+		shared = owner->m_shared;
+		std::lock_guard<std::mutex> ownLock(m_meshMtx);
+		m_bounds = owner->m_bounds;
+		m_positionOffset = owner->m_positionOffset;
+		m_positionScale = owner->m_positionScale;
+	}
+	if (state == ResourceState::Failed || !shared)
+	{
+		DEBUG_WARNING("Model File %s: %s has the same content but no meshes to share, reading it", _name.c_str(), ownerName.c_str());
+		return false;
+	}
+	if (!MatchesShared(*shared, _path, _name))
+	{
+		DEBUG_WARNING("Model File %s: same hash as %s but not the same size or counts, reading it", _name.c_str(), ownerName.c_str());
+		return false;
+	}
+
+	size_t bufferBytes = 0;
+	for (const Mesh* mesh : shared->meshes)
+		bufferBytes += mesh->GetBufferBytes();
+	std::error_code error;
+	std::uintmax_t sourceBytes = std::filesystem::file_size(_path, error);
+
+	{
+		std::lock_guard<std::mutex> lock(m_meshMtx);
+		m_shared = shared;
+		meshes = shared->meshes;
+		m_sharedWith = ownerName;
+	}
+	// Keep after the owner's upload freed them: read back now from the owner's cooked file
+	ApplyRetention(*shared);
+	if (m_retention == GeometryRetention::Keep && !HasCpuGeometry() && !ReloadCpuGeometry())
+	{
+		DEBUG_WARNING("Model File %s: CPU geometry already freed by %s and not reloaded, discarding it", _name.c_str(), ownerName.c_str());
+		m_retention = GeometryRetention::Discard;
+	}
+	Log::SuccessColor();
+	DEBUG_LOG("Model File %s has the same content as %s: sharing its %zu meshes, %.2f MB not read, %.1f KB of buffers not duplicated", _name.c_str(),
+		ownerName.c_str(), meshes.size(), error ? 0.0 : static_cast<double>(sourceBytes) / (1024.0 * 1024.0), bufferBytes / 1024.f);
+	Log::ResetColor();
+	return true;
+}
+
+bool Model::MatchesShared(const SharedMeshes& _shared, const std::filesystem::path& _path, const std::string& _name) const
+{
+	bool compared = false;
+	std::error_code error;
+	uintmax_t objBytes = std::filesystem::file_size(GetObjFile(_name), error);
+	if (!error && _shared.objBytes != 0)
+	{
+		if (objBytes != _shared.objBytes)
+			return false;
+		compared = true;
+	}
+	// Its own cooked file, with the same settings: same meshes
+	uint64_t vertexCount = 0, indexCount = 0;
+	if (_path.extension() == ".mesh" && MeshFile::ReadCounts(_path, GetCookFlags(m_vertexFormat), vertexCount, indexCount))
+	{
+		if (vertexCount != _shared.vertexCount || indexCount != _shared.indexCount)
+			return false;
+		compared = true;
+	}
+	return compared;
+}
 
-	m_tmpVertices.clear();
-	m_tmpIdxPositions.clear();
-	m_tmpIdxUvs.clear();
-	m_tmpIdxNormals.clear();
-	m_indices.clear();
-	m_isLoaded = true;
+void Model::ApplyRetention(SharedMeshes& _shared)
+{
+	if (m_retention == GeometryRetention::Reload && !std::filesystem::exists(GetCookedFile(_shared.owner)))
+	{
+		DEBUG_WARNING("Model File %s: no cooked file of %s to reload the geometry from, keeping it on the CPU", m_name.c_str(), _shared.owner.c_str());
+		m_retention = GeometryRetention::Keep;
+	}
+	if (m_retention == GeometryRetention::Keep)
+	{
+		std::lock_guard<std::mutex> lock(_shared.retentionMtx);
+		_shared.keepGeometry = true;
+	}
+}
+
+double Model::ReadObj(const std::filesystem::path& _path, const std::string& _name)
+{
+	TRACE_SCOPE("model", "Parse OBJ", _name.c_str());
+	auto start = std::chrono::steady_clock::now();
+	MappedFile file(_path);
+	if (!file.IsOpen())
+		return -1.0;
+	Log::SuccessColor();
+	DEBUG_LOG("Model File %s has been opened", _name.c_str());
+	Log::ResetColor();
+
+	// Load .obj
+	auto parseStart = std::chrono::steady_clock::now();
+	ObjData data;
+	size_t chunks = ObjParser::ParseParallel(file.Data(), file.Data() + file.Size(), data, ResourcesManager::GetThreadPool());
+	double parseSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - parseStart).count();
+	size_t fileBytes = file.Size();
+	double megaBytes = static_cast<double>(fileBytes) / (1024.0 * 1024.0);
+	file.Close();
+
+	DEBUG_LOG("Model File %s parsed: %.2f MB in %.2f ms (%.1f MB/s, %zu chunks)", _name.c_str(), megaBytes, parseSeconds * 1000.0,
+		parseSeconds > 0.0 ? megaBytes / parseSeconds : 0.0, chunks);
+
+	BuildFromObj(data);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	SetReadCost(_path, fileBytes, seconds);
+	return seconds;
+}
+
+bool Model::ReadCooked(const std::filesystem::path& _path, const std::string& _name)
+{
+	TRACE_SCOPE("model", "Read .mesh", _name.c_str());
+	auto start = std::chrono::steady_clock::now();
+	std::vector<Mesh*> read;
+	size_t bytes = MeshFile::Read(_path, read, GetCookFlags(m_vertexFormat));
+	if (bytes == 0)
+		return false;
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	double megaBytes = static_cast<double>(bytes) / (1024.0 * 1024.0);
+	SetReadCost(_path, bytes, seconds);
+
+	Log::SuccessColor();
+	DEBUG_LOG("Model File %s read from .mesh: %.2f MB in %.2f ms (%.1f MB/s, %zu meshes)", _name.c_str(), megaBytes, seconds * 1000.0,
+		seconds > 0.0 ? megaBytes / seconds : 0.0, read.size());
+	Log::ResetColor();
+
+	std::lock_guard<std::mutex> lock(m_meshMtx);
+	meshes.insert(meshes.end(), read.begin(), read.end());
+	UpdateBounds();
+	return true;
+}
+
+void Model::Cook(const std::string& _name, double _objSeconds)
+{
+	TRACE_SCOPE("model", "Cook .mesh", _name.c_str());
+	// Not hashed yet when the sharing is off
+	if (m_sourceHash == 0)
+	{
+		MappedFile file(GetObjFile(_name));
+		m_sourceHash = file.IsOpen() ? file.ContentHash() : 0;
+	}
+	std::filesystem::path cooked = GetCookedFile(_name);
+	std::error_code error;
+	std::filesystem::create_directories(cooked.parent_path(), error);
+	{
+		std::lock_guard<std::mutex> lock(m_meshMtx);
+		if (meshes.empty() || !MeshFile::Write(cooked, meshes, GetCookFlags(m_vertexFormat), m_sourceHash))
+		{
+			DEBUG_WARNING("Model File %s could not be cooked to %s", _name.c_str(), cooked.generic_string().c_str());
+			return;
+		}
+	}
+
+	// Same meshes back from the file (warm, just written), for the comparison
+	auto start = std::chrono::steady_clock::now();
+	std::vector<Mesh*> check;
+	size_t bytes = MeshFile::Read(cooked, check, GetCookFlags(m_vertexFormat));
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	for (Mesh* mesh : check)
+		delete mesh;
+
+	std::uintmax_t objBytes = std::filesystem::file_size(GetObjFile(_name), error);
+	DEBUG_LOG("Model File %s cooked to %s: .obj %.2f MB parsed and built in %.2f ms, .mesh %.2f MB read in %.2f ms (%.1fx faster)", _name.c_str(),
+		cooked.generic_string().c_str(), error ? 0.0 : static_cast<double>(objBytes) / (1024.0 * 1024.0), _objSeconds * 1000.0,
+		static_cast<double>(bytes) / (1024.0 * 1024.0), seconds * 1000.0, seconds > 0.0 ? _objSeconds / seconds : 0.0);
+}
+
+// Position, uv and normal i share the slot i (the face indices pick each from its own slot)
+static std::vector<Vertex> BuildVertexSlots(const ObjData& _data, size_t _positions, size_t _uvs, size_t _normals)
+{
+	std::vector<Vertex> vertices(std::max({ _positions, _uvs, _normals }));
+	for (size_t i = 0; i < _positions; i++)
+		vertices[i].Position = Vectorf3(_data.positions[i * 3], _data.positions[i * 3 + 1], _data.positions[i * 3 + 2]);
+	for (size_t i = 0; i < _uvs; i++)
+		vertices[i].Uv = Vectorf2(_data.uvs[i * 2], _data.uvs[i * 2 + 1]);
+	for (size_t i = 0; i < _normals; i++)
+		vertices[i].Normal = Vectorf3(_data.normals[i * 3], _data.normals[i * 3 + 1], _data.normals[i * 3 + 2]);
+	return vertices;
+}
+
+void Model::BuildFromObj(ObjData& _data)
+{
+	TRACE_SCOPE("model", "Build meshes");
+	auto prefix = [](const std::vector<uint32_t>& _indices, size_t _count) {
+		return std::vector<uint32_t>(_indices.begin(), _indices.begin() + _count); };
+
+	// Each "g default" snapshots what was read so far in a mesh
+	std::vector<Mesh*> built;
+	for (const ObjGroupMark& group : _data.groups)
+	{
+		// No face yet: it would be a mesh without triangles
+		if (group.indices == 0)
+			continue;
+
+		built.push_back(new Mesh(BuildVertexSlots(_data, group.positions, group.uvs, group.normals),
+			prefix(_data.idxPositions, group.idxPositions), prefix(_data.idxUvs, group.idxUvs), prefix(_data.idxNormals, group.idxNormals),
+			prefix(_data.indices, group.indices)));
+	}
+
+	// Whole file, only when there was no group
+	if (built.empty() && !_data.idxPositions.empty())
+		built.push_back(new Mesh(BuildVertexSlots(_data, _data.positions.size() / 3, _data.uvs.size() / 2, _data.normals.size() / 3),
+			_data.idxPositions, _data.idxUvs, _data.idxNormals, _data.indices));
+
+	if (ResourcesManager::generateLods)
+	{
+		TRACE_SCOPE("model", "Build LODs");
+		for (Mesh* mesh : built)
+			mesh->BuildLods();
+	}
+
+	if (ResourcesManager::optimizeMeshes)
+	{
+		TRACE_SCOPE("model", "Optimize meshes");
+		for (Mesh* mesh : built)
+			mesh->OptimizeIndexOrder();
+	}
+
+	std::lock_guard<std::mutex> lock(m_meshMtx);
+	meshes.insert(meshes.end(), built.begin(), built.end());
+	UpdateBounds();
+
+	size_t vertexCount = 0, vertexBytes = 0;
+	for (Mesh* mesh : built)
+	{
+		mesh->PackVertices(m_vertexFormat, m_positionOffset, m_positionScale);
+		mesh->PackIndices();
+		vertexCount += mesh->GetVertexCount();
+		vertexBytes += mesh->GetVertexData().size();
+	}
+	if (vertexCount)
+		DEBUG_LOG("Model vertices: %zu, %.1f KB at %zu bytes each (%.1f KB as GpuVertex, %.1f KB as Vertex)", vertexCount, vertexBytes / 1024.f,
+			vertexBytes / vertexCount, vertexCount * sizeof(GpuVertex) / 1024.f, vertexCount * sizeof(Vertex) / 1024.f);
+}
+
+void Model::UpdateBounds()
+{
+	m_bounds = BoundingVolume();
+	for (const Mesh* mesh : meshes)
+		m_bounds.Merge(mesh->GetBounds());
+	if (m_bounds.IsEmpty())
+		return;
+
+	if (m_vertexFormat != VertexFormat::Compact16)
+		return;
+	m_positionOffset = m_bounds.boxMin;
+	for (int k = 0; k < 3; k++)
+	{
+		// Flat on an axis: any scale decodes back to the offset
+		float extent = m_bounds.boxMax[k] - m_bounds.boxMin[k];
+		m_positionScale[k] = extent > 0.f ? extent : 1.f;
+	}
+}
+
+void Model::SetVertexUniforms(const Shader& _shader) const
+{
+	_shader.SetBool("compactVertices", m_vertexFormat == VertexFormat::Compact16);
+	_shader.SetVec3("positionOffset", m_positionOffset);
+	_shader.SetVec3("positionScale", m_positionScale);
+}
+
+void Model::ResourceLoadOpenGL(const std::string _name)
+{
+	TRACE_SCOPE("model", "Upload", _name.c_str());
+	// Meshes are built by the worker, only the buffers are left
+	// Shared ones once, by the first of their models uploaded
+	if (m_shared)
+		std::call_once(m_shared->uploaded, [this, &_name]() {
+			// The other models may read back or free the CPU copy meanwhile
+			std::lock_guard<std::mutex> lock(m_shared->retentionMtx);
+			for (Mesh* mesh : m_shared->meshes)
+				mesh->SetupMesh();
+			// Drawn from the GPU buffers only
+			if (m_shared->keepGeometry)
+				return;
+			size_t freed = 0;
+			for (Mesh* mesh : m_shared->meshes)
+				freed += mesh->ReleaseCpuData();
+			DEBUG_LOG("Model File %s: %.1f KB of CPU geometry freed after the upload", _name.c_str(), freed / 1024.f);
+		});
+
+	SetState(ResourceState::Ready);
 }
 
 void Model::Draw(Shader& _shader)
 {
+	SetVertexUniforms(_shader);
 	for (Mesh* mesh : meshes)
 		mesh->Draw();
 }
@@ -175,13 +450,93 @@ void Model::Draw() {
 	Draw(*shader);
 }
 
-void Model::ResourceUnload()
+void Model::Draw(float _pixelsPerUnit)
 {
 	for (Mesh* mesh : meshes)
+		mesh->Draw(mesh->SelectLod(_pixelsPerUnit));
+}
+
+float Model::GetPixelsPerUnit(const BoundingVolume& _worldBounds, const Camera& _camera) const
+{
+	// Orthographic: no distance, keep the full detail
+	if (!_camera.perspective || _worldBounds.IsEmpty() || m_bounds.radius <= 0.f)
+		return std::numeric_limits<float>::max();
+
+	// The world sphere is the model one scaled by the longest axis
+	float scale = _worldBounds.radius / m_bounds.radius;
+	Vectorf3 toCenter(_worldBounds.center[0] - _camera.eye[0], _worldBounds.center[1] - _camera.eye[1], _worldBounds.center[2] - _camera.eye[2]);
+	// Nearest point of the bounds, the camera inside gets the full detail
+	float distance = toCenter.Magnitude() - _worldBounds.radius;
+	if (distance <= _camera.zNear)
+		return std::numeric_limits<float>::max();
+	return _camera.height / (2.f * std::tan(_camera.fovY * 0.5f) * distance) * scale;
+}
+
+void Model::ResourceUnload()
+{
 	{
-		mesh->Unload();
-		delete mesh;
+		std::lock_guard<std::mutex> lock(m_meshMtx);
+		meshes.clear();
+		m_occluder = OccluderMesh();
+		// The last model using them deletes the meshes
+		m_shared.reset();
 	}
+	SetState(ResourceState::Evicted);
+}
+
+std::filesystem::path Model::GetSourceFile(const std::string& _name) const
+{
+	std::filesystem::path obj = GetObjFile(_name);
+	if (!ResourcesManager::useCookedMeshes)
+		return obj;
+
+	// Cooked and not older than its .obj (or shipped without it), ResourceFileRead then compares their content
+	std::filesystem::path cooked = GetCookedFile(_name);
+	std::error_code error;
+	std::filesystem::file_time_type cookedTime = std::filesystem::last_write_time(cooked, error);
+	if (error)
+		return obj;
+	std::filesystem::file_time_type objTime = std::filesystem::last_write_time(obj, error);
+	return error || cookedTime >= objTime ? cooked : obj;
+}
+
+std::filesystem::path Model::GetObjFile(const std::string& _name)
+{
+	std::filesystem::path path = "assets/meshes/";
+	path += _name + std::string(".obj");
+	return path;
+}
+
+std::filesystem::path Model::GetCookedFile(const std::string& _name)
+{
+	std::filesystem::path path = "assets/meshes/cooked/";
+	path += _name + std::string(".mesh");
+	return path;
+}
+
+size_t Model::GetCpuBytes() const
+{
+	std::lock_guard<std::mutex> lock(m_meshMtx);
+	// Counted on the model that read them
+	if (!m_sharedWith.empty())
+		return 0;
+	std::unique_lock<std::mutex> geometryLock = LockCpuGeometry();
+	size_t bytes = 0;
+	for (const Mesh* mesh : meshes)
+		bytes += mesh->GetCpuBytes();
+	return bytes;
+}
+
+size_t Model::GetGpuBytes() const
+{
+	std::lock_guard<std::mutex> lock(m_meshMtx);
+	// Counted on the model that read them
+	if (!m_sharedWith.empty())
+		return 0;
+	size_t bytes = 0;
+	for (const Mesh* mesh : meshes)
+		bytes += mesh->GetGpuBytes();
+	return bytes;
 }
 
 void Model::ProcessNode(SceneNode* _node, const Scene* _scene) {
@@ -198,12 +553,202 @@ void Model::ProcessNode(SceneNode* _node, const Scene* _scene, Shader* _shader)
 	_shader->SetMat4("model", model);
 	_shader->SetMat3("normalMatrix", _node->GetTransform().NormalMatrix());
 	_shader->SetMat4("MVP", MVP);
+	SetVertexUniforms(*_shader);
+}
+
+bool Model::AddDraws(DrawBatcher& _batcher, SceneNode* _node, const Scene* _scene)
+{
+	if (!GetBatchedDrawCount(_node))
+		return false;
+
+	Transform transform = _node->GetTransform();
+	DrawData data = DrawBatcher::MakeDrawData(transform.ModelMatrix(), transform.NormalMatrix(), m_positionOffset, m_positionScale, _node->material);
+	float pixelsPerUnit = GetPixelsPerUnit(_node->GetWorldBounds(), _scene->camera);
+	for (Mesh* mesh : meshes)
+		_batcher.Add(*_node->shader, *mesh, mesh->SelectLod(pixelsPerUnit), _node->material, data);
+	return true;
+}
+
+size_t Model::GetBatchedDrawCount(const SceneNode* _node) const
+{
+	if (!IsLoaded() || meshes.empty() || !_node->shader)
+		return 0;
+	for (const Mesh* mesh : meshes)
+		if (!mesh->GetArena())
+			return 0;
+	return meshes.size();
+}
+
+void Model::SetDraws(DrawBatcher& _batcher, SceneNode* _node, const Scene* _scene, size_t _firstDraw, uint32_t _data) const
+{
+	Transform transform = _node->GetTransform();
+	_batcher.SetData(_data, DrawBatcher::MakeDrawData(transform.ModelMatrix(), transform.NormalMatrix(), m_positionOffset, m_positionScale,
+		_node->material));
+	float pixelsPerUnit = GetPixelsPerUnit(_node->GetWorldBounds(), _scene->camera);
+	for (size_t i = 0; i < meshes.size(); i++)
+		_batcher.Set(_firstDraw + i, *_node->shader, *meshes[i], meshes[i]->SelectLod(pixelsPerUnit), _node->material, _data);
+}
+
+std::filesystem::path Model::GetReloadFile() const
+{
+	std::lock_guard<std::mutex> lock(m_meshMtx);
+	return GetCookedFile(m_shared ? m_shared->owner : m_name);
+}
+
+const void* Model::GetGeometryKey() const
+{
+	if (meshes.empty())
+		return this;
+	if (meshes[0]->GetArena())
+		return meshes[0]->GetArena();
+	return meshes[0];
+}
+
+const OccluderMesh& Model::GetOccluderMesh() const
+{
+	static const OccluderMesh s_none;
+	return GetState() == ResourceState::Ready ? m_occluder : s_none;
+}
+
+void Model::BuildOccluder()
+{
+	TRACE_SCOPE("model", "Build occluder", m_name.c_str());
+	// The upload of the owner (or a model sharing the meshes) can free the CPU geometry at any time:
+	// checked and decoded under the same lock, read back once if it was already freed, released again unless kept
+	bool reloaded = false;
+	for (int attempt = 0; attempt < 2; attempt++)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_meshMtx);
+			std::unique_lock<std::mutex> geometryLock = LockCpuGeometry();
+			if (std::all_of(meshes.begin(), meshes.end(), [](const Mesh* _mesh) { return _mesh->HasCpuData(); }))
+			{
+				for (const Mesh* mesh : meshes)
+					mesh->AppendTriangles(m_occluder, m_positionOffset, m_positionScale);
+				break;
+			}
+		}
+		if (attempt == 1 || !(reloaded = ReloadCpuGeometry()))
+		{
+			DEBUG_WARNING("Model File %s: no CPU geometry for the occlusion buffer, set its retention to Keep", m_name.c_str());
+			return;
+		}
+	}
+	if (reloaded && m_retention != GeometryRetention::Keep)
+		ReleaseCpuGeometry();
+}
+
+bool Model::HasCpuGeometry() const
+{
+	std::lock_guard<std::mutex> lock(m_meshMtx);
+	std::unique_lock<std::mutex> geometryLock = LockCpuGeometry();
+	for (const Mesh* mesh : meshes)
+		if (!mesh->HasCpuData())
+			return false;
+	return true;
+}
+
+bool Model::ReloadCpuGeometry()
+{
+	TRACE_SCOPE("model", "Reload CPU geometry", m_name.c_str());
+	auto start = std::chrono::steady_clock::now();
+	std::vector<Mesh*> read;
+	std::filesystem::path cooked = GetReloadFile();
+	size_t bytes = MeshFile::Read(cooked, read, GetCookFlags(m_vertexFormat));
+	bool restored = false;
+	{
+		std::lock_guard<std::mutex> lock(m_meshMtx);
+		std::unique_lock<std::mutex> geometryLock = LockCpuGeometry();
+		// Same meshes in the same order, unless cooked again since
+		restored = bytes != 0 && read.size() == meshes.size();
+		for (size_t i = 0; restored && i < meshes.size(); i++)
+			restored = meshes[i]->HasCpuData() || meshes[i]->RestoreCpuData(*read[i]);
+	}
+	for (Mesh* mesh : read)
+	{
+		mesh->Unload();
+		delete mesh;
+	}
+	if (!restored)
+	{
+		DEBUG_WARNING("Model File %s: %s does not match the uploaded meshes, CPU geometry not reloaded", m_name.c_str(),
+			cooked.generic_string().c_str());
+		return false;
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	DEBUG_LOG("Model File %s: CPU geometry reloaded, %.1f KB in %.2f ms", m_name.c_str(), bytes / 1024.f, seconds * 1000.0);
+	return true;
+}
+
+size_t Model::ReleaseCpuGeometry()
+{
+	std::lock_guard<std::mutex> lock(m_meshMtx);
+	std::unique_lock<std::mutex> geometryLock = LockCpuGeometry();
+	// Another model sharing the meshes keeps them
+	if (m_shared && m_shared->keepGeometry)
+		return 0;
+	size_t freed = 0;
+	for (Mesh* mesh : meshes)
+		freed += mesh->ReleaseCpuData();
+	return freed;
+}
+
+std::unique_lock<std::mutex> Model::LockCpuGeometry() const
+{
+	if (!m_shared)
+		return std::unique_lock<std::mutex>();
+	return std::unique_lock<std::mutex>(m_shared->retentionMtx);
 }
 
 void Model::ResetCount() {
 	s_ModelNumber = 0;
 }
 
+void Model::SetVertexFormat(const std::string& _name, VertexFormat _format)
+{
+	std::lock_guard<std::mutex> lock(s_VertexFormatMtx);
+	s_VertexFormats[_name] = _format;
+}
+
+VertexFormat Model::GetVertexFormat(const std::string& _name)
+{
+	std::lock_guard<std::mutex> lock(s_VertexFormatMtx);
+	auto it = s_VertexFormats.find(_name);
+	if (it != s_VertexFormats.end())
+		return it->second;
+	return ResourcesManager::compactVertices ? VertexFormat::Compact16 : VertexFormat::Float32;
+}
+
+void Model::SetGeometryRetention(const std::string& _name, GeometryRetention _retention)
+{
+	std::lock_guard<std::mutex> lock(s_RetentionMtx);
+	s_Retentions[_name] = _retention;
+}
+
+GeometryRetention Model::GetGeometryRetention(const std::string& _name)
+{
+	std::lock_guard<std::mutex> lock(s_RetentionMtx);
+	auto it = s_Retentions.find(_name);
+	if (it != s_Retentions.end())
+		return it->second;
+	return ResourcesManager::discardCpuGeometry ? GeometryRetention::Discard : GeometryRetention::Keep;
+}
+
+void Model::SetOccluder(const std::string& _name, bool _occluder)
+{
+	std::lock_guard<std::mutex> lock(s_OccluderMtx);
+	if (_occluder)
+		s_Occluders.insert(_name);
+	else
+		s_Occluders.erase(_name);
+}
+
+bool Model::IsOccluder(const std::string& _name)
+{
+	std::lock_guard<std::mutex> lock(s_OccluderMtx);
+	return s_Occluders.contains(_name);
+}
+
 void Model::AddMaterial() {
 	materials.push_back(material::none);
 }
@@ -0,0 +1,394 @@
+#include <ObjParser.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include <MappedFile.hpp>
+#include <ThreadPool.hpp>
+
+namespace
+{
+	// Whitespace of the "C" locale, without '\n' (lines are already split)
+	inline bool IsBlank(char _c) {
+		return _c == ' ' || _c == '\t' || _c == '\r' || _c == '\v' || _c == '\f';
+	}
+
+	inline const char* SkipBlanks(const char* _p, const char* _end)
+	{
+		while (_p < _end && IsBlank(*_p))
+			_p++;
+		return _p;
+	}
+
+	inline bool ReadFloat(const char*& _p, const char* _end, float& _value)
+	{
+		_p = SkipBlanks(_p, _end);
+		// from_chars does not take the '+' that operator>> accepts
+		if (_p < _end && *_p == '+')
+			_p++;
+		std::from_chars_result result = std::from_chars(_p, _end, _value);
+		if (result.ec != std::errc())
+			return false;
+		_p = result.ptr;
+		return true;
+	}
+
+	inline bool ReadIndex(const char*& _p, const char* _end, uint32_t& _value)
+	{
+		_p = SkipBlanks(_p, _end);
+		std::from_chars_result result = std::from_chars(_p, _end, _value);
+		if (result.ec != std::errc())
+			return false;
+		_p = result.ptr;
+		return true;
+	}
+
+	void ParseFace(const char* _p, const char* _end, ObjData& _out)
+	{
+		uint32_t vertexIdx = 0;
+		bool reading = true;
+		while (reading)
+		{
+			// Position, uv, normal: "p", "p/u", "p//n" or "p/u/n"
+			for (int elementsToAdd = 3; elementsToAdd > 0; --elementsToAdd)
+			{
+				uint32_t i = 0;
+				if (!ReadIndex(_p, _end, i))
+				{
+					reading = false;
+					break;
+				}
+				if (!i)
+					break;
+
+				if (elementsToAdd == 1)
+					_out.idxNormals.push_back(i);
+
+				if (elementsToAdd == 2)
+					_out.idxUvs.push_back(i);
+
+				if (elementsToAdd == 3)
+				{
+					_out.idxPositions.push_back(i);
+					if (vertexIdx / 2) // New triangle
+					{
+						_out.indices.push_back(_out.faceVertices);
+						_out.indices.push_back(_out.faceVertices + vertexIdx - 1);
+						_out.indices.push_back(_out.faceVertices + vertexIdx);
+					}
+					vertexIdx++;
+				}
+
+				if (_p < _end && *_p == '/')
+				{
+					_p++;
+					if (_p < _end && *_p == '/')
+					{
+						_p++;
+						elementsToAdd--;
+					}
+				}
+
+				if (_p < _end && *_p == ' ')
+					break;
+			}
+		}
+		_out.faceVertices += vertexIdx;
+	}
+
+	void ParseLine(const char* _line, const char* _end, ObjData& _out)
+	{
+		const char* p = SkipBlanks(_line, _end);
+		const char* typeEnd = p;
+		while (typeEnd < _end && !IsBlank(*typeEnd))
+			typeEnd++;
+		std::string_view type(p, typeEnd - p);
+		if (type.empty() || type == "#")
+			return;
+		p = typeEnd;
+
+		if (type[0] == 'v')
+		{
+			// Missing values stay at 0
+			float xyz[3] = { 0.f, 0.f, 0.f };
+			for (int i = 0; i < 3 && ReadFloat(p, _end, xyz[i]); i++);
+
+			if (type.size() == 1) // Vertex position
+				_out.positions.insert(_out.positions.end(), xyz, xyz + 3);
+			else if (type[1] == 't') // Texture position
+				_out.uvs.insert(_out.uvs.end(), xyz, xyz + 2);
+			else if (type[1] == 'n') // Normal position
+				_out.normals.insert(_out.normals.end(), xyz, xyz + 3);
+		}
+		else if (type == "g") // Group
+		{
+			// Kept even before any vertex: a chunk does not know what the previous ones read
+			if (std::string_view(_line, _end - _line).find("default") != std::string_view::npos)
+				_out.groups.push_back({ _out.positions.size() / 3, _out.uvs.size() / 2, _out.normals.size() / 3,
+					_out.idxPositions.size(), _out.idxUvs.size(), _out.idxNormals.size(), _out.indices.size() });
+		}
+		else if (type == "f") // Face indices
+			ParseFace(p, _end, _out);
+	}
+
+	bool HasVertices(const ObjGroupMark& _group) {
+		return _group.positions != 0 || _group.uvs != 0 || _group.normals != 0;
+	}
+}
+
+void ObjData::Clear()
+{
+	positions.clear();
+	uvs.clear();
+	normals.clear();
+	idxPositions.clear();
+	idxUvs.clear();
+	idxNormals.clear();
+	indices.clear();
+	faceVertices = 0;
+	groups.clear();
+}
+
+void ObjParser::Parse(const char* _begin, const char* _end, ObjData& _out)
+{
+	const char* line = _begin;
+	while (line < _end)
+	{
+		const char* lineEnd = static_cast<const char*>(std::memchr(line, '\n', _end - line));
+		if (!lineEnd)
+			lineEnd = _end;
+		ParseLine(line, lineEnd, _out);
+		line = lineEnd + 1;
+	}
+}
+
+size_t ObjParser::ParseParallel(const char* _begin, const char* _end, ObjData& _out, ThreadPool& _pool)
+{
+	size_t size = _end - _begin;
+	// A few chunks per thread, they do not all parse at the same speed
+	size_t chunkCount = std::min(size / s_chunkBytes, static_cast<size_t>(ThreadPool::GetSize() + 1) * 4);
+	if (size < s_parallelMinBytes || chunkCount < 2)
+	{
+		Parse(_begin, _end, _out);
+		return 1;
+	}
+
+	// Each chunk ends after a line end
+	std::vector<const char*> bounds(chunkCount + 1);
+	bounds[0] = _begin;
+	bounds[chunkCount] = _end;
+	for (size_t k = 1; k < chunkCount; k++)
+	{
+		const char* p = std::max(_begin + size / chunkCount * k, bounds[k - 1]);
+		const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', _end - p));
+		bounds[k] = lineEnd ? lineEnd + 1 : _end;
+	}
+
+	std::vector<ObjData> chunks(chunkCount);
+	_pool.ParallelFor(chunkCount, [&bounds, &chunks](size_t _k) {
+		TRACE_SCOPE("model", "Parse OBJ chunk");
+		Parse(bounds[_k], bounds[_k + 1], chunks[_k]);
+		}, "OBJ chunk");
+
+	// Where each chunk goes in the merged arrays
+	struct Offsets
+	{
+		size_t positions, uvs, normals;
+		size_t idxPositions, idxUvs, idxNormals, indices;
+		uint32_t faceVertices;
+	};
+	std::vector<Offsets> offsets(chunkCount + 1);
+	offsets[0] = { _out.positions.size(), _out.uvs.size(), _out.normals.size(),
+		_out.idxPositions.size(), _out.idxUvs.size(), _out.idxNormals.size(), _out.indices.size(), _out.faceVertices };
+	for (size_t k = 0; k < chunkCount; k++)
+	{
+		const ObjData& chunk = chunks[k];
+		const Offsets& o = offsets[k];
+		offsets[k + 1] = { o.positions + chunk.positions.size(), o.uvs + chunk.uvs.size(), o.normals + chunk.normals.size(),
+			o.idxPositions + chunk.idxPositions.size(), o.idxUvs + chunk.idxUvs.size(), o.idxNormals + chunk.idxNormals.size(),
+			o.indices + chunk.indices.size(), o.faceVertices + chunk.faceVertices };
+
+		// Marks are relative to their chunk
+		for (const ObjGroupMark& group : chunk.groups)
+			_out.groups.push_back({ o.positions / 3 + group.positions, o.uvs / 2 + group.uvs, o.normals / 3 + group.normals,
+				o.idxPositions + group.idxPositions, o.idxUvs + group.idxUvs, o.idxNormals + group.idxNormals, o.indices + group.indices });
+	}
+
+	const Offsets& total = offsets[chunkCount];
+	_out.positions.resize(total.positions);
+	_out.uvs.resize(total.uvs);
+	_out.normals.resize(total.normals);
+	_out.idxPositions.resize(total.idxPositions);
+	_out.idxUvs.resize(total.idxUvs);
+	_out.idxNormals.resize(total.idxNormals);
+	_out.indices.resize(total.indices);
+	_out.faceVertices = total.faceVertices;
+
+	// Chunks write disjoint ranges
+	_pool.ParallelFor(chunkCount, [&chunks, &offsets, &_out](size_t _k) {
+		TRACE_SCOPE("model", "Merge OBJ chunk");
+		const ObjData& chunk = chunks[_k];
+		const Offsets& o = offsets[_k];
+		std::copy(chunk.positions.begin(), chunk.positions.end(), _out.positions.begin() + o.positions);
+		std::copy(chunk.uvs.begin(), chunk.uvs.end(), _out.uvs.begin() + o.uvs);
+		std::copy(chunk.normals.begin(), chunk.normals.end(), _out.normals.begin() + o.normals);
+		// File indices are absolute, only the face corners need the offset
+		std::copy(chunk.idxPositions.begin(), chunk.idxPositions.end(), _out.idxPositions.begin() + o.idxPositions);
+		std::copy(chunk.idxUvs.begin(), chunk.idxUvs.end(), _out.idxUvs.begin() + o.idxUvs);
+		std::copy(chunk.idxNormals.begin(), chunk.idxNormals.end(), _out.idxNormals.begin() + o.idxNormals);
+		std::transform(chunk.indices.begin(), chunk.indices.end(), _out.indices.begin() + o.indices,
+			[&o](uint32_t _index) { return _index + o.faceVertices; });
+		}, "OBJ merge");
+
+	return chunkCount;
+}
+
+void ObjParser::ParseReference(std::istream& _in, ObjData& _out)
+{
+	std::string line;
+	while (std::getline(_in, line))
+	{
+		if (line.empty())
+			continue;
+		// Missing values stay at 0 (the old parser left them uninitialized)
+		float x = 0.f, y = 0.f, z = 0.f;
+		// Process each line
+		std::istringstream iss(line);
+		std::string type;
+		iss >> type;
+		if (type == "#")
+			continue;
+		if (type[0] == 'v')
+		{
+			iss >> x >> y >> z;
+			if (type == "v") // Vertex position
+				_out.positions.insert(_out.positions.end(), { x, y, z });
+			else if (type[1] == 't') // Texture position
+				_out.uvs.insert(_out.uvs.end(), { x, y });
+			else if (type[1] == 'n') // Normal position
+				_out.normals.insert(_out.normals.end(), { x, y, z });
+		}
+		else if (type == "g"
+			&& line.find("default") != std::string::npos
+			&& !(_out.positions.empty() && _out.uvs.empty() && _out.normals.empty())) // Group
+		{
+			_out.groups.push_back({ _out.positions.size() / 3, _out.uvs.size() / 2, _out.normals.size() / 3,
+				_out.idxPositions.size(), _out.idxUvs.size(), _out.idxNormals.size(), _out.indices.size() });
+		}
+		else if (type == "f") // Face indices
+		{
+			uint32_t vertexIdx = 0;
+			do {
+				while (iss.peek() == ' ')
+					iss.ignore();
+				for (int elementsToAdd = 3; elementsToAdd > 0; --elementsToAdd)
+				{
+					uint32_t i = 0;
+					// Extract the value into i
+					iss >> i;
+					if (!i)
+						break;
+
+					if (elementsToAdd == 1)
+						_out.idxNormals.push_back(i);
+
+					if (elementsToAdd == 2)
+						_out.idxUvs.push_back(i);
+
+					if (elementsToAdd == 3)
+					{
+						_out.idxPositions.push_back(i);
+						if (vertexIdx / 2) // New triangle
+						{
+							_out.indices.push_back(_out.faceVertices);
+							_out.indices.push_back(_out.faceVertices + vertexIdx - 1);
+							_out.indices.push_back(_out.faceVertices + vertexIdx);
+						}
+						vertexIdx++;
+					}
+
+					if (iss.peek() == '/')
+					{
+						iss.ignore();
+						if (iss.peek() == '/')
+						{
+							iss.ignore();
+							elementsToAdd--;
+						}
+					}
+
+					if (iss.peek() == ' ')
+						break;
+				}
+			} while (iss);
+			_out.faceVertices += vertexIdx;
+		}
+	}
+}
+
+bool ObjParser::SameOutput(const ObjData& _a, const ObjData& _b)
+{
+	if (_a.positions != _b.positions || _a.uvs != _b.uvs || _a.normals != _b.normals || _a.idxPositions != _b.idxPositions
+		|| _a.idxUvs != _b.idxUvs || _a.idxNormals != _b.idxNormals || _a.indices != _b.indices || _a.faceVertices != _b.faceVertices)
+		return false;
+
+	auto sameMark = [](const ObjGroupMark& _x, const ObjGroupMark& _y) {
+		return _x.positions == _y.positions && _x.uvs == _y.uvs && _x.normals == _y.normals && _x.idxPositions == _y.idxPositions
+			&& _x.idxUvs == _y.idxUvs && _x.idxNormals == _y.idxNormals && _x.indices == _y.indices; };
+	auto a = std::find_if(_a.groups.begin(), _a.groups.end(), HasVertices);
+	auto b = std::find_if(_b.groups.begin(), _b.groups.end(), HasVertices);
+	for (; a != _a.groups.end() && b != _b.groups.end(); ++a, ++b)
+		if (!sameMark(*a, *b))
+			return false;
+	return a == _a.groups.end() && b == _b.groups.end();
+}
+
+ObjParseBenchmark ObjParser::Benchmark(const std::filesystem::path& _path, ThreadPool& _pool)
+{
+	ObjParseBenchmark result;
+	result.file = _path.filename().string();
+	using Clock = std::chrono::steady_clock;
+	auto toMs = [](Clock::time_point _start) {
+		return std::chrono::duration<double, std::milli>(Clock::now() - _start).count(); };
+
+	// Each one opens the file itself, warm page cache for all after the first
+	ObjData reference;
+	Clock::time_point start = Clock::now();
+	std::ifstream stream(_path);
+	if (!stream.is_open())
+		return result;
+	ParseReference(stream, reference);
+	result.referenceMs = toMs(start);
+	stream.close();
+
+	ObjData serial;
+	start = Clock::now();
+	{
+		MappedFile file(_path);
+		if (!file.IsOpen())
+			return result;
+		Parse(file.Data(), file.Data() + file.Size(), serial);
+		result.megaBytes = static_cast<double>(file.Size()) / (1024.0 * 1024.0);
+	}
+	result.serialMs = toMs(start);
+
+	ObjData parallel;
+	start = Clock::now();
+	{
+		MappedFile file(_path);
+		if (!file.IsOpen())
+			return result;
+		result.chunks = ParseParallel(file.Data(), file.Data() + file.Size(), parallel, _pool);
+	}
+	result.parallelMs = toMs(start);
+
+	result.opened = true;
+	result.sameOutput = SameOutput(reference, serial) && SameOutput(reference, parallel);
+	return result;
+}
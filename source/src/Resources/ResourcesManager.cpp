@@ -1,10 +1,35 @@
 #include <ResourcesManager.hpp>
 
+#include <algorithm>
+#include <cstring>
+
+#include <ImGui/imgui.h>
+
 // Singleton
 std::atomic<ResourcesManager*> ResourcesManager::s_m_instance = nullptr;
 std::mutex ResourcesManager::s_m_mutex;
 std::unordered_map<std::string, IResource*> ResourcesManager::s_m_resources;
 ThreadPool ResourcesManager::s_m_threadPool;
+Prefetcher ResourcesManager::s_m_prefetcher;
+
+// Load scheduling
+bool ResourcesManager::s_m_batching = false;
+std::vector<PendingLoad> ResourcesManager::s_m_pendingLoads;
+std::mutex ResourcesManager::s_m_throughputMutex;
+LoadBatchTiming ResourcesManager::s_m_batchTimings[2];
+std::chrono::steady_clock::time_point ResourcesManager::s_m_batchStart;
+bool ResourcesManager::s_m_batchLongestFirst = false;
+std::atomic<uint64_t> ResourcesManager::s_m_batchId = 0;
+std::atomic<size_t> ResourcesManager::s_m_batchReadsLeft = 0;
+std::mutex ResourcesManager::s_m_contentMutex;
+std::unordered_map<uint64_t, std::pair<IResource*, std::string>> ResourcesManager::s_m_contentOwners;
+// First guesses, replaced by the measures as soon as files are read
+std::unordered_map<std::string, LoadThroughput> ResourcesManager::s_m_throughputs = {
+	{ "Model .obj", { 15.0 * 1024.0 * 1024.0, 0.001, 0 } },		// Text parsing
+	{ "Model .mesh", { 500.0 * 1024.0 * 1024.0, 0.001, 0 } },	// Binary, straight to the buffers
+	{ "Texture .png", { 40.0 * 1024.0 * 1024.0, 0.001, 0 } },	// Compressed bytes to decode
+	{ "Texture .jpg", { 40.0 * 1024.0 * 1024.0, 0.001, 0 } }
+};
 
 ResourcesManager::ResourcesManager() {
 	s_m_instance = this->GetInstance();
@@ -21,9 +46,10 @@ bool ResourcesManager::IsPoolDone()
 	//if (s_m_isDeadPool)
 		//return true;
 
+	std::lock_guard<std::mutex> lock(s_m_mutex);
 	unsigned int totalDone = 0;
 	for (std::pair<std::string, IResource*> pair : s_m_resources)
-		if (pair.second->IsLoaded()) totalDone++;
+		if (pair.second->IsSettled()) totalDone++;
 
 	if (totalDone == s_m_resources.size())
 		return true;
@@ -31,9 +57,171 @@ bool ResourcesManager::IsPoolDone()
 		return false;
 }
 
+IResource* ResourcesManager::ClaimContent(uint64_t _key, IResource* _resource, const std::string& _name, std::string& _ownerName)
+{
+	std::lock_guard<std::mutex> lock(s_m_contentMutex);
+	auto [it, claimed] = s_m_contentOwners.try_emplace(_key, _resource, _name);
+	if (claimed || it->second.first == _resource)
+		return nullptr;
+	_ownerName = it->second.second;
+	return it->second.first;
+}
+
+void ResourcesManager::ReleaseContent(const IResource* _resource)
+{
+	std::lock_guard<std::mutex> lock(s_m_contentMutex);
+	std::erase_if(s_m_contentOwners, [_resource](const auto& _pair) { return _pair.second.first == _resource; });
+}
+
+void ResourcesManager::BeginLoadBatch()
+{
+	std::lock_guard<std::mutex> lock(s_m_mutex);
+	s_m_pendingLoads.clear();
+	s_m_batching = true;
+}
+
+void ResourcesManager::SubmitLoadBatch()
+{
+	TRACE_SCOPE("manager", "SubmitLoadBatch");
+	// Taken out of the lock, the UI reports on the resources while the batch is queued
+	std::vector<PendingLoad> loads;
+	{
+		std::lock_guard<std::mutex> lock(s_m_mutex);
+		s_m_batching = false;
+		loads.swap(s_m_pendingLoads);
+	}
+
+	double sourceOrderMakespan = SimulateMakespan(loads);
+	if (longestJobFirst)
+		std::stable_sort(loads.begin(), loads.end(), [](const PendingLoad& _a, const PendingLoad& _b) {
+			return _a.estimatedSeconds > _b.estimatedSeconds; });
+	double submittedMakespan = SimulateMakespan(loads);
+
+	DEBUG_LOG("Load batch of %zu files, %s order. Estimated makespan: source order %.1f ms, submitted %.1f ms (%.1f%% gain)",
+		loads.size(), longestJobFirst ? "longest first" : "source", sourceOrderMakespan * 1000.0, submittedMakespan * 1000.0,
+		sourceOrderMakespan > 0.0 ? (1.0 - submittedMakespan / sourceOrderMakespan) * 100.0 : 0.0);
+
+	uint64_t batchId = 0;
+	{
+		std::lock_guard<std::mutex> lock(s_m_throughputMutex);
+		// Its remaining reads no longer count
+		if (s_m_batchReadsLeft.load() != 0)
+			DEBUG_WARNING("Load batch submitted while the previous one is still reading, the previous one is not measured");
+		batchId = ++s_m_batchId;
+		s_m_batchLongestFirst = longestJobFirst;
+		LoadBatchTiming& timing = s_m_batchTimings[s_m_batchLongestFirst];
+		timing.files = loads.size();
+		timing.estimatedMs = submittedMakespan * 1000.0;
+		timing.measuredMs = 0.0;
+		s_m_batchReadsLeft = loads.size();
+		s_m_batchStart = std::chrono::steady_clock::now();
+	}
+
+	// The workers take the loads in this order, the prefetcher follows them
+	std::vector<std::filesystem::path> files;
+	files.reserve(loads.size());
+	for (const PendingLoad& load : loads)
+		files.push_back(load.resource->GetSourceFile(load.name));
+	s_m_prefetcher.Start(files, prefetchEnabled ? static_cast<unsigned int>(std::max(prefetchDistance, 0)) : 0);
+
+	for (const PendingLoad& load : loads)
+		QueueRead(load.resource, load.name, batchId);
+}
+
+void ResourcesManager::QueueRead(IResource* _resource, const std::string& _name, uint64_t _batchId)
+{
+	s_m_threadPool.AddToQueue([_resource, _name, _batchId]() {
+		s_m_prefetcher.NotifyReadStarted();
+		_resource->ResourceFileReadTimed(_name);
+		RecordThroughput(_resource);
+		if (_batchId != 0 && _batchId == s_m_batchId.load() && s_m_batchReadsLeft.fetch_sub(1) == 1)
+			FinishLoadBatch();
+		}, _name + " creation");
+}
+
+void ResourcesManager::FinishLoadBatch()
+{
+	std::lock_guard<std::mutex> lock(s_m_throughputMutex);
+	LoadBatchTiming& timing = s_m_batchTimings[s_m_batchLongestFirst];
+	timing.measuredMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - s_m_batchStart).count();
+	timing.loads++;
+	const LoadBatchTiming& other = s_m_batchTimings[!s_m_batchLongestFirst];
+	DEBUG_LOG("Load batch of %zu files read in %.1f ms, %s order (estimated %.1f ms). Last %s order batch: %.1f ms", timing.files, timing.measuredMs,
+		s_m_batchLongestFirst ? "longest first" : "source", timing.estimatedMs, s_m_batchLongestFirst ? "source" : "longest first", other.measuredMs);
+}
+
+LoadBatchTiming ResourcesManager::GetLoadBatchTiming(bool _longestFirst)
+{
+	std::lock_guard<std::mutex> lock(s_m_throughputMutex);
+	return s_m_batchTimings[_longestFirst];
+}
+
+std::string ResourcesManager::GetLoadKind(const std::string& _type, const std::filesystem::path& _file) {
+	return _type + " " + _file.extension().string();
+}
+
+double ResourcesManager::EstimateLoadSeconds(const std::string& _kind, uintmax_t _fileBytes)
+{
+	std::lock_guard<std::mutex> lock(s_m_throughputMutex);
+	auto it = s_m_throughputs.find(_kind);
+	LoadThroughput throughput = it != s_m_throughputs.end() ? it->second : LoadThroughput{ 100.0 * 1024.0 * 1024.0, 0.001, 0 };
+	return throughput.fixedSeconds + static_cast<double>(_fileBytes) / throughput.bytesPerSecond;
+}
+
+void ResourcesManager::RecordThroughput(const IResource* _resource)
+{
+	// Not the Reading -> Decoded time: it also holds the content hash and the wait on a shared owner
+	// Not the state either: the main thread may already have moved the resource on to its upload
+	const ReadCost& cost = _resource->GetReadCost();
+	if (cost.bytes == 0 || cost.seconds <= 0.0)
+		return;
+	double seconds = cost.seconds;
+
+	// Small files mostly measure the per file cost
+	const uintmax_t smallFile = 64 * 1024;
+	// Moving average, recent loads weigh more (warm cache, same machine)
+	const double weight = 0.3;
+
+	std::lock_guard<std::mutex> lock(s_m_throughputMutex);
+	LoadThroughput& throughput = s_m_throughputs.try_emplace(GetLoadKind(_resource->GetTypeName(), cost.file), LoadThroughput{ 100.0 * 1024.0 * 1024.0, 0.001, 0 }).first->second;
+	if (cost.bytes < smallFile)
+		throughput.fixedSeconds += (seconds - throughput.fixedSeconds) * weight;
+	else
+	{
+		double bytesPerSecond = static_cast<double>(cost.bytes) / std::max(seconds - throughput.fixedSeconds, seconds * 0.5);
+		throughput.bytesPerSecond += (bytesPerSecond - throughput.bytesPerSecond) * (throughput.samples ? weight : 1.0);
+		throughput.samples++;
+	}
+}
+
+double ResourcesManager::SimulateMakespan(const std::vector<PendingLoad>& _loads)
+{
+	// Each load goes to the worker that gets free first
+	std::vector<double> workerEnd(ThreadPool::GetSize(), 0.0);
+	for (const PendingLoad& load : _loads)
+	{
+		auto firstFree = std::min_element(workerEnd.begin(), workerEnd.end());
+		*firstFree += load.estimatedSeconds;
+	}
+	return *std::max_element(workerEnd.begin(), workerEnd.end());
+}
+
+void ResourcesManager::LogThroughputs()
+{
+	std::lock_guard<std::mutex> lock(s_m_throughputMutex);
+	for (const std::pair<const std::string, LoadThroughput>& pair : s_m_throughputs)
+		DEBUG_LOG("%s read throughput: %.2f MB/s + %.2f ms per file (%u samples)", pair.first.c_str(),
+			pair.second.bytesPerSecond / (1024.0 * 1024.0), pair.second.fixedSeconds * 1000.0, pair.second.samples);
+}
+
+void ResourcesManager::LogPrefetchStats() {
+	s_m_prefetcher.LogStats();
+}
+
 void ResourcesManager::Destroy()
 {
 	Log::SuccessColor();
+	std::unique_lock<std::mutex> lock(s_m_mutex);
 	for (std::pair<std::string, IResource*> pair : s_m_resources)
 	{
 		pair.second->ResourceUnload();
@@ -41,6 +229,11 @@ void ResourcesManager::Destroy()
 		DEBUG_LOG("Resource %s deleted successfully", pair.first.c_str());
 	}
 	s_m_resources.clear(); // Probably useless
+	lock.unlock();
+	{
+		std::lock_guard<std::mutex> lock(s_m_contentMutex);
+		s_m_contentOwners.clear();
+	}
 	Model::ResetCount();
 	Shader::ResetCount();
 	DEBUG_LOG("Resource manager cleared successfully");
@@ -62,6 +255,7 @@ ResourcesManager* ResourcesManager::GetInstance()
 
 void ResourcesManager::Delete(const std::string& _name)
 {
+	std::unique_lock<std::mutex> lock(s_m_mutex);
 	auto it = s_m_resources.find(_name);
 	if (it == s_m_resources.end())
 	{
@@ -71,8 +265,111 @@ void ResourcesManager::Delete(const std::string& _name)
 
 	delete s_m_resources.find(_name)->second;
 	s_m_resources.erase(_name);
+	lock.unlock();
 
 	Log::SuccessColor();
 	DEBUG_LOG("Resource %s deleted successfully", _name);
 	Log::ResetColor();
+}
+
+std::vector<ResourceMemoryInfo> ResourcesManager::GetMemoryReport()
+{
+	std::vector<ResourceMemoryInfo> report;
+	// Held while measuring: a resource created again under the same name deletes the previous one
+	std::lock_guard<std::mutex> lock(s_m_mutex);
+	report.reserve(s_m_resources.size());
+	for (const std::pair<const std::string, IResource*>& pair : s_m_resources)
+	{
+		ResourceState state = pair.second->GetState();
+		ResourceMemoryInfo info = { pair.first, pair.second->GetTypeName(), state, 0, 0 };
+		// A worker is still filling it
+		if (state != ResourceState::Queued && state != ResourceState::Reading)
+		{
+			info.cpuBytes = pair.second->GetCpuBytes();
+			info.gpuBytes = pair.second->GetGpuBytes();
+		}
+		report.push_back(info);
+	}
+	std::sort(report.begin(), report.end(), [](const ResourceMemoryInfo& _a, const ResourceMemoryInfo& _b) {
+		return _a.cpuBytes + _a.gpuBytes > _b.cpuBytes + _b.gpuBytes; });
+	return report;
+}
+
+std::vector<ResourceMemoryTotals> ResourcesManager::GetMemoryTotalsByType()
+{
+	std::vector<ResourceMemoryTotals> totals;
+	for (const ResourceMemoryInfo& info : GetMemoryReport())
+	{
+		auto it = std::find_if(totals.begin(), totals.end(), [&info](const ResourceMemoryTotals& _total) {
+			return std::strcmp(_total.type, info.type) == 0; });
+		if (it == totals.end())
+			totals.push_back({ info.type, 1, info.cpuBytes, info.gpuBytes });
+		else
+		{
+			it->count++;
+			it->cpuBytes += info.cpuBytes;
+			it->gpuBytes += info.gpuBytes;
+		}
+	}
+	std::sort(totals.begin(), totals.end(), [](const ResourceMemoryTotals& _a, const ResourceMemoryTotals& _b) {
+		return _a.cpuBytes + _a.gpuBytes > _b.cpuBytes + _b.gpuBytes; });
+	return totals;
+}
+
+void ResourcesManager::ShowImGuiMemory()
+{
+	// 0: Total, 1: CPU, 2: GPU
+	static int s_sortColumn = 0;
+	auto toMB = [](size_t _bytes) { return static_cast<float>(_bytes) / (1024.f * 1024.f); };
+
+	std::vector<ResourceMemoryTotals> totals = GetMemoryTotalsByType();
+	size_t cpuTotal = 0, gpuTotal = 0;
+	for (const ResourceMemoryTotals& total : totals)
+	{
+		cpuTotal += total.cpuBytes;
+		gpuTotal += total.gpuBytes;
+	}
+	ImGui::Text("RAM: %.2f MB  VRAM (est.): %.2f MB", toMB(cpuTotal), toMB(gpuTotal));
+
+	ImGui::Columns(4, "memoryByType");
+	ImGui::Text("Type"); ImGui::NextColumn();
+	ImGui::Text("Count"); ImGui::NextColumn();
+	ImGui::Text("CPU (MB)"); ImGui::NextColumn();
+	ImGui::Text("GPU (MB)"); ImGui::NextColumn();
+	ImGui::Separator();
+	for (const ResourceMemoryTotals& total : totals)
+	{
+		ImGui::Text("%s", total.type); ImGui::NextColumn();
+		ImGui::Text("%zu", total.count); ImGui::NextColumn();
+		ImGui::Text("%.2f", toMB(total.cpuBytes)); ImGui::NextColumn();
+		ImGui::Text("%.2f", toMB(total.gpuBytes)); ImGui::NextColumn();
+	}
+	ImGui::Columns(1);
+	ImGui::Separator();
+
+	std::vector<ResourceMemoryInfo> report = GetMemoryReport();
+	if (s_sortColumn != 0)
+		std::stable_sort(report.begin(), report.end(), [](const ResourceMemoryInfo& _a, const ResourceMemoryInfo& _b) {
+			return s_sortColumn == 1 ? _a.cpuBytes > _b.cpuBytes : _a.gpuBytes > _b.gpuBytes; });
+
+	// Click on a size header to sort by it
+	ImGui::Columns(5, "memoryByResource");
+	ImGui::Text("Resource"); ImGui::NextColumn();
+	ImGui::Text("State"); ImGui::NextColumn();
+	if (ImGui::Selectable("CPU (MB)", s_sortColumn == 1)) s_sortColumn = 1;
+	ImGui::NextColumn();
+	if (ImGui::Selectable("GPU (MB)", s_sortColumn == 2)) s_sortColumn = 2;
+	ImGui::NextColumn();
+	if (ImGui::Selectable("Total (MB)", s_sortColumn == 0)) s_sortColumn = 0;
+	ImGui::NextColumn();
+	ImGui::Separator();
+	for (const ResourceMemoryInfo& info : report)
+	{
+		ImGui::Text("%s (%s)", info.name.c_str(), info.type); ImGui::NextColumn();
+		ImGui::Text("%s", ResourceStateName(info.state)); ImGui::NextColumn();
+		ImGui::Text("%.3f", toMB(info.cpuBytes)); ImGui::NextColumn();
+		ImGui::Text("%.3f", toMB(info.gpuBytes)); ImGui::NextColumn();
+		ImGui::Text("%.3f", toMB(info.cpuBytes + info.gpuBytes)); ImGui::NextColumn();
+	}
+	ImGui::Columns(1);
 }
\ No newline at end of file
@@ -14,6 +14,11 @@ Scene::~Scene() {
 void Scene::Init()
 {
 	DEBUG_LOG(isMultiThreaded ? "\nMultithread\n" : "\nMonoThreaded\n");
+	// The previous load's tasks (and late per-frame helpers) must not record while the buffers are reset
+	ResourcesManager::GetThreadPool().WaitIdle();
+	Tracer::Clear();
+	Tracer::SetThreadName("Main (OpenGL)");
+	TRACE_SCOPE("scene", "Init");
 	using namespace std::chrono;
 	m_startLoad = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
 	m_orbInitDone = false;
@@ -22,9 +27,14 @@ void Scene::Init()
 	//InitComponents
 	models.resize(ModelName::size_model + 16, nullptr);
 	textures.resize(TextureName::size_texture, nullptr);
+	// Read by ResourceFileRead: set before any load is queued. The building is an occluder, decoded by its worker
+	Model::SetOccluder("objBuilding", true);
 
 	if (isMultiThreaded)
-		m_oneThreadToRuleThemAll = std::thread([this] { InitThread(); });
+		m_oneThreadToRuleThemAll = std::thread([this] {
+			Tracer::SetThreadName("Scene loader");
+			InitThread();
+		});
 	InitShaders();
 	InitLights();
 	InitGraph();
@@ -38,6 +48,8 @@ void Scene::Init()
 		m_durationLoad = m_endLoad - m_startLoad;
 		Log::Print("Time total for loading: %u ms.", m_durationLoad);
 		m_globalInitDone = true;
+		Mesh::LogIndexStats();
+		Tracer::ExportChromeJson("LoadTrace_mono.json");
 	}
 	m_justRestarted = false;
 }
@@ -66,6 +78,10 @@ void Scene::InitContinue()
 		m_durationLoad = m_endLoad - m_startLoad;													//
 		Log::Print("Time total for loading: %u ms.", m_durationLoad);							    //
 		m_globalInitDone = true;
+		ResourcesManager::LogThroughputs();
+		ResourcesManager::LogPrefetchStats();
+		Mesh::LogIndexStats();
+		Tracer::ExportChromeJson("LoadTrace_multi.json");
 	}
 }
 
@@ -97,6 +113,7 @@ void Scene::Draw() {
 
 void Scene::Destroy()
 {
+	graph.batcher.Release();
 	directionalLights.clear();
 	pointLights.clear();
 	spotLights.clear();
@@ -111,6 +128,7 @@ void Scene::Restart()
 	ResourcesManager::Destroy();
 	Scene::Destroy();
 	graph.Destroy();
+	m_crowd.clear();
 
 	isMultiThreaded = !isMultiThreaded; // Change the option multiThread<->monoThread
 
@@ -119,8 +137,38 @@ void Scene::Restart()
 	m_justRestarted = true;
 }
 
+void Scene::SpawnCrowd(size_t _count)
+{
+	graph.RemoveEntities(m_crowd);
+	m_crowd.clear();
+	if (_count == 0)
+		return;
+	if (models.size() <= cube_m || !models[cube_m] || !models[cube_m]->IsLoaded())
+	{
+		DEBUG_WARNING("Crowd: the cube is not loaded yet");
+		return;
+	}
+
+	// Square grid under the scene, centered on the origin
+	const float spacing = 1.5f;
+	size_t side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(_count))));
+	float start = -0.5f * spacing * (side - 1);
+	m_crowd.reserve(_count);
+	for (size_t i = 0; i < _count; i++)
+	{
+		Vectorf3 position(start + spacing * (i % side), -3.f, start + spacing * (i / side));
+		graph.AddEntity(models[cube_m], nullptr, Transform(position, {}, { 0.5f, 0.5f, 0.5f }));
+		SceneNode* entity = graph.entities.back();
+		entity->material = material::list[i % std::size(material::list)];
+		entity->shader = shadLight;
+		m_crowd.push_back(entity);
+	}
+}
+
 void Scene::InitThread()
 {
+	TRACE_SCOPE("scene", "InitThread");
+	ResourcesManager::BeginLoadBatch();
 	ResourcesManager::CreateResourceThreaded<Texture>("white.png");
 	ResourcesManager::CreateResourceThreaded<Model>("Horse");
 
@@ -152,10 +200,12 @@ void Scene::InitThread()
 	ResourcesManager::CreateResourceThreaded<Model>("big_blue7");
 	ResourcesManager::CreateResourceThreaded<Model>("big_blue8");
 	ResourcesManager::CreateResourceThreaded<Model>("big_blue9");
+	ResourcesManager::SubmitLoadBatch();
 }
 
 void Scene::InitResources()
 {
+	TRACE_SCOPE("scene", "InitResources");
 	// The glorious, all important WHITE
 	if (!textures[white_t])
 		textures[white_t] = ResourcesManager::CreateResource<Texture>("white.png", isMultiThreaded);
@@ -272,6 +322,7 @@ void Scene::InitGraph()
 	graph.AddEntity(nullptr, nullptr, Transform({ 0.f,1.f,-0.5f }));
 	// Building [3]
 	graph.AddEntity(nullptr, nullptr, Transform({ 5.f,0.f, 0.f }, {}, { 0.1f,0.2f, 0.3f }));
+	graph.entities[building_e]->occluder = true;
 	// Orbit [4]
 	graph.AddEntity(nullptr, nullptr, Transform({ -7.f,0.f,0.f }));
 	graph.entities[orbit_e]->AddChild(graph.entities[robot_e], true);
@@ -290,14 +341,15 @@ void Scene::InitGraph()
 
 void Scene::InitModels()
 {
+	TRACE_SCOPE("scene", "InitModels");
 	// Viking Room [0]
-	if (models[viking_room_m] && models[viking_room_m]->IsReadFinished())
+	if (models[viking_room_m] && models[viking_room_m]->BeginUpload())
 	{
 		models[viking_room_m]->ResourceLoadOpenGL("viking_room");
 		graph.entities[0]->model = models[viking_room_m];
 	}
 	// Set Viking Room texture
-	if (textures[viking_room_t] && textures[viking_room_t]->IsReadFinished())
+	if (textures[viking_room_t] && textures[viking_room_t]->BeginUpload())
 	{
 		textures[viking_room_t]->ResourceLoadOpenGL("viking_room.jpg");
 		graph.entities[viking_room_e]->material.AttachDiffuseMap(textures[viking_room_t]);
@@ -305,26 +357,26 @@ void Scene::InitModels()
 	}
 
 	// Robot [1]s
-	if (models[robot_m] && models[robot_m]->IsReadFinished())
+	if (models[robot_m] && models[robot_m]->BeginUpload())
 	{
 		models[robot_m]->ResourceLoadOpenGL("robot_operator");
 		graph.entities[robot_e]->model = models[robot_m];
 	}
 	// Set Robot texture
-	if (textures[robot_base_t] && textures[robot_base_t]->IsReadFinished())
+	if (textures[robot_base_t] && textures[robot_base_t]->BeginUpload())
 	{
 		textures[robot_base_t]->ResourceLoadOpenGL("robot/base.png");
 		graph.entities[robot_e]->material.AttachDiffuseMap(textures[robot_base_t]);
 	}
 	// Set Robot lighting texture
-	if (textures[robot_roughness_t] && textures[robot_roughness_t]->IsReadFinished())
+	if (textures[robot_roughness_t] && textures[robot_roughness_t]->BeginUpload())
 	{
 		textures[robot_roughness_t]->ResourceLoadOpenGL("robot/roughness.png");
 		graph.entities[robot_e]->material.AttachSpecularMap(textures[robot_roughness_t]);
 	}
 
 	// Copper Cube [2]
-	if (models[cube_m] && models[cube_m]->IsReadFinished())
+	if (models[cube_m] && models[cube_m]->BeginUpload())
 	{
 		models[cube_m]->ResourceLoadOpenGL("cube");
 		graph.entities[copper_cube_e]->model = graph.entities[orb1_e]->model = graph.entities[orb2_e]->model = graph.entities[orb3_e]->model = models[cube_m];
@@ -335,21 +387,21 @@ void Scene::InitModels()
 	}
 
 	// Building [3]
-	if (models[building_m] && models[building_m]->IsReadFinished())
+	if (models[building_m] && models[building_m]->BeginUpload())
 	{
 		models[building_m]->ResourceLoadOpenGL("objBuilding");
 		graph.entities[building_e]->model = models[building_m];
 	}
 
 	// Bind texture to entity
-	if (textures[objBuilding_brck91L_t] && textures[objBuilding_brck91L_t]->IsReadFinished())
+	if (textures[objBuilding_brck91L_t] && textures[objBuilding_brck91L_t]->BeginUpload())
 	{
 		textures[objBuilding_brck91L_t]->ResourceLoadOpenGL("objBuilding/brck91L.jpg");
 		graph.entities[building_e]->material.AttachDiffuseMap(textures[objBuilding_brck91L_t]);
 	}
 
 	// Bind texture to entity
-	if (textures[objBuilding_brck91Lb_t] && textures[objBuilding_brck91Lb_t]->IsReadFinished())
+	if (textures[objBuilding_brck91Lb_t] && textures[objBuilding_brck91Lb_t]->BeginUpload())
 	{
 		textures[objBuilding_brck91Lb_t]->ResourceLoadOpenGL("objBuilding/brck91Lb.jpg");
 		graph.entities[building_e]->material.AttachSpecularMap(textures[objBuilding_brck91Lb_t]);
@@ -377,7 +429,7 @@ void Scene::InitModels()
 	}
 
 	// LOOK AT MY HORSE [8]
-	if (models[horse_m] && models[horse_m]->IsReadFinished() && textures[white_t])
+	if (textures[white_t] && models[horse_m] && models[horse_m]->BeginUpload())
 	{
 		models[horse_m]->ResourceLoadOpenGL("Horse");
 		graph.entities[horse_e]->model = models[horse_m];
@@ -388,7 +440,7 @@ void Scene::InitModels()
 	}
 
 	// Big Blue [9]
-	if (models[big_blue_m] && models[big_blue_m]->IsReadFinished() && textures[white_t])
+	if (textures[white_t] && models[big_blue_m] && models[big_blue_m]->BeginUpload())
 	{
 		models[big_blue_m]->ResourceLoadOpenGL("big_blue");
 		graph.entities[big_blue_e]->model = models[big_blue_m];
@@ -399,14 +451,15 @@ void Scene::InitModels()
 	}
 
 	for (int i = 6; i < 22; i++)
-		if (models[i] && models[i]->IsReadFinished())
-			models[i]->BypassLoad();
+		if (models[i])
+			models[i]->SkipUpload(); // Only read for the loading benchmark
 	// Do this last
 	graph.InitDefaultShader(*shadLight);
 }
 
 void Scene::InitShaders()
 {
+	TRACE_SCOPE("scene", "InitShaders");
 	shadLight = ResourcesManager::CreateResource<Shader>("shadLight", false);
 	shadLightCube = ResourcesManager::CreateResource<Shader>("shadLightCube", false);
 
@@ -432,9 +485,15 @@ void Scene::InitMaterials()
 	// Only once and after white.png has been loaded
 	if (m_materialsInitDone)
 		return;
+	TRACE_SCOPE("scene", "InitMaterials");
 
-	if (textures[white_t]->IsReadFinished())
+	if (!textures[white_t])
+		return;
+	if (textures[white_t]->BeginUpload())
 		textures[white_t]->ResourceLoadOpenGL("white.png");
+	// Wait for the upload (or the failure) before attaching it
+	if (!textures[white_t]->IsSettled())
+		return;
 
 	material::none.AttachDiffuseMap(textures[white_t]);
 	material::none.AttachSpecularMap(textures[white_t]);
@@ -1,5 +1,7 @@
 #include <Shader.hpp>
 
+#include <GLState.hpp>
+
 Shader::Shader()
 {
 	s_m_totalShaderNumber++;
@@ -35,13 +37,15 @@ bool Shader::ReadVertexShader(std::filesystem::path const& _filename)
 		success = true;
 	} // Safe if file isn't open
 
-	m_isRead = true;
+	if (GetState() < ResourceState::Decoded)
+		SetState(ResourceState::Decoded);
 	file.close();
 	return success;
 }
 
 bool Shader::SetVertexShader()
 {
+	TRACE_SCOPE("shader", "Compile vertex", m_resourcePath.c_str());
 	int  success = 0; // false
 	const char* vertSrc = m_vertexShaderSource.c_str();
 	m_vertexShader = glCreateShader(GL_VERTEX_SHADER);
@@ -79,13 +83,15 @@ bool Shader::ReadFragmentShader(std::filesystem::path const& _filename)
 		success = true;
 	}// Safe if file isn't open
 
-	m_isRead = true;
+	if (GetState() < ResourceState::Decoded)
+		SetState(ResourceState::Decoded);
 	file.close();
 	return success;
 }
 
 bool Shader::SetFragmentShader()
 {
+	TRACE_SCOPE("shader", "Compile fragment", m_resourcePath.c_str());
 	int success = 0; // false
 	const char* fragSrc = m_fragmentShaderSource.c_str();
 
@@ -105,6 +111,7 @@ bool Shader::SetFragmentShader()
 
 bool Shader::Link()
 {
+	TRACE_SCOPE("shader", "Link", m_resourcePath.c_str());
 	m_shaderProgram = glCreateProgram();
 	glAttachShader(m_shaderProgram, m_vertexShader);
 	glAttachShader(m_shaderProgram, m_fragmentShader);
@@ -125,7 +132,7 @@ bool Shader::Link()
 		Log::ResetColor();
 	}
 
-	m_isLoaded = true;
+	SetState(success ? ResourceState::Ready : ResourceState::Failed);
 	DeleteVertFrag(); // Maybe you delete in any case
 	return success;
 }
@@ -139,6 +146,7 @@ void Shader::ResourceUnload()
 {
 	DeleteVertFrag();
 	DeleteProgram();
+	SetState(ResourceState::Evicted);
 }
 
 void Shader::DeleteVertFrag()
@@ -147,12 +155,14 @@ void Shader::DeleteVertFrag()
 	glDeleteShader(m_fragmentShader);
 }
 
-void Shader::DeleteProgram() {
+void Shader::DeleteProgram()
+{
 	glDeleteProgram(m_shaderProgram);
+	GLState::ForgetProgram(m_shaderProgram);
 }
 
 void Shader::Use() {
-	glUseProgram(m_shaderProgram);
+	GLState::UseProgram(m_shaderProgram);
 }
 
 void Shader::ResetCount() {
@@ -161,8 +171,8 @@ void Shader::ResetCount() {
 
 void Shader::SetBool(const std::string& _name, bool _value) const
 {
-	//Should always work, if not change this to int
-	int valueLocation = static_cast<bool>(glGetUniformLocation(m_shaderProgram, _name.c_str()));
+	// GLSL bools are set as ints
+	int valueLocation = glGetUniformLocation(m_shaderProgram, _name.c_str());
 	glUniform1i(valueLocation, _value);
 }
 
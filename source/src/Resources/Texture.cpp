@@ -1,55 +1,102 @@
 #include <Texture.hpp>
 
+#include <chrono>
+
+#include <GLState.hpp>
+
 Texture::~Texture() {
 	ResourceUnload();
 };
 
 void Texture::ResourceFileRead(const std::string _name)
 {
-	std::filesystem::path path = "assets/textures/";
-	path += _name;
+	TRACE_SCOPE("texture", "Decode", _name.c_str());
+	std::filesystem::path path = GetSourceFile(_name);
 
 	// Could be problematic on models
 	stbi_set_flip_vertically_on_load(true);
 
+	auto start = std::chrono::steady_clock::now();
 	m_data = stbi_load(path.string().c_str(), &m_width, &m_height, &m_channels, 0);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-	m_isRead = true;
+	if (!m_data)
+	{
+		DEBUG_WARNING("Failed to read Texture %s", _name.c_str());
+		SetState(ResourceState::Failed);
+		return;
+	}
+	std::error_code error;
+	uintmax_t fileBytes = std::filesystem::file_size(path, error);
+	SetReadCost(path, error ? 0 : fileBytes, seconds);
+	SetState(ResourceState::Decoded);
 }
 
 void Texture::ResourceLoadOpenGL(const std::string _name)
 {
-	if (m_data)
+	TRACE_SCOPE("texture", "Upload", _name.c_str());
+	GLenum format = 0;
+	if (m_channels == 1)
+		format = GL_RED;
+	else if (m_channels == 3)
+		format = GL_RGB;
+	else if (m_channels == 4)
+		format = GL_RGBA;
+
+	bool uploaded = m_data && format != 0;
+	if (uploaded)
 	{
 		glGenTextures(1, &m_resourceId);
-		glActiveTexture(GL_TEXTURE0 + m_resourceId);
-		glBindTexture(GL_TEXTURE_2D, m_resourceId);
+		GLState::BindTexture(m_resourceId, GL_TEXTURE_2D, m_resourceId);
 
 		// Set the texture wrapping/filtering options (on the currently bound texture object)
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); // MIPMAP is only for minifier
-		GLenum format = 0;
-		if (m_channels == 1)
-			format = GL_RED;
-		else if (m_channels == 3)
-			format = GL_RGB;
-		else if (m_channels == 4)
-			format = GL_RGBA;
-		else
-			Assert(true, std::string("Invalid number of channels in texture file ") + _name);
 		glTexImage2D(GL_TEXTURE_2D, 0, format, m_width, m_height, 0, format, GL_UNSIGNED_BYTE, m_data);
 		glGenerateMipmap(GL_TEXTURE_2D);
+		// Drivers pad RGB to RGBA, the mip chain adds a third
+		size_t bytesPerTexel = m_channels == 3 ? 4 : m_channels;
+		m_gpuBytes = static_cast<size_t>(m_width) * m_height * bytesPerTexel * 4 / 3;
+	}
+	else if (m_data)
+	{
+		DEBUG_WARNING("Failed to load Texture %s: %d channels", _name.c_str(), m_channels);
 	}
 	else
 	{
 		DEBUG_WARNING("Failed to load Texture %s", _name.c_str());
 	}
 	stbi_image_free(m_data);
-	m_isLoaded = true;
+	m_data = nullptr;
+	// Waiters must not take a texture without GL object for a loaded one
+	SetState(uploaded ? ResourceState::Ready : ResourceState::Failed);
 }
 
-void Texture::ResourceUnload() {
+void Texture::ResourceUnload()
+{
 	glDeleteTextures(1, &m_resourceId);
+	GLState::ForgetTexture(m_resourceId);
+	m_gpuBytes = 0;
+	SetState(ResourceState::Evicted);
+}
+
+std::filesystem::path Texture::GetSourceFile(const std::string& _name) const
+{
+	std::filesystem::path path = "assets/textures/";
+	path += _name;
+	return path;
+}
+
+// Decoded pixels, freed once uploaded
+size_t Texture::GetCpuBytes() const
+{
+	if (!m_data)
+		return 0;
+	return static_cast<size_t>(m_width) * m_height * m_channels;
+}
+
+size_t Texture::GetGpuBytes() const {
+	return m_gpuBytes;
 }
\ No newline at end of file